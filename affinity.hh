@@ -0,0 +1,225 @@
+#ifndef AFFINITY_HH
+#define AFFINITY_HH
+
+/*
+ * Binding of jobs to sets of CPUs (the -B option).  Each job is run in
+ * one of the job slots given by -j, and the slot with index I is bound
+ * to the set of CPUs with index I modulo the number of sets.  The sets
+ * are either given explicitly in the format of Linux CPU lists
+ * separated by colons, e.g., "0-7,16-23:8-15,24-31", or by "numa", in
+ * which case there is one set for each NUMA node containing CPUs.  In
+ * the latter case, consecutive slots are bound to different nodes,
+ * such that the jobs are distributed over all nodes, and each job runs
+ * on a single node.
+ *
+ * Supported only when sched_setaffinity(2) is available, i.e., on Linux.
+ */
+
+#ifndef USE_AFFINITY
+#   ifdef __linux__
+#      define USE_AFFINITY 1
+#   else
+#      define USE_AFFINITY 0
+#   endif
+#endif
+
+#include <dirent.h>
+#if USE_AFFINITY
+#   include <sched.h>
+#endif
+
+#include "error.hh"
+#include "format.hh"
+
+class Affinity
+{
+public:
+
+	static void open(const char *spec);
+	/* Parse the argument of -B */
+
+	static bool is_used()  {  return ! sets.empty();  }
+
+	static int acquire();
+	/* Return the index of a free slot, and mark it as used */
+
+	static void release(int slot);
+
+	static void apply(int slot);
+	/* Called in the child process of a job.  Bind the process to
+	 * the set of CPUs of SLOT.  On errors, output a message and
+	 * exit.  */
+
+private:
+
+#if USE_AFFINITY
+	static vector <cpu_set_t> sets;
+#else
+	static vector <int> sets;
+#endif
+
+	static vector <bool> slots;
+	/* Whether each slot is used */
+
+	static bool parse(const string &list, size_t &count);
+	/* Parse a CPU list into a new element of SETS.  Return FALSE on
+	 * syntax errors.  COUNT is set to the number of CPUs.  */
+};
+
+#if USE_AFFINITY
+vector <cpu_set_t> Affinity::sets;
+#else
+vector <int> Affinity::sets;
+#endif
+vector <bool> Affinity::slots;
+
+void Affinity::open(const char *spec)
+{
+	Place place(Place::Type::OPTION, 'B');
+#if USE_AFFINITY
+	vector <string> lists;
+	if (! strcmp(spec, "numa")) {
+		const char *dir_nodes= "/sys/devices/system/node";
+		DIR *d= opendir(dir_nodes);
+		if (d == nullptr) {
+			print_error_system(dir_nodes);
+			exit(ERROR_FATAL);
+		}
+		vector <long> nodes;
+		struct dirent *entry;
+		while ((entry= readdir(d)) != nullptr) {
+			if (strncmp(entry->d_name, "node", 4)
+			    || ! isdigit((unsigned char) entry->d_name[4]))
+				continue;
+			nodes.push_back(strtol(entry->d_name + 4, nullptr, 10));
+		}
+		closedir(d);
+		sort(nodes.begin(), nodes.end());
+		for (long node:  nodes) {
+			string filename= frmt("%s/node%ld/cpulist", dir_nodes, node);
+			FILE *file= fopen(filename.c_str(), "r");
+			if (file == nullptr) {
+				print_error_system(filename);
+				exit(ERROR_FATAL);
+			}
+			char *lineptr= nullptr;
+			size_t n= 0;
+			ssize_t len= getline(&lineptr, &n, file);
+			if (len < 0) {
+				print_error_system(filename);
+				exit(ERROR_FATAL);
+			}
+			while (len > 0 && lineptr[len - 1] == '\n')
+				lineptr[--len]= '\0';
+			/* Nodes without CPUs have an empty list */
+			if (len > 0)
+				lists.push_back(lineptr);
+			free(lineptr);
+			fclose(file);
+		}
+		if (lists.empty()) {
+			place << fmt("no NUMA nodes with CPUs found in %s",
+				     name_format_word(dir_nodes));
+			exit(ERROR_FATAL);
+		}
+	} else {
+		const char *p= spec;
+		while (true) {
+			const char *q= strchr(p, ':');
+			lists.push_back(q ? string(p, q - p) : string(p));
+			if (! q)
+				break;
+			p= q + 1;
+		}
+	}
+	for (const string &list:  lists) {
+		size_t count;
+		if (! parse(list, count)) {
+			place << fmt("expected a list of CPUs, not %s",
+				     name_format_word(list));
+			exit(ERROR_FATAL);
+		}
+		if (count == 0) {
+			place << fmt("list of CPUs %s must not be empty",
+				     name_format_word(list));
+			exit(ERROR_FATAL);
+		}
+	}
+#else /* ! USE_AFFINITY */
+	(void) spec;
+	place << "binding jobs to CPUs is not supported on this system";
+	exit(ERROR_FATAL);
+#endif /* ! USE_AFFINITY */
+}
+
+int Affinity::acquire()
+{
+	size_t slot= 0;
+	while (slot < slots.size() && slots[slot])
+		++slot;
+	if (slot == slots.size())
+		slots.push_back(true);
+	else
+		slots[slot]= true;
+	return slot;
+}
+
+void Affinity::release(int slot)
+{
+	assert(slot >= 0 && (size_t) slot < slots.size());
+	assert(slots[slot]);
+	slots[slot]= false;
+}
+
+void Affinity::apply(int slot)
+{
+	assert(slot >= 0);
+#if USE_AFFINITY
+	if (0 > sched_setaffinity(0, sizeof(cpu_set_t), &sets[slot % sets.size()])) {
+		perror("sched_setaffinity");
+		_Exit(127);
+	}
+#endif
+}
+
+bool Affinity::parse(const string &list, size_t &count)
+{
+#if USE_AFFINITY
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	const char *p= list.c_str();
+	while (true) {
+		if (! isdigit((unsigned char) *p))
+			return false;
+		char *endptr;
+		errno= 0;
+		unsigned long first= strtoul(p, &endptr, 10), last= first;
+		p= endptr;
+		if (*p == '-') {
+			++p;
+			if (! isdigit((unsigned char) *p))
+				return false;
+			last= strtoul(p, &endptr, 10);
+			p= endptr;
+		}
+		if (errno || last < first || last >= CPU_SETSIZE)
+			return false;
+		for (unsigned long cpu= first;  cpu <= last;  ++cpu)
+			CPU_SET(cpu, &set);
+		if (*p == '\0')
+			break;
+		if (*p != ',')
+			return false;
+		++p;
+	}
+	count= CPU_COUNT(&set);
+	sets.push_back(set);
+	return true;
+#else
+	(void) list;
+	(void) count;
+	return false;
+#endif
+}
+
+#endif /* ! AFFINITY_HH */
@@ -7,10 +7,14 @@
  * targets are built in depth-first order (the default), or in random
  * order.  Which is used is determined by the global variable OPTION_VEC
  * defined in global.hh, which is set once before any Buffer object is
- * created.
+ * created.  In target order (-m target), a separate heap ordered by the
+ * hash of the dependencies' names is used, such that the order does not
+ * depend on the order in which dependencies were added.  The hash is
+ * computed once when a dependency is added.
  */
 
-#include <queue>
+#include <algorithm>
+#include <deque>
 #include <random>
 
 static default_random_engine buffer_generator;
@@ -25,6 +29,16 @@ size_t random_number(size_t n)
 	return distribution(buffer_generator); 
 }
 
+/*
+ * The key by which targets are ordered in target order (-m target).  A
+ * fixed hash function is used, such that the order is the same on all
+ * platforms.
+ */
+uint64_t order_key(string text)
+{
+	return hash_fnv(text); 
+}
+
 class Buffer
 {
 private:
@@ -34,13 +48,19 @@ private:
 
 	/* All contained dependencies are normalized */
 
-	queue <shared_ptr <const Dep> > q;
+	deque <shared_ptr <const Dep> > q;
 	vector <shared_ptr <const Dep> > v;
 
+	typedef pair <uint64_t, shared_ptr <const Dep> > Keyed; 
+	vector <Keyed> h;
+	/* The heap in target order, with the key of each dependency */ 
+
 public:
 
 	size_t size() const {
-		if (order_vec) 
+		if (order == Order::TARGET)
+			return h.size(); 
+		else if (order_vec) 
 			return v.size();
 		else
 			return q.size();
@@ -50,7 +70,12 @@ public:
 	/* Return the next element, removing it from the buffer at the
 	 * same time  */
 	{
-		if (order_vec) {
+		if (order == Order::TARGET) {
+			pop_heap(h.begin(), h.end(), after); 
+			shared_ptr <const Dep> ret= h.back().second;
+			h.pop_back(); 
+			return ret; 
+		} else if (order_vec) {
 			size_t s= v.size();
 			size_t k= random_number(s);
 			if (k + 1 < s) 
@@ -60,7 +85,7 @@ public:
 			return ret; 
 		} else {
 			shared_ptr <const Dep> ret= q.front();
-			q.pop(); 
+			q.pop_front(); 
 			return ret; 
 		}
 	}
@@ -70,20 +95,46 @@ public:
 	 * add) */ 
 	{
 		assert(d->is_normalized()); 
-		if (order_vec) {
+		if (order == Order::TARGET) {
+			h.emplace_back(order_key(d->format_src()), d); 
+			push_heap(h.begin(), h.end(), after); 
+		} else if (order_vec) {
 			v.emplace_back(d); 
 		} else {
-			q.push(d); 
+			q.push_back(d); 
 		}
 	}
 
-	bool empty() const {
+	void put_back(shared_ptr <const Dep> d)
+	/* Put back an element that was just returned by next(), such
+	 * that it is returned again by the next call to next() (if
+	 * sorted, otherwise, just add) */ 
+	{
 		if (order_vec) {
+			push(d); 
+		} else {
+			q.push_front(d); 
+		}
+	}
+
+	bool empty() const {
+		if (order == Order::TARGET) {
+			return h.empty(); 
+		} else if (order_vec) {
 			return v.empty();
 		} else {
 			return q.empty(); 
 		}
 	}
+
+private:
+
+	static bool after(const Keyed &a, const Keyed &b)
+	/* Comparison for the heap in target order:  the dependency with
+	 * the smallest key comes first */
+	{
+		return a.first > b.first; 
+	}
 };
 
 #endif /* ! BUFFER_HH */
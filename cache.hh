@@ -0,0 +1,613 @@
+#ifndef CACHE_HH
+#define CACHE_HH
+
+/*
+ * The output cache (the -O and -b options).  Before the command of a
+ * target is executed, a key is computed from the command, the
+ * environment variables of the job (parameters and variables), the
+ * redirections, the names of the file targets, and the names and
+ * SHA-256 digests of the input files, i.e., the direct file
+ * dependencies.  When an entry with that key exists, the file targets
+ * are written from it, and the command is not executed.  Otherwise, the
+ * command is executed, and when it succeeds, the file targets are
+ * stored under the key.  The output of commands is not stored.  Copy
+ * rules, rules with content and rules without file targets are not
+ * cached.
+ *
+ * Entries are kept in a store, which is one of:
+ *
+ *   - A directory, which may be shared, e.g., on a network file
+ *     system.  Entries are written under a temporary name and then
+ *     renamed, such that they are published atomically.  Each time an
+ *     entry is used, its modification time is updated.  When the total
+ *     size of the entries exceeds $STU_CACHE_SIZE (in megabytes;
+ *     default 1024), the least recently used entries are removed.  To
+ *     avoid scanning the store on each write, the file 'size' in the
+ *     store holds the approximate total size, to which each new entry
+ *     is added; the store is scanned only when that size exceeds the
+ *     limit, and additionally for one in EVICT_PERIOD entries, which
+ *     corrects the size lost by concurrent updates.
+ *
+ *   - The Unix socket of a cache server.  The reference server is
+ *     started with 'stu -O DIRECTORY -b SOCKET', and keeps its
+ *     entries in the given directory store.
+ *
+ * As with workers (-W), caching is done by the child process of the
+ * job:  it writes the files of an entry and exits, or forks the process
+ * that executes the command, waits for it, and stores the files.
+ *
+ * An entry consists of the number of files followed by the files,
+ * encoded as in the messages to workers.  File names must be relative
+ * and must not contain '..'; jobs with other file targets are not
+ * cached.  An entry is used only when its files are exactly the file
+ * targets of the job.  Messages to the cache server consist of "get" or
+ * "put" and the key, each terminated by '\0', followed by the entry for
+ * "put".  The response to "get" is "1" and '\0' followed by the entry,
+ * or "0" and '\0' when there is no entry.  The response to "put" is "1"
+ * and '\0'.
+ */
+
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+#include "digest.hh"
+#include "timestamp.hh"
+#include "worker.hh"
+
+class Cache
+{
+public:
+
+	static void open(const char *store_);
+	/* Use the given directory or cache server (-O) */
+
+	static bool is_used()  {  return store != nullptr;  }
+
+	static void prepare(const vector <string> &filenames_input_,
+			    const vector <string> &filenames_output_);
+	/* Set the input files and the file targets of the next job.
+	 * Called before the job is started.  */
+
+	static void run(const string &command,
+			const map <string, string> &mapping,
+			const string &filename_output,
+			const string &filename_input);
+	/* Called in the child process of a job before the command is
+	 * executed.  When the entry exists, write the file targets and
+	 * exit.  Otherwise, fork:  return in the new child process,
+	 * which executes the command, and in the parent, wait for it,
+	 * store the file targets when it succeeded, and exit with its
+	 * wait status.  Return immediately when the job is not
+	 * cached.  */
+
+	static void serve(const char *socket_name) __attribute__((noreturn));
+	/* Run as a cache server for the directory store (-b) */
+
+private:
+
+	static const char *store;
+
+	static bool is_server;
+	/* Whether STORE is the socket of a cache server */
+
+	static vector <string> filenames_input, filenames_output;
+
+	static char socket_served[sizeof(((struct sockaddr_un *) nullptr)->sun_path)];
+
+	static string key(const string &command,
+			  const map <string, string> &mapping,
+			  const string &filename_output,
+			  const string &filename_input);
+
+	static bool get(const string &k, string &entry);
+	static void put(const string &k, const string &entry);
+
+	static bool get_directory(const string &k, string &entry);
+	static bool put_directory(const string &k, const string &entry);
+	/* Return false on errors, with ERRNO set */
+
+	static const unsigned EVICT_PERIOD= 256;
+
+	static bool get_size_max(unsigned long long &size_max);
+	/* The maximal size of the directory store in bytes.  Return
+	 * false when $STU_CACHE_SIZE is invalid.  */
+
+	static void update_size(size_t size_entry);
+	/* Add the size of a new entry to the size file of the directory
+	 * store, and evict entries when needed */
+
+	static void evict();
+	/* Remove the least recently used entries of the directory
+	 * store, and write the size file */
+
+	static void write_size(unsigned long long size_total);
+
+	static bool request(const string &message, string &response);
+	/* Send a message to the cache server.  Return false on errors,
+	 * with ERRNO set.  */
+
+	static bool extract(const string &entry);
+	/* Write the file targets from the entry.  Return false when the
+	 * entry is invalid or does not contain all file targets.  */
+
+	static void handle(int fd) __attribute__((noreturn));
+	/* In a child process of the cache server */
+
+	static void terminate(int sig);
+	/* Signal handler in the cache server */
+};
+
+const char *Cache::store= nullptr;
+bool Cache::is_server= false;
+vector <string> Cache::filenames_input;
+vector <string> Cache::filenames_output;
+char Cache::socket_served[sizeof(((struct sockaddr_un *) nullptr)->sun_path)];
+
+void Cache::open(const char *store_)
+{
+	store= store_;
+	struct stat buf;
+	if (stat(store, &buf) < 0) {
+		print_error_system(store);
+		exit(ERROR_FATAL);
+	}
+	if (S_ISSOCK(buf.st_mode)) {
+		is_server= true;
+	} else if (! S_ISDIR(buf.st_mode)) {
+		Place(Place::Type::OPTION, 'O')
+			<< fmt("%s must be a directory or a socket",
+			       name_format_word(store));
+		exit(ERROR_FATAL);
+	}
+}
+
+void Cache::prepare(const vector <string> &filenames_input_,
+		    const vector <string> &filenames_output_)
+{
+	filenames_input= filenames_input_;
+	sort(filenames_input.begin(), filenames_input.end());
+	filenames_input.erase(unique(filenames_input.begin(), filenames_input.end()),
+			      filenames_input.end());
+	filenames_output= filenames_output_;
+}
+
+void Cache::run(const string &command,
+		const map <string, string> &mapping,
+		const string &filename_output,
+		const string &filename_input)
+{
+	if (filenames_output.empty())
+		return;
+	for (const string &name:  filenames_output)
+		if (! Worker::is_relative(name))
+			return;
+
+	const string k= key(command, mapping, filename_output, filename_input);
+	string entry;
+	if (get(k, entry) && extract(entry))
+		_Exit(0);
+
+	pid_t pid= fork();
+	if (pid < 0) {
+		perror("fork");
+		_Exit(127);
+	}
+	if (pid == 0)
+		return;
+
+	int status;
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR) {
+			perror("waitpid");
+			_Exit(127);
+		}
+	}
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+		entry= frmt("%zu", filenames_output.size());
+		entry += '\0';
+		bool complete= true;
+		for (const string &name:  filenames_output)
+			if (! Worker::append_file(entry, name, name))
+				complete= false;
+		if (complete)
+			put(k, entry);
+	}
+	if (WIFSIGNALED(status)) {
+		signal(WTERMSIG(status), SIG_DFL);
+		raise(WTERMSIG(status));
+	}
+	_Exit(WIFEXITED(status) ? WEXITSTATUS(status) : 127);
+}
+
+void Cache::serve(const char *socket_name)
+{
+	assert(is_used());
+	if (is_server) {
+		Place(Place::Type::OPTION, 'b')
+			<< fmt("the cache server must use a directory given by %s",
+			       multichar_format_word("-O"));
+		exit(ERROR_FATAL);
+	}
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family= AF_UNIX;
+	if (*socket_name == '\0' || strlen(socket_name) >= sizeof(addr.sun_path)) {
+		Place(Place::Type::OPTION, 'b')
+			<< fmt("invalid socket name %s", name_format_word(socket_name));
+		exit(ERROR_FATAL);
+	}
+	strcpy(addr.sun_path, socket_name);
+	strcpy(socket_served, socket_name);
+
+	int fd_listen= Daemon::socket_unix();
+	if (fd_listen < 0) {
+		print_error_system("socket");
+		exit(ERROR_FATAL);
+	}
+	if (connect(fd_listen, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+		print_error(fmt("Cache server is already running on socket %s",
+				name_format_word(socket_name)));
+		exit(ERROR_FATAL);
+	}
+	struct stat buf;
+	if (lstat(socket_name, &buf) == 0 && S_ISSOCK(buf.st_mode))
+		unlink(socket_name);
+	if (bind(fd_listen, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+	    listen(fd_listen, 64) < 0) {
+		print_error_system(socket_name);
+		exit(ERROR_FATAL);
+	}
+	signal(SIGINT,  terminate);
+	signal(SIGTERM, terminate);
+	signal(SIGHUP,  terminate);
+	/* Child processes are reaped automatically */
+	signal(SIGCHLD, SIG_IGN);
+
+	while (true) {
+		int fd_conn= Daemon::accept_cloexec(fd_listen);
+		if (fd_conn < 0) {
+			if (errno != EINTR && errno != ECONNABORTED)
+				print_error_system("accept");
+			continue;
+		}
+		pid_t pid= fork();
+		if (pid < 0)
+			print_error_system("fork");
+		if (pid == 0) {
+			close(fd_listen);
+			signal(SIGINT,  SIG_DFL);
+			signal(SIGTERM, SIG_DFL);
+			signal(SIGHUP,  SIG_DFL);
+			handle(fd_conn);
+		}
+		close(fd_conn);
+	}
+}
+
+string Cache::key(const string &command,
+		  const map <string, string> &mapping,
+		  const string &filename_output,
+		  const string &filename_input)
+{
+	Digest digest;
+	string text= "stu-cache-1";
+	text += '\0';
+	text += command;
+	text += '\0';
+	for (auto &i:  mapping) {
+		text += i.first + '=' + i.second;
+		text += '\0';
+	}
+	text += '\0';
+	text += filename_output;
+	text += '\0';
+	text += filename_input;
+	text += '\0';
+	for (const string &name:  filenames_output) {
+		text += name;
+		text += '\0';
+	}
+	text += '\0';
+	digest.update(text);
+
+	vector <string> names_input= filenames_input;
+	if (filename_input != "" &&
+	    find(names_input.begin(), names_input.end(), filename_input) == names_input.end())
+		names_input.push_back(filename_input);
+	for (const string &name:  names_input) {
+		/* Input files that do not exist are included as such */
+		Digest digest_file;
+		string content;
+		int fd= ::open(name.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd >= 0) {
+			if (! Daemon::read_all(fd, content)) {
+				perror(name.c_str());
+				_Exit(127);
+			}
+			close(fd);
+			digest_file.update(content);
+		}
+		text= name;
+		text += '\0';
+		text += fd >= 0 ? digest_file.hex() : "-";
+		text += '\0';
+		digest.update(text);
+	}
+	return digest.hex();
+}
+
+bool Cache::get(const string &k, string &entry)
+{
+	if (! is_server)
+		return get_directory(k, entry);
+
+	string message= "get";
+	message += '\0';
+	message += k;
+	message += '\0';
+	string response;
+	if (! request(message, response)) {
+		fprintf(stderr, "%s: %s: %s\n", PACKAGE, store, strerror(errno));
+		return false;
+	}
+	if (response.size() < 2 || response.compare(0, 2, string("1\0", 2)))
+		return false;
+	entry= response.substr(2);
+	return true;
+}
+
+void Cache::put(const string &k, const string &entry)
+{
+	bool ok;
+	if (! is_server) {
+		ok= put_directory(k, entry);
+	} else {
+		string message= "put";
+		message += '\0';
+		message += k;
+		message += '\0';
+		message += entry;
+		string response;
+		ok= request(message, response);
+	}
+	/* The job itself has succeeded */
+	if (! ok)
+		fprintf(stderr, "%s: %s: %s\n", PACKAGE, store, strerror(errno));
+}
+
+bool Cache::get_directory(const string &k, string &entry)
+{
+	string filename= frmt("%s/%s/%s", store, k.substr(0, 2).c_str(), k.c_str());
+	int fd= ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	bool ok= Daemon::read_all(fd, entry);
+	close(fd);
+	/* Mark the entry as recently used */
+	if (ok)
+		utimensat(AT_FDCWD, filename.c_str(), nullptr, 0);
+	return ok;
+}
+
+bool Cache::put_directory(const string &k, const string &entry)
+{
+	string dir= frmt("%s/%s", store, k.substr(0, 2).c_str());
+	if (mkdir(dir.c_str(), 0777) < 0 && errno != EEXIST)
+		return false;
+	string filename= dir + '/' + k;
+	string filename_tmp= frmt("%s/tmp.%ld.%s", store, (long) getpid(), k.c_str());
+	if (! Worker::write_file(filename_tmp, 0666, entry) ||
+	    rename(filename_tmp.c_str(), filename.c_str()) < 0) {
+		int errno_save= errno;
+		unlink(filename_tmp.c_str());
+		errno= errno_save;
+		return false;
+	}
+	/* The last two digits of the key are uniformly distributed */
+	if (strtoul(k.substr(k.size() - 2).c_str(), nullptr, 16) % EVICT_PERIOD == 0)
+		evict();
+	else
+		update_size(entry.size());
+	return true;
+}
+
+bool Cache::get_size_max(unsigned long long &size_max)
+{
+	const char *size_env= getenv("STU_CACHE_SIZE");
+	size_max= 1024;
+	if (size_env && *size_env) {
+		char *endptr;
+		errno= 0;
+		size_max= strtoull(size_env, &endptr, 10);
+		if (errno || *endptr)
+			return false;
+	}
+	size_max *= 1024 * 1024;
+	return true;
+}
+
+void Cache::update_size(size_t size_entry)
+{
+	string filename= string(store) + "/size";
+	string content;
+	unsigned long long size_total= 0;
+	int fd= ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd >= 0) {
+		if (Daemon::read_all(fd, content))
+			size_total= strtoull(content.c_str(), nullptr, 10);
+		close(fd);
+	}
+	size_total += size_entry;
+	unsigned long long size_max;
+	if (get_size_max(size_max) && size_total > size_max) {
+		evict();
+		return;
+	}
+	write_size(size_total);
+}
+
+void Cache::evict()
+{
+	unsigned long long size_max;
+	if (! get_size_max(size_max))
+		return;
+
+	struct Entry {
+		Timestamp time;
+		off_t size;
+		string filename;
+	};
+	vector <Entry> entries;
+	unsigned long long size_total= 0;
+	DIR *dir= opendir(store);
+	if (dir == nullptr)
+		return;
+	while (struct dirent *d= readdir(dir)) {
+		/* Only the subdirectories named by two hexadecimal digits,
+		 * in particular not '..' */
+		if (strlen(d->d_name) != 2 ||
+		    strspn(d->d_name, "0123456789abcdef") != 2)
+			continue;
+		string name_sub= string(store) + '/' + d->d_name;
+		DIR *dir_sub= opendir(name_sub.c_str());
+		if (dir_sub == nullptr)
+			continue;
+		while (struct dirent *e= readdir(dir_sub)) {
+			if (strlen(e->d_name) != 64 ||
+			    strspn(e->d_name, "0123456789abcdef") != 64)
+				continue;
+			string filename= name_sub + '/' + e->d_name;
+			struct stat buf;
+			if (stat(filename.c_str(), &buf) < 0 || ! S_ISREG(buf.st_mode))
+				continue;
+			entries.push_back(Entry{Timestamp(&buf), buf.st_size, filename});
+			size_total += buf.st_size;
+		}
+		closedir(dir_sub);
+	}
+	closedir(dir);
+
+	if (size_total > size_max) {
+		sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+				return a.time < b.time;
+			});
+		for (const Entry &entry:  entries) {
+			if (size_total <= size_max)
+				break;
+			if (unlink(entry.filename.c_str()) == 0 || errno == ENOENT)
+				size_total -= entry.size;
+		}
+	}
+
+	write_size(size_total);
+}
+
+void Cache::write_size(unsigned long long size_total)
+{
+	string filename= string(store) + "/size";
+	string filename_tmp= frmt("%s/tmp.%ld.size", store, (long) getpid());
+	if (! Worker::write_file(filename_tmp, 0666, frmt("%llu\n", size_total)) ||
+	    rename(filename_tmp.c_str(), filename.c_str()) < 0)
+		unlink(filename_tmp.c_str());
+}
+
+bool Cache::request(const string &message, string &response)
+{
+	int fd= Worker::connect_socket(store);
+	if (fd < 0)
+		return false;
+	bool ok= Daemon::write_all(fd, message) &&
+		shutdown(fd, SHUT_WR) == 0 &&
+		Daemon::read_all(fd, response);
+	int errno_save= errno;
+	close(fd);
+	errno= errno_save;
+	if (ok && (response.size() < 2 || response[1] != '\0')) {
+		errno= EPROTO;
+		return false;
+	}
+	return ok;
+}
+
+bool Cache::extract(const string &entry)
+{
+	size_t i= 0, count;
+	if (! Worker::next_number(entry, i, count))
+		return false;
+	vector <string> names, contents;
+	vector <mode_t> modes;
+	for (size_t k= 0;  k < count;  ++k) {
+		string name, content;
+		mode_t mode;
+		if (! Worker::next_file(entry, i, name, mode, content))
+			return false;
+		names.push_back(name);
+		modes.push_back(mode);
+		contents.push_back(content);
+	}
+	if (i != entry.size())
+		return false;
+	/* The names must be exactly the file targets */
+	vector <string> names_sorted= names, names_output= filenames_output;
+	sort(names_sorted.begin(), names_sorted.end());
+	names_sorted.erase(unique(names_sorted.begin(), names_sorted.end()),
+			   names_sorted.end());
+	sort(names_output.begin(), names_output.end());
+	names_output.erase(unique(names_output.begin(), names_output.end()),
+			   names_output.end());
+	if (names_sorted != names_output)
+		return false;
+	for (const string &name:  names)
+		if (! Worker::is_relative(name))
+			return false;
+	for (size_t k= 0;  k < count;  ++k) {
+		if (! Worker::write_file(names[k], modes[k], contents[k])) {
+			perror(names[k].c_str());
+			_Exit(127);
+		}
+	}
+	return true;
+}
+
+void Cache::handle(int fd)
+{
+	string message, response;
+	size_t i= 0;
+	string command, k, entry;
+	if (! Daemon::read_all(fd, message) ||
+	    ! Worker::next(message, i, command) ||
+	    ! Worker::next(message, i, k) ||
+	    k.size() != 64 ||
+	    k.find_first_not_of("0123456789abcdef") != string::npos)
+		_Exit(1);
+	if (command == "get") {
+		if (i != message.size())
+			_Exit(1);
+		if (get_directory(k, entry)) {
+			response= string("1\0", 2) + entry;
+		} else {
+			response= string("0\0", 2);
+		}
+	} else if (command == "put") {
+		if (! put_directory(k, message.substr(i)))
+			_Exit(1);
+		response= string("1\0", 2);
+	} else {
+		_Exit(1);
+	}
+	Daemon::write_all(fd, response);
+	_Exit(0);
+}
+
+void Cache::terminate(int sig)
+{
+	unlink(socket_served);
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+#endif /* ! CACHE_HH */
@@ -0,0 +1,253 @@
+#ifndef CGROUP_HH
+#define CGROUP_HH
+
+/*
+ * Placement of jobs into cgroups (the -G option; Linux only).  The
+ * given directory is a cgroup of the cgroup v2 hierarchy that Stu may
+ * modify, e.g., one delegated to the user.  Stu creates the cgroup
+ * 'stu.PID' in it, and each job is placed into its own leaf cgroup
+ * 'job.PID' below that, where PID is the process ID of Stu and of the
+ * job, respectively.  Limits are set in the leaf cgroup from the
+ * following variables, which are taken from the variable dependencies
+ * of the rule, or else from the environment of Stu:
+ *
+ *	$STU_CPU_MAX		cpu.max, e.g. "50000 100000"
+ *	$STU_MEMORY_MAX		memory.max, e.g. "2G"
+ *	$STU_IO_WEIGHT		io.weight, e.g. "50"
+ *
+ * The controllers needed for them are enabled in 'stu.PID' when
+ * available.
+ *
+ * All processes started by a job remain in its cgroup even when they
+ * change their process group, and are thus killed with the job: when
+ * the job has terminated, and when all jobs are terminated by a signal
+ * to Stu.  The cgroups are removed when the job has terminated and on
+ * exit.  Cgroups of Stu processes that are not running anymore, e.g.,
+ * after having been killed by SIGKILL, are removed by open().
+ *
+ * Like claiming (see claim.hh), placement is done in the child process
+ * of the job, before the command is executed.
+ */
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "error.hh"
+#include "format.hh"
+
+class Cgroup
+{
+public:
+
+	static void open(const char *directory);
+	/* Create the cgroup of Stu within DIRECTORY (-G) */
+
+	static bool is_used()  {  return filename_kill != nullptr;  }
+
+	static void enter(const map <string, string> &mapping);
+	/* Called in the child process of a job.  Create the leaf cgroup
+	 * of the job, set its limits from the variables in MAPPING or
+	 * in the environment, and move the process into it.  On
+	 * errors, output a message and exit.  */
+
+	static void remove(pid_t pid);
+	/* Kill all remaining processes of the terminated job PID and
+	 * remove its cgroup.  When they do not terminate immediately,
+	 * the cgroup is removed by close().  */
+
+	static void kill_all();
+	/* Kill all processes in the cgroups of jobs.
+	 * [ASYNC-SIGNAL-SAFE] */
+
+	static void close();
+	/* Remove all cgroups created by Stu; called on exit */
+
+private:
+
+	static string dir;
+	/* The cgroup of this Stu process */
+
+	static char *filename_kill;
+	/* The file 'cgroup.kill' of DIR; allocated with malloc(), as it
+	 * is used in async signal-safe functions.  Null when not used.  */
+
+	static bool write_file(string filename, string text);
+	/* Return FALSE with ERRNO set on error */
+
+	static bool remove_dir(string directory, bool wait);
+	/* Kill all processes in the cgroup DIRECTORY, and remove it.
+	 * Processes are killed asynchronously; with WAIT, wait a short
+	 * time for them.  Return FALSE with ERRNO set when the cgroup
+	 * could not be removed.  */
+
+	static bool remove_all(string directory);
+	/* Remove the cgroup DIRECTORY of a Stu process including the
+	 * cgroups of its jobs.  Return FALSE with ERRNO set on error.  */
+};
+
+string Cgroup::dir;
+char *Cgroup::filename_kill= nullptr;
+
+void Cgroup::open(const char *directory)
+{
+	string filename_procs= string(directory) + "/cgroup.procs";
+	struct stat buf;
+	if (stat(filename_procs.c_str(), &buf) < 0) {
+		print_error_system(filename_procs);
+		exit(ERROR_FATAL);
+	}
+
+	/* Remove the cgroups of Stu processes that are not running */
+	DIR *d= opendir(directory);
+	if (d == nullptr) {
+		print_error_system(directory);
+		exit(ERROR_FATAL);
+	}
+	struct dirent *entry;
+	while ((entry= readdir(d)) != nullptr) {
+		if (strncmp(entry->d_name, "stu.", 4))
+			continue;
+		char *endptr;
+		errno= 0;
+		long pid= strtol(entry->d_name + 4, &endptr, 10);
+		if (errno || *endptr || pid <= 0 || pid == getpid())
+			continue;
+		if (::kill(pid, 0) == 0 || errno != ESRCH)
+			continue;
+		remove_all(string(directory) + '/' + entry->d_name);
+	}
+	closedir(d);
+
+	dir= frmt("%s/stu.%ld", directory, (long) getpid());
+	if (mkdir(dir.c_str(), 0777) < 0) {
+		print_error_system(dir);
+		exit(ERROR_FATAL);
+	}
+	filename_kill= strdup((dir + "/cgroup.kill").c_str());
+	if (filename_kill == nullptr) {
+		print_error_system("strdup");
+		exit(ERROR_FATAL);
+	}
+
+	/* Enable the controllers used for limits, when they are
+	 * available in the parent.  Errors are ignored here, and
+	 * reported when a limit is set.  */
+	for (const char *controller:  {"cpu", "memory", "io"}) {
+		string text= string("+") + controller;
+		write_file(string(directory) + "/cgroup.subtree_control", text);
+		write_file(dir + "/cgroup.subtree_control", text);
+	}
+}
+
+void Cgroup::enter(const map <string, string> &mapping)
+{
+	string dir_job= frmt("%s/job.%ld", dir.c_str(), (long) getpid());
+	if (mkdir(dir_job.c_str(), 0777) < 0) {
+		perror(dir_job.c_str());
+		_Exit(127);
+	}
+
+	static const char *const limits[][2]= {
+		{"STU_CPU_MAX",    "cpu.max"},
+		{"STU_MEMORY_MAX", "memory.max"},
+		{"STU_IO_WEIGHT",  "io.weight"},
+	};
+	for (const auto &limit:  limits) {
+		const char *value= nullptr;
+		auto i= mapping.find(limit[0]);
+		if (i != mapping.end())
+			value= i->second.c_str();
+		else
+			value= getenv(limit[0]);
+		if (value == nullptr || value[0] == '\0')
+			continue;
+		string filename= dir_job + '/' + limit[1];
+		if (! write_file(filename, value)) {
+			perror(filename.c_str());
+			_Exit(127);
+		}
+	}
+
+	string filename_procs= dir_job + "/cgroup.procs";
+	if (! write_file(filename_procs, "0")) {
+		perror(filename_procs.c_str());
+		_Exit(127);
+	}
+}
+
+void Cgroup::remove(pid_t pid)
+{
+	remove_dir(frmt("%s/job.%ld", dir.c_str(), (long) pid), false);
+}
+
+void Cgroup::kill_all()
+{
+	/* [ASYNC-SIGNAL-SAFE] We use only async signal-safe functions here */
+	if (filename_kill == nullptr)
+		return;
+	int fd= ::open(filename_kill, O_WRONLY);
+	if (fd < 0)
+		return;
+	ssize_t r= write(fd, "1", 1);
+	(void) r;
+	::close(fd);
+}
+
+void Cgroup::close()
+{
+	if (! is_used())
+		return;
+	/* Jobs that were terminated by job_terminate_all() are not
+	 * passed to remove() */
+	if (! remove_all(dir))
+		print_error_system(dir);
+	free(filename_kill);
+	filename_kill= nullptr;
+}
+
+bool Cgroup::write_file(string filename, string text)
+{
+	int fd= ::open(filename.c_str(), O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	ssize_t r= write(fd, text.c_str(), text.size());
+	int errno_save= errno;
+	::close(fd);
+	if (r != (ssize_t) text.size()) {
+		errno= r < 0 ? errno_save : EIO;
+		return false;
+	}
+	return true;
+}
+
+bool Cgroup::remove_dir(string directory, bool wait)
+{
+	/* 'cgroup.kill' is not available before Linux 5.14; then
+	 * remaining processes are not killed */
+	write_file(directory + "/cgroup.kill", "1");
+	for (int i= 0;  i < (wait ? 100 : 1);  ++i) {
+		if (rmdir(directory.c_str()) == 0)
+			return true;
+		if (errno != EBUSY)
+			return false;
+		if (wait)
+			usleep(10000);
+	}
+	return false;
+}
+
+bool Cgroup::remove_all(string directory)
+{
+	DIR *d= opendir(directory.c_str());
+	if (d == nullptr)
+		return false;
+	struct dirent *entry;
+	while ((entry= readdir(d)) != nullptr) {
+		if (! strncmp(entry->d_name, "job.", 4))
+			remove_dir(directory + '/' + entry->d_name, true);
+	}
+	closedir(d);
+	return remove_dir(directory, true);
+}
+
+#endif /* ! CGROUP_HH */
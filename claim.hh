@@ -0,0 +1,191 @@
+#ifndef CLAIM_HH
+#define CLAIM_HH
+
+/*
+ * Claiming of targets by cooperating Stu processes (the -l option).
+ * Before the command of a job is executed, the job claims its targets
+ * by locking a lock file in the given directory with flock(2).  When
+ * the lock is held by another process, which may be another Stu
+ * process building the same targets, the job waits until the lock is
+ * released.  If all file targets have been changed in the meantime,
+ * they are considered to have been built by the other process, and the
+ * command is not executed.  Otherwise, the command is executed while
+ * holding the lock.  The lock is held until the command and all
+ * processes started by it that keep the file descriptor open have
+ * terminated.
+ *
+ * The name of the lock file is derived from the absolute canonical name
+ * of the first file target, i.e., the canonical name of its directory
+ * followed by its basename, such that processes started in different
+ * directories, or naming the target differently, use the same lock
+ * file.  Lock files are never removed, such that a lock file cannot
+ * be replaced by a new one while another process is waiting for it.
+ * Locks are released by the kernel when a process terminates, and
+ * therefore processes that were killed do not leave stale locks.  The
+ * directory may be on a file system shared between hosts, if that file
+ * system supports flock(2).
+ *
+ * Claiming is done in the child process of the job, such that waiting
+ * for another process is done in the same way as waiting for a job.  In
+ * particular, a job that waits for another process occupies its job
+ * slot (-j) while waiting.  The name of the lock file is determined by
+ * prepare() in the parent process.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "error.hh"
+#include "format.hh"
+#include "timestamp.hh"
+
+class Claim
+{
+public:
+
+	static void open(const char *directory_);
+	/* Claim targets using the given directory (-l) */
+
+	static bool is_used() {  return directory != nullptr;  }
+
+	static void prepare(const vector <string> &filenames_);
+	/* Set the file targets of the next job.  Called before the
+	 * job is started.  */
+
+	static bool acquire();
+	/* Called in the child process of a job, before the command is
+	 * executed.  Claim the file targets set by prepare(), waiting
+	 * for another process if necessary.  Return whether the file
+	 * targets were built by another process, in which case the
+	 * command is not executed.  On errors, output a message and
+	 * exit.  */
+
+private:
+
+	static const char *directory;
+
+	static vector <string> filenames;
+	static string name_lock;
+	/* The lock file of the file targets set by prepare(), or empty */
+
+	static string name_canonical(string name);
+	/* The absolute name of the file, with the directory resolved by
+	 * realpath(3).  If the directory does not exist, the name is
+	 * only made absolute.  */
+
+	static string filename_lock(string name);
+};
+
+const char *Claim::directory= nullptr;
+vector <string> Claim::filenames;
+string Claim::name_lock;
+
+void Claim::open(const char *directory_)
+{
+	directory= directory_;
+	struct stat buf;
+	if (stat(directory, &buf) < 0) {
+		print_error_system(directory);
+		exit(ERROR_FATAL);
+	}
+	if (! S_ISDIR(buf.st_mode)) {
+		errno= ENOTDIR;
+		print_error_system(directory);
+		exit(ERROR_FATAL);
+	}
+}
+
+void Claim::prepare(const vector <string> &filenames_)
+{
+	filenames= filenames_;
+	name_lock= filenames.empty() ? ""
+		: filename_lock(name_canonical(filenames.front()));
+}
+
+bool Claim::acquire()
+{
+	if (filenames.empty())
+		return false;
+
+	const string &name= name_lock;
+	/* Not closed on exec, such that the lock is held by the
+	 * command */
+	int fd= ::open(name.c_str(), O_RDWR | O_CREAT, 0666);
+	if (fd < 0) {
+		perror(name.c_str());
+		_Exit(127);
+	}
+	if (flock(fd, LOCK_EX | LOCK_NB) == 0)
+		return false;
+	if (errno != EWOULDBLOCK) {
+		perror(name.c_str());
+		_Exit(127);
+	}
+
+	/* The targets are claimed by another process */
+	vector <Timestamp> timestamps(filenames.size(), Timestamp::UNDEFINED);
+	for (size_t i= 0;  i < filenames.size();  ++i) {
+		struct stat buf;
+		if (stat(filenames[i].c_str(), &buf) == 0)
+			timestamps[i]= Timestamp(&buf);
+	}
+	while (flock(fd, LOCK_EX) < 0) {
+		if (errno != EINTR) {
+			perror(name.c_str());
+			_Exit(127);
+		}
+	}
+	for (size_t i= 0;  i < filenames.size();  ++i) {
+		struct stat buf;
+		if (stat(filenames[i].c_str(), &buf) < 0)
+			return false;
+		if (timestamps[i].defined() && ! (timestamps[i] < Timestamp(&buf)))
+			return false;
+	}
+	return true;
+}
+
+string Claim::name_canonical(string name)
+{
+	size_t p= name.rfind('/');
+	string dir= p == string::npos ? "." : p == 0 ? "/" : name.substr(0, p);
+	string base= p == string::npos ? name : name.substr(p + 1);
+	char *dir_real= realpath(dir.c_str(), nullptr);
+	if (dir_real) {
+		string ret= dir_real;
+		free(dir_real);
+		if (ret != "/")
+			ret += '/';
+		return ret + base;
+	}
+	if (name[0] == '/')
+		return name;
+	char *cwd= getcwd(nullptr, 0);
+	if (! cwd)
+		return name;
+	string ret= string(cwd) + '/' + name;
+	free(cwd);
+	return ret;
+}
+
+string Claim::filename_lock(string name)
+/* Characters other than letters, digits, '.', '_' and '-' are encoded
+ * as '%' followed by two hexadecimal digits.  Names that would be too
+ * long are replaced by their FNV-1a hash.  */
+{
+	string ret;
+	for (unsigned char c:  name) {
+		if (isalnum(c) || c == '.' || c == '_' || c == '-')
+			ret += (char) c;
+		else
+			ret += frmt("%%%02X", c);
+	}
+	if (ret.size() > 200 || ret == "." || ret == "..") {
+		ret= frmt("%%%016llx", (unsigned long long) hash_fnv(name));
+	}
+	return string(directory) + '/' + ret;
+}
+
+#endif /* ! CLAIM_HH */
@@ -0,0 +1,1185 @@
+#ifndef DAEMON_HH
+#define DAEMON_HH
+
+/*
+ * Daemon mode (the -D and -U options).  A daemon started with
+ *
+ *	stu -D SOCKET [-f FILENAME | -F RULES]...
+ *
+ * reads the rules once, and then listens on the Unix socket SOCKET.
+ * A client started with
+ *
+ *	stu -U SOCKET [OPTION]... [TARGET]...
+ *
+ * connects to the daemon and passes it its arguments, environment,
+ * working directory and the file descriptors of its standard input,
+ * output and error output.  For each client, the daemon forks a child
+ * process that performs the build exactly as Stu would, using the
+ * rules already read, and in which the client's options are parsed as
+ * usual.  The client waits for the child process, forwards termination
+ * signals to it, and exits with its exit status.  Builds are performed
+ * one after the other.  The daemon does not detach itself from the
+ * terminal, and runs until it is terminated by a signal.
+ *
+ * The daemon keeps a cache of the results of stat(2) on the files
+ * checked by previous builds.  After each build, the daemon puts a
+ * watch on the directories containing these files (and all their
+ * ancestors) using inotify(7), and removes entries from the cache when
+ * the corresponding file is changed.  Before a job is started, the
+ * cache entries of its targets are removed.  Names of files which are
+ * not in normal form (e.g., containing '..' or consecutive slashes) and
+ * symbolic links are not cached.  When a watched directory is moved or removed, the
+ * whole cache is cleared.  Changes that do not generate inotify events
+ * (e.g., on network filesystems, or through writable memory maps) are
+ * not seen.
+ *
+ * Watch mode (the -w option) uses the same mechanisms:  each build is
+ * performed by a child process, after which Stu waits until any of the
+ * files checked by the build or any of the rule files change.  Changes
+ * that arrive within a short delay of each other are built together.
+ * The child process passes the reverse dependencies of a successful
+ * build (as recorded by the index of the -R option) back to Stu, which
+ * keeps them between builds.  The next build then visits only the
+ * targets that depend directly or indirectly on the changed files; the
+ * other targets are up to date when their files exist.  When rule
+ * files have changed, Stu starts over by executing itself again.
+ *
+ * Before each build, the daemon checks whether any of the files from
+ * which it read rules (including included files) have changed, and
+ * reads the rules again if that is the case.  If that fails, the rules
+ * are read by the child process performing the next build, such that
+ * the errors are output to the client.
+ *
+ * Messages sent by the client:  one byte together with its three file
+ * descriptors, then the working directory, the number of arguments,
+ * the arguments (starting with the name of the program) and the
+ * environment, each terminated by '\0'.  Messages sent by the daemon:
+ * the PID of the child process and its wait status, each as a decimal
+ * number terminated by '\n'.
+ *
+ * Daemon mode and watch mode are supported only when inotify(7) is
+ * available, i.e., on Linux.  The other functions of this class are
+ * portable, and are also used by workers and the output cache.
+ */
+
+#ifndef USE_DAEMON
+#   ifdef __linux__
+#      define USE_DAEMON 1
+#   else
+#      define USE_DAEMON 0
+#   endif
+#endif
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#if USE_DAEMON
+#   include <sys/inotify.h>
+#endif
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "error.hh"
+#include "format.hh"
+#include "timestamp.hh"
+
+extern char **environ;
+
+class Daemon
+{
+public:
+
+	typedef void (*Loader)(const vector <pair <char, string> > &options);
+	/* Read the rules from the given -f and -F options (in order), or
+	 * from the default file when there are none.  Throws errors.  */
+
+	static void serve(int &argc, char **&argv, Loader loader);
+	/* Run the daemon (-D), with ARGV[1] beginning with "-D".  Only
+	 * returns in a child process performing a build, after having
+	 * set ARGC, ARGV and the environment to those of the client, and
+	 * the standard file descriptors to those of the client.  */
+
+	static void client(int argc, char **argv) __attribute__((noreturn));
+	/* Run as a client of a daemon (-U), with ARGV[1] beginning
+	 * with "-U" */
+
+	static bool is_child()  {  return child;  }
+	/* Whether this is a child process of the daemon performing a
+	 * build */
+
+	static bool stat_cached(const char *filename, struct stat *buf, int &ret);
+	/* Look up FILENAME in the cache.  When it is found, write the
+	 * result into BUF and RET (and errno) as stat(2) would, and
+	 * return true.  Otherwise, return false; the name is then
+	 * checked by the daemon after the build.  */
+
+	static void forget(const char *filename);
+	/* The file may be changed by a job */
+
+	typedef void (*Invalidator)(const string &index,
+				    const unordered_set <string> *names_changed);
+	/* Called before each build in watch mode with the reverse
+	 * dependencies passed by the previous build (empty when there
+	 * are none), and the files changed since then, or nullptr when
+	 * any file may have changed */
+
+	static void watch_builds(char **argv, Invalidator invalidator);
+	/* Watch mode (-w).  Perform builds in child processes, each time
+	 * files have changed.  Only returns in the child processes.
+	 * ARGV is used to start over when rules have changed.  */
+
+	static void report_index(const string &index);
+	/* In the child process in watch mode:  pass the reverse
+	 * dependencies of the build to the next build */
+
+	static void rules_read(const vector <string> &filenames);
+	/* The rules were read from the given files; called by the
+	 * loader */
+
+	static bool read_all(int fd, string &s);
+	/* Append everything up to end of file to S */
+
+	static bool write_all(int fd, const string &s);
+	/* Write S completely.  Return false on errors, including when
+	 * the peer of a socket has closed it, without raising SIGPIPE.  */
+
+	static int socket_unix();
+	/* Create a Unix stream socket with FD_CLOEXEC set.  Return -1 on
+	 * errors, with ERRNO set.  */
+
+	static int accept_cloexec(int fd_listen);
+	/* Accept a connection and set FD_CLOEXEC on it.  Return -1 on
+	 * errors, with ERRNO set.  */
+
+	static bool set_cloexec(int fd);
+	/* Set FD_CLOEXEC.  Used instead of SOCK_CLOEXEC, accept4(2),
+	 * pipe2(2) and MSG_CMSG_CLOEXEC, which are not portable.  */
+
+private:
+
+	struct Entry
+	{
+		int err; /* errno of stat(2), or 0 */
+		struct stat buf;
+	};
+
+	static bool child;
+
+	static unordered_map <string, Entry> cache;
+	/* By filename */
+
+	static unordered_set <string> names_missed;
+	/* In the child process:  filenames not found in the cache */
+
+	static unordered_set <string> names_forgotten;
+	/* In the child process:  filenames passed to forget() */
+
+	static int fd_report;
+	/* In the child process:  the names of NAMES_MISSED are written
+	 * into this pipe at exit */
+
+	static string index_report;
+	/* In the child process:  the reverse dependencies written into
+	 * FD_REPORT after the names */
+
+	static unordered_set <string> names_changed;
+	/* In watch mode:  the files changed since the last build */
+
+	static bool changed_all;
+	/* In watch mode:  the cache was cleared since the last build */
+
+	static bool watching;
+
+	static int fd_inotify;
+
+	static unordered_map <int, string> dirs;
+	/* Watched directories by their watch descriptor */
+
+	static unordered_map <int, unordered_map <string, vector <string> > > names_by_watch;
+	/* For each watch descriptor, for each name within the directory,
+	 * the keys of CACHE that are stored under that name */
+
+	static unordered_map <int, unordered_set <string> > subdirs;
+	/* For each watch descriptor, the names of watched directories
+	 * within it */
+
+	static vector <pair <string, Entry> > rule_files;
+	/* The files from which the rules were read, with their state
+	 * at the time */
+
+	static bool rules_stale;
+	/* The rules could not be read again by the daemon */
+
+	static char socket_name[sizeof(((struct sockaddr_un *) nullptr)->sun_path)];
+
+	static const int DELAY_WATCH_MS= 100;
+	/* In watch mode, wait until no file was changed during this
+	 * time before starting a build */
+
+	static void report();
+	/* Called at exit in the child process.  Write the names in
+	 * NAMES_MISSED and in NAMES_FORGOTTEN, each followed by '\0',
+	 * separated by an additional '\0'.  When INDEX_REPORT is not
+	 * empty, it follows after another '\0'.  */
+
+	static pid_t fork_build(int &fd_read);
+	/* Fork a child process to perform a build.  Return its PID in
+	 * the parent process, and set FD_READ to the pipe from which the
+	 * report is read.  Return 0 in the child process, and -1 on
+	 * errors.  */
+
+	static int wait_build(pid_t pid, int fd_read, int fd_conn, string &names);
+	/* Read the report and wait for the child process.  Terminate
+	 * the child process when FD_CONN (if not -1) is hung up.
+	 * Return the wait status.  */
+
+	static bool update(const string &names, string *index);
+	/* Update the cache after a build, given the report.  Return
+	 * whether files were changed during the build, other than
+	 * those that were passed to forget().  Set INDEX (if not null)
+	 * to the reverse dependencies in the report.  */
+
+	static void handle(int fd_conn, int fd_listen,
+			   const vector <pair <char, string> > &options, Loader loader,
+			   const string &cwd, int &argc, char **&argv);
+	/* Handle one client connection.  Returns only in the child
+	 * process.  */
+
+	static bool process_events(const unordered_set <string> *ignored);
+	/* Process pending inotify events.  Return whether a file has
+	 * changed, not counting the files in IGNORED, if not null.  */
+
+	static void clear();
+	/* Clear the cache and remove all watches */
+
+	static void add(const string &name);
+	/* Add a file to the cache */
+
+	static int watch_dir(const string &dir);
+	/* Watch the directory DIR and its ancestors.  Return the watch
+	 * descriptor of DIR, or -1 on errors.  */
+
+	static bool split(const string &name, string &dir, string &base);
+	/* Split a filename into its directory and last component.
+	 * Return false when the filename is not in normal form.  */
+
+	static bool rules_changed();
+
+	static string resolve_program(const char *name);
+	/* The absolute filename of the program NAME, which is looked up
+	 * in $PATH when it does not contain a slash.  Return NAME when
+	 * it cannot be resolved.  */
+
+	static bool same(const Entry &a, const Entry &b);
+
+	static void terminate(int sig);
+	/* Signal handler in the daemon */
+};
+
+bool Daemon::child= false;
+unordered_map <string, Daemon::Entry> Daemon::cache;
+unordered_set <string> Daemon::names_missed;
+unordered_set <string> Daemon::names_forgotten;
+int Daemon::fd_report= -1;
+string Daemon::index_report;
+unordered_set <string> Daemon::names_changed;
+bool Daemon::changed_all= false;
+bool Daemon::watching= false;
+int Daemon::fd_inotify= -1;
+unordered_map <int, string> Daemon::dirs;
+unordered_map <int, unordered_map <string, vector <string> > > Daemon::names_by_watch;
+unordered_map <int, unordered_set <string> > Daemon::subdirs;
+vector <pair <string, Daemon::Entry> > Daemon::rule_files;
+bool Daemon::rules_stale= false;
+char Daemon::socket_name[sizeof(((struct sockaddr_un *) nullptr)->sun_path)];
+
+void Daemon::serve(int &argc, char **&argv, Loader loader)
+{
+	assert(argc >= 2 && ! strncmp(argv[1], "-D", 2));
+#if ! USE_DAEMON
+	(void) loader;
+	Place(Place::Type::OPTION, 'D') << "daemon mode is not supported on this system";
+	exit(ERROR_FATAL);
+#else
+
+	/* Options of the daemon */
+	vector <pair <char, string> > options;
+	for (int c; (c= getopt(argc, argv, "D:f:F:")) != -1;) {
+		switch (c) {
+		case 'D':
+			if (*optarg == '\0' || strlen(optarg) >= sizeof(socket_name)) {
+				Place(Place::Type::OPTION, 'D')
+					<< fmt("invalid socket name %s",
+					       name_format_word(optarg));
+				exit(ERROR_FATAL);
+			}
+			if (*socket_name) {
+				Place(Place::Type::OPTION, 'D')
+					<< "must be used only once";
+				exit(ERROR_FATAL);
+			}
+			strcpy(socket_name, optarg);
+			break;
+		case 'f':
+			if (*optarg == '\0' || ! strcmp(optarg, "-")) {
+				Place(Place::Type::OPTION, 'f')
+					<< fmt("expected the name of a file, not %s",
+					       name_format_word(optarg));
+				exit(ERROR_FATAL);
+			}
+			/* Fall through */
+		case 'F':
+			options.push_back(pair <char, string> (c, optarg));
+			break;
+		default:
+			fprintf(stderr, "%s: only the options %s and %s can be used with %s\n",
+				dollar_zero,
+				multichar_format_word("-f").c_str(),
+				multichar_format_word("-F").c_str(),
+				multichar_format_word("-D").c_str());
+			exit(ERROR_FATAL);
+		}
+	}
+	if (optind < argc) {
+		Place(Place::Type::ARGUMENT)
+			<< fmt("targets cannot be passed to a daemon using %s; "
+			       "pass them to its clients using %s",
+			       multichar_format_word("-D"),
+			       multichar_format_word("-U"));
+		exit(ERROR_FATAL);
+	}
+
+	try {
+		loader(options);
+	} catch (int e) {
+		exit(e);
+	}
+
+	char *cwd_c= getcwd(nullptr, 0);
+	if (cwd_c == nullptr) {
+		print_error_system("getcwd");
+		exit(ERROR_FATAL);
+	}
+	const string cwd= cwd_c;
+	free(cwd_c);
+
+	fd_inotify= inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd_inotify < 0) {
+		print_error_system("inotify_init1");
+		exit(ERROR_FATAL);
+	}
+
+	/* Socket */
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family= AF_UNIX;
+	strcpy(addr.sun_path, socket_name);
+	int fd_listen= socket_unix();
+	if (fd_listen < 0) {
+		print_error_system("socket");
+		exit(ERROR_FATAL);
+	}
+	if (connect(fd_listen, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+		print_error(fmt("Daemon is already running on socket %s",
+				name_format_word(socket_name)));
+		exit(ERROR_FATAL);
+	}
+	struct stat buf;
+	if (lstat(socket_name, &buf) == 0 && S_ISSOCK(buf.st_mode))
+		unlink(socket_name);
+	if (bind(fd_listen, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+	    listen(fd_listen, 16) < 0) {
+		print_error_system(socket_name);
+		exit(ERROR_FATAL);
+	}
+	signal(SIGINT,  terminate);
+	signal(SIGTERM, terminate);
+	signal(SIGHUP,  terminate);
+
+	while (true) {
+		struct pollfd fds[2]= {
+			{fd_listen, POLLIN, 0}, {fd_inotify, POLLIN, 0}
+		};
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			print_error_system("poll");
+			exit(ERROR_FATAL);
+		}
+		if (fds[1].revents)
+			process_events(nullptr);
+		if (! fds[0].revents)
+			continue;
+		int fd_conn= accept_cloexec(fd_listen);
+		if (fd_conn < 0) {
+			if (errno != EINTR && errno != ECONNABORTED)
+				print_error_system("accept");
+			continue;
+		}
+		handle(fd_conn, fd_listen, options, loader, cwd, argc, argv);
+		if (child)
+			return;
+	}
+#endif /* USE_DAEMON */
+}
+
+void Daemon::handle(int fd_conn, int fd_listen,
+		    const vector <pair <char, string> > &options, Loader loader,
+		    const string &cwd, int &argc, char **&argv)
+{
+	/* Don't let a client that does not send its request block the
+	 * daemon */
+	struct timeval timeout= {10, 0};
+	setsockopt(fd_conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	/* Receive the file descriptors */
+	int fds[3]= {-1, -1, -1};
+	char byte;
+	struct iovec iov= {&byte, 1};
+	union {
+		char buf[CMSG_SPACE(sizeof(fds))];
+		struct cmsghdr align;
+	} control;
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov= &iov;
+	msg.msg_iovlen= 1;
+	msg.msg_control= control.buf;
+	msg.msg_controllen= sizeof(control.buf);
+	if (recvmsg(fd_conn, &msg, 0) == 1) {
+		struct cmsghdr *cmsg= CMSG_FIRSTHDR(&msg);
+		if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS
+		    && cmsg->cmsg_len == CMSG_LEN(sizeof(fds)))
+			memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+		for (int fd:  fds)
+			if (fd >= 0)
+				set_cloexec(fd);
+	}
+
+	/* Receive the rest of the request */
+	string request;
+	vector <const char *> strings;
+	if (fds[0] >= 0 && read_all(fd_conn, request)) {
+		for (size_t i= 0;  i < request.size();  i += strlen(request.c_str() + i) + 1)
+			strings.push_back(request.c_str() + i);
+	}
+	/* Working directory, number of arguments, arguments */
+	long count_args= strings.size() >= 2 ? atol(strings[1]) : -1;
+	if (count_args < 1 || (size_t) count_args > strings.size() - 2) {
+		for (int fd:  fds)
+			if (fd >= 0)
+				close(fd);
+		close(fd_conn);
+		return;
+	}
+
+	process_events(nullptr);
+	if (rules_changed()) {
+		try {
+			loader(options);
+			rules_stale= false;
+		} catch (int) {
+			rules_stale= true;
+		}
+	}
+
+	int fd_read;
+	pid_t pid= fork_build(fd_read);
+	if (pid < 0) {
+		close(fd_conn);
+		return;
+	}
+
+	if (pid == 0) {
+		/* Child process */
+		signal(SIGINT,  SIG_DFL);
+		signal(SIGTERM, SIG_DFL);
+		signal(SIGHUP,  SIG_DFL);
+		close(fd_listen);
+		close(fd_conn);
+		for (int i= 0;  i < 3;  ++i) {
+			if (dup2(fds[i], i) < 0)
+				_Exit(ERROR_FATAL);
+			close(fds[i]);
+		}
+
+		argc= count_args;
+		argv= (char **) malloc((argc + 1) * sizeof(*argv));
+		char **envp= (char **) malloc((strings.size() - 1 - argc) * sizeof(*envp));
+		if (argv == nullptr || envp == nullptr) {
+			perror("malloc");
+			exit(ERROR_FATAL);
+		}
+		for (int i= 0;  i < argc;  ++i)
+			argv[i]= strdup(strings[2 + i]);
+		argv[argc]= nullptr;
+		size_t count_env= 0;
+		for (size_t i= 2 + argc;  i < strings.size();  ++i)
+			envp[count_env++]= strdup(strings[i]);
+		envp[count_env]= nullptr;
+		environ= envp;
+		optind= 1;
+
+		if (cwd != strings[0]) {
+			print_error(fmt("Daemon runs in directory %s",
+					name_format_word(cwd)));
+			exit(ERROR_FATAL);
+		}
+		if (rules_stale) {
+			try {
+				loader(options);
+			} catch (int e) {
+				exit(e);
+			}
+		}
+		return;
+	}
+
+	/* Parent process */
+	for (int fd:  fds)
+		close(fd);
+	write_all(fd_conn, frmt("%ld\n", (long) pid));
+	string names;
+	int status= wait_build(pid, fd_read, fd_conn, names);
+	write_all(fd_conn, frmt("%d\n", status));
+	close(fd_conn);
+	update(names, nullptr);
+}
+
+void Daemon::watch_builds(char **argv, Invalidator invalidator)
+{
+#if ! USE_DAEMON
+	(void) argv;
+	(void) invalidator;
+	Place(Place::Type::OPTION, 'w') << "watch mode is not supported on this system";
+	exit(ERROR_FATAL);
+#else
+	/* Used to start over when the rules have changed */
+	string filename_program= resolve_program(argv[0]);
+
+	fd_inotify= inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd_inotify < 0) {
+		print_error_system("inotify_init1");
+		exit(ERROR_FATAL);
+	}
+	watching= true;
+	for (auto &i:  rule_files)
+		add(i.first);
+
+	string index;
+	while (true) {
+		/* The targets that do not depend on changed files are not
+		 * visited by the next build */
+		invalidator(index, changed_all ? nullptr : &names_changed);
+		names_changed.clear();
+		changed_all= false;
+		index.clear();
+
+		int fd_read;
+		pid_t pid= fork_build(fd_read);
+		if (pid < 0)
+			exit(ERROR_FATAL);
+		if (pid == 0)
+			return;
+		string names;
+		int status= wait_build(pid, fd_read, -1, names);
+
+		/* When files were changed during the build by others than
+		 * its jobs, build again immediately */
+		bool changed= update(names, &index);
+		if (! WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			index.clear();
+		if (! changed) {
+			print_out("Watching for changes");
+			while (! process_events(nullptr)) {
+				struct pollfd fd_poll= {fd_inotify, POLLIN, 0};
+				if (poll(&fd_poll, 1, -1) < 0 && errno != EINTR) {
+					print_error_system("poll");
+					exit(ERROR_FATAL);
+				}
+			}
+		}
+
+		/* Changes that arrive close together are built together */
+		while (true) {
+			struct pollfd fd_poll= {fd_inotify, POLLIN, 0};
+			int r= poll(&fd_poll, 1, DELAY_WATCH_MS);
+			if (r < 0 && errno != EINTR) {
+				print_error_system("poll");
+				exit(ERROR_FATAL);
+			}
+			if (r == 0)
+				break;
+			process_events(nullptr);
+		}
+
+		/* Changed rules are read by starting over */
+		if (rules_changed()) {
+			execv(filename_program.c_str(), argv);
+			print_error_system(filename_program);
+			exit(ERROR_FATAL);
+		}
+	}
+#endif /* USE_DAEMON */
+}
+
+void Daemon::report_index(const string &index)
+{
+	index_report= index;
+}
+
+pid_t Daemon::fork_build(int &fd_read)
+{
+	int fds_report[2];
+	if (pipe(fds_report) < 0) {
+		print_error_system("pipe");
+		return -1;
+	}
+	set_cloexec(fds_report[0]);
+	set_cloexec(fds_report[1]);
+
+	pid_t pid= fork();
+	if (pid < 0) {
+		print_error_system("fork");
+		close(fds_report[0]);
+		close(fds_report[1]);
+		return -1;
+	}
+
+	if (pid == 0) {
+		child= true;
+		close(fd_inotify);
+		close(fds_report[0]);
+		fd_report= fds_report[1];
+		atexit(report);
+		return 0;
+	}
+
+	close(fds_report[1]);
+	fd_read= fds_report[0];
+	return pid;
+}
+
+int Daemon::wait_build(pid_t pid, int fd_read, int fd_conn, string &names)
+{
+	bool killed= fd_conn < 0;
+	while (true) {
+		struct pollfd fds_poll[2]= {
+			{fd_read, POLLIN, 0}, {fd_conn, 0, 0}
+		};
+		if (poll(fds_poll, killed ? 1 : 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			print_error_system("poll");
+			break;
+		}
+		if (! killed && fds_poll[1].revents & (POLLHUP | POLLERR)) {
+			kill(pid, SIGTERM);
+			killed= true;
+		}
+		if (fds_poll[0].revents) {
+			char buf[0x1000];
+			ssize_t r= read(fd_read, buf, sizeof(buf));
+			if (r < 0 && errno == EINTR)
+				continue;
+			if (r <= 0)
+				break;
+			names.append(buf, r);
+		}
+	}
+	close(fd_read);
+
+	int status;
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR) {
+			print_error_system("waitpid");
+			return ERROR_FATAL << 8;
+		}
+	}
+	return status;
+}
+
+bool Daemon::update(const string &names, string *index)
+{
+	vector <string> missed;
+	unordered_set <string> forgotten;
+	bool in_forgotten= false;
+	for (size_t i= 0;  i < names.size();  i += strlen(names.c_str() + i) + 1) {
+		const char *name= names.c_str() + i;
+		if (*name == '\0' && in_forgotten) {
+			if (index)
+				*index= names.substr(i + 1);
+			break;
+		}
+		if (*name == '\0')
+			in_forgotten= true;
+		else if (in_forgotten)
+			forgotten.insert(name);
+		else
+			missed.push_back(name);
+	}
+
+	/* Events caused by the build must be processed before adding
+	 * files to the cache */
+	bool ret= process_events(&forgotten);
+	for (const string &name:  missed)
+		add(name);
+	return ret;
+}
+
+void Daemon::client(int argc, char **argv)
+{
+	assert(argc >= 2 && ! strncmp(argv[1], "-U", 2));
+#if ! USE_DAEMON
+	Place(Place::Type::OPTION, 'U') << "daemon mode is not supported on this system";
+	exit(ERROR_FATAL);
+#endif
+
+	int begin= 2;
+	const char *name= argv[1] + 2;
+	if (*name == '\0') {
+		if (argc < 3) {
+			Place(Place::Type::OPTION, 'U') << "expected the name of a socket";
+			exit(ERROR_FATAL);
+		}
+		name= argv[2];
+		begin= 3;
+	}
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family= AF_UNIX;
+	if (*name == '\0' || strlen(name) >= sizeof(addr.sun_path)) {
+		Place(Place::Type::OPTION, 'U')
+			<< fmt("invalid socket name %s", name_format_word(name));
+		exit(ERROR_FATAL);
+	}
+	strcpy(addr.sun_path, name);
+
+	int fd= socket_unix();
+	if (fd < 0) {
+		print_error_system("socket");
+		exit(ERROR_FATAL);
+	}
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		print_error_system(name);
+		exit(ERROR_FATAL);
+	}
+
+	/* Request */
+	char *cwd= getcwd(nullptr, 0);
+	if (cwd == nullptr) {
+		print_error_system("getcwd");
+		exit(ERROR_FATAL);
+	}
+	string request= cwd;
+	free(cwd);
+	request += '\0';
+	request += frmt("%d", argc - begin + 1);
+	request += '\0';
+	request += argv[0];
+	request += '\0';
+	for (int i= begin;  i < argc;  ++i) {
+		request += argv[i];
+		request += '\0';
+	}
+	for (char **e= environ;  *e;  ++e) {
+		request += *e;
+		request += '\0';
+	}
+
+	int fds[3]= {0, 1, 2};
+	char byte= 0;
+	struct iovec iov= {&byte, 1};
+	union {
+		char buf[CMSG_SPACE(sizeof(fds))];
+		struct cmsghdr align;
+	} control;
+	memset(&control, 0, sizeof(control));
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov= &iov;
+	msg.msg_iovlen= 1;
+	msg.msg_control= control.buf;
+	msg.msg_controllen= sizeof(control.buf);
+	struct cmsghdr *cmsg= CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level= SOL_SOCKET;
+	cmsg->cmsg_type= SCM_RIGHTS;
+	cmsg->cmsg_len= CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+	if (sendmsg(fd, &msg, MSG_NOSIGNAL) != 1 ||
+	    ! write_all(fd, request) ||
+	    shutdown(fd, SHUT_WR) < 0) {
+		print_error_system(name);
+		exit(ERROR_FATAL);
+	}
+
+	/* Response:  the PID of the child process, to which signals are
+	 * forwarded until it has terminated, and its wait status */
+	string response;
+	static volatile pid_t pid_child= -1;
+	struct sigaction act;
+	memset(&act, 0, sizeof(act));
+	act.sa_handler= [](int sig) {
+		if (pid_child > 0)
+			kill(pid_child, sig);
+	};
+	for (int sig:  {SIGINT, SIGTERM, SIGHUP, SIGQUIT})
+		sigaction(sig, &act, nullptr);
+	while (true) {
+		char buf[64];
+		ssize_t r= read(fd, buf, sizeof(buf));
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			break;
+		response.append(buf, r);
+		if (pid_child < 0 && response.find('\n') != string::npos)
+			pid_child= atol(response.c_str());
+	}
+	size_t i= response.find('\n');
+	if (i == string::npos || i + 1 >= response.size() || response.back() != '\n') {
+		print_error(fmt("Daemon on socket %s terminated without a result",
+				name_format_word(name)));
+		exit(ERROR_FATAL);
+	}
+	int status= atoi(response.c_str() + i + 1);
+	if (WIFSIGNALED(status)) {
+		signal(WTERMSIG(status), SIG_DFL);
+		raise(WTERMSIG(status));
+	}
+	exit(WIFEXITED(status) ? WEXITSTATUS(status) : ERROR_FATAL);
+}
+
+bool Daemon::stat_cached(const char *filename, struct stat *buf, int &ret)
+{
+	if (! child)
+		return false;
+	auto i= cache.find(filename);
+	if (i == cache.end()) {
+		names_missed.insert(filename);
+		return false;
+	}
+	if (i->second.err) {
+		errno= i->second.err;
+		ret= -1;
+	} else {
+		*buf= i->second.buf;
+		ret= 0;
+	}
+	return true;
+}
+
+void Daemon::forget(const char *filename)
+{
+	cache.erase(filename);
+	names_forgotten.insert(filename);
+}
+
+void Daemon::rules_read(const vector <string> &filenames)
+{
+	rule_files.clear();
+	for (const string &filename:  filenames) {
+		Entry entry;
+		entry.err= stat(filename.c_str(), &entry.buf) == 0 ? 0 : errno;
+		rule_files.push_back(pair <string, Entry> (filename, entry));
+	}
+}
+
+void Daemon::report()
+{
+	string names;
+	for (const string &name:  names_missed) {
+		names += name;
+		names += '\0';
+	}
+	names += '\0';
+	for (const string &name:  names_forgotten) {
+		names += name;
+		names += '\0';
+	}
+	if (! index_report.empty()) {
+		names += '\0';
+		names += index_report;
+	}
+	write_all(fd_report, names);
+}
+
+bool Daemon::process_events(const unordered_set <string> *ignored)
+{
+	bool ret= false;
+#if USE_DAEMON
+	alignas(struct inotify_event) char buf[0x1000];
+	ssize_t r;
+	while ((r= read(fd_inotify, buf, sizeof(buf))) > 0) {
+		for (char *p= buf;  p < buf + r;
+		     p += sizeof(struct inotify_event) + ((struct inotify_event *) p)->len) {
+			struct inotify_event *event= (struct inotify_event *) p;
+			/* Watches removed by clear() */
+			if (event->mask & IN_IGNORED && ! dirs.count(event->wd))
+				continue;
+			if (event->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_UNMOUNT |
+					   IN_DELETE_SELF | IN_MOVE_SELF)) {
+				clear();
+				changed_all= true;
+				ret= true;
+				continue;
+			}
+			if (event->len == 0)
+				continue;
+			auto h= subdirs.find(event->wd);
+			if (h != subdirs.end() && h->second.count(event->name)) {
+				/* A watched directory was moved or removed */
+				clear();
+				changed_all= true;
+				ret= true;
+				continue;
+			}
+			auto i= names_by_watch.find(event->wd);
+			if (i == names_by_watch.end())
+				continue;
+			auto j= i->second.find(event->name);
+			if (j == i->second.end())
+				continue;
+			for (const string &name:  j->second) {
+				cache.erase(name);
+				if (ignored == nullptr || ! ignored->count(name)) {
+					ret= true;
+					if (watching)
+						names_changed.insert(name);
+				}
+			}
+			i->second.erase(j);
+		}
+	}
+#else
+	(void) ignored;
+#endif
+	return ret;
+}
+
+void Daemon::clear()
+{
+#if USE_DAEMON
+	for (auto &i:  dirs)
+		inotify_rm_watch(fd_inotify, i.first);
+#endif
+	dirs.clear();
+	names_by_watch.clear();
+	subdirs.clear();
+	cache.clear();
+}
+
+void Daemon::add(const string &name)
+{
+	if (cache.count(name))
+		return;
+	string dir, base;
+	if (! split(name, dir, base))
+		return;
+	int wd= watch_dir(dir);
+	if (wd < 0)
+		return;
+
+	/* Stat only after the watch is in place, such that no change
+	 * is missed */
+	Entry entry;
+	if (lstat(name.c_str(), &entry.buf) == 0) {
+		if (S_ISLNK(entry.buf.st_mode)) {
+			/* Not cached, but changes are still seen in
+			 * watch mode */
+			vector <string> &names= names_by_watch[wd][base];
+			if (find(names.begin(), names.end(), name) == names.end())
+				names.push_back(name);
+			return;
+		}
+		entry.err= 0;
+	} else if (errno == ENOENT) {
+		entry.err= ENOENT;
+	} else {
+		return;
+	}
+	cache[name]= entry;
+	names_by_watch[wd][base].push_back(name);
+}
+
+int Daemon::watch_dir(const string &dir)
+{
+#if ! USE_DAEMON
+	(void) dir;
+	return -1;
+#else
+	const uint32_t mask= IN_ATTRIB | IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE
+		| IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF
+		| IN_MOVE_SELF | IN_ONLYDIR;
+	int wd= inotify_add_watch(fd_inotify, dir.c_str(), mask);
+	if (wd < 0)
+		return -1;
+	if (dirs.count(wd))
+		return wd;
+	dirs[wd]= dir;
+
+	/* Ancestors */
+	string dir_parent, base_dir;
+	if (dir != "." && dir != "/" && split(dir, dir_parent, base_dir)) {
+		int wd_parent= watch_dir(dir_parent);
+		if (wd_parent < 0) {
+			clear();
+			return -1;
+		}
+		subdirs[wd_parent].insert(base_dir);
+	}
+	return wd;
+#endif /* USE_DAEMON */
+}
+
+bool Daemon::split(const string &name, string &dir, string &base)
+{
+	if (name.empty() || name.back() == '/' || name.find(string(2, '/')) != string::npos)
+		return false;
+	for (size_t i= 0;  i <= name.size(); ) {
+		size_t j= name.find('/', i);
+		if (j == string::npos)
+			j= name.size();
+		string component= name.substr(i, j - i);
+		if (component == "." || component == "..")
+			return false;
+		i= j + 1;
+	}
+	size_t k= name.rfind('/');
+	if (k == string::npos) {
+		dir= ".";
+		base= name;
+	} else {
+		dir= k == 0 ? "/" : name.substr(0, k);
+		base= name.substr(k + 1);
+	}
+	return true;
+}
+
+bool Daemon::rules_changed()
+{
+	if (rules_stale)
+		return true;
+	for (auto &i:  rule_files) {
+		Entry entry;
+		entry.err= stat(i.first.c_str(), &entry.buf) == 0 ? 0 : errno;
+		if (! same(entry, i.second))
+			return true;
+	}
+	return false;
+}
+
+string Daemon::resolve_program(const char *name)
+{
+	string filename= name;
+	if (! strchr(name, '/')) {
+		const char *path= getenv("PATH");
+		if (path == nullptr)
+			return name;
+		for (const char *p= path; ; ) {
+			const char *q= strchr(p, ':');
+			size_t len= q ? (size_t)(q - p) : strlen(p);
+			/* An empty entry is the current directory */
+			string dir= len ? string(p, len) : string(".");
+			filename= dir + '/' + name;
+			if (access(filename.c_str(), X_OK) == 0)
+				break;
+			if (! q)
+				return name;
+			p= q + 1;
+		}
+	}
+	char *resolved= realpath(filename.c_str(), nullptr);
+	if (resolved == nullptr)
+		return filename;
+	string ret= resolved;
+	free(resolved);
+	return ret;
+}
+
+bool Daemon::same(const Entry &a, const Entry &b)
+{
+	if (a.err || b.err)
+		return a.err == b.err;
+	Timestamp time_a(&a.buf), time_b(&b.buf);
+	return a.buf.st_dev == b.buf.st_dev
+		&& a.buf.st_ino == b.buf.st_ino
+		&& a.buf.st_size == b.buf.st_size
+		&& ! (time_a < time_b) && ! (time_b < time_a)
+		&& a.buf.st_ctime == b.buf.st_ctime;
+}
+
+bool Daemon::read_all(int fd, string &s)
+{
+	char buf[0x1000];
+	while (true) {
+		ssize_t r= read(fd, buf, sizeof(buf));
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r < 0)
+			return false;
+		if (r == 0)
+			return true;
+		s.append(buf, r);
+	}
+}
+
+bool Daemon::write_all(int fd, const string &s)
+{
+	for (size_t i= 0;  i < s.size(); ) {
+		ssize_t r= send(fd, s.data() + i, s.size() - i, MSG_NOSIGNAL);
+		if (r < 0 && errno == ENOTSOCK)
+			r= write(fd, s.data() + i, s.size() - i);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return false;
+		i += r;
+	}
+	return true;
+}
+
+int Daemon::socket_unix()
+{
+	int fd= socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd >= 0 && ! set_cloexec(fd)) {
+		int errno_save= errno;
+		close(fd);
+		errno= errno_save;
+		return -1;
+	}
+	return fd;
+}
+
+int Daemon::accept_cloexec(int fd_listen)
+{
+	int fd= accept(fd_listen, nullptr, nullptr);
+	if (fd >= 0 && ! set_cloexec(fd)) {
+		int errno_save= errno;
+		close(fd);
+		errno= errno_save;
+		return -1;
+	}
+	return fd;
+}
+
+bool Daemon::set_cloexec(int fd)
+{
+	int flags= fcntl(fd, F_GETFD);
+	return flags >= 0 && fcntl(fd, F_SETFD, flags | FD_CLOEXEC) >= 0;
+}
+
+void Daemon::terminate(int sig)
+{
+	unlink(socket_name);
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+#endif /* ! DAEMON_HH */
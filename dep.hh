@@ -216,7 +216,8 @@ class Plain_Dep
  * information is also contained in PLACE_PARAM_TARGET.  No other Dep
  * type has the F_TARGET_TRANSIENT flag set.
  */
-	:  public Dep
+	:  public Dep,
+	   private Counted <Plain_Dep>
 {
 public:
 
@@ -303,6 +304,7 @@ public:
 
 	Plain_Dep(const Plain_Dep &plain_dep)
 		:  Dep(plain_dep),
+		   Counted <Plain_Dep> (plain_dep),
 		   place_param_target(plain_dep.place_param_target),
 		   place(plain_dep.place),
 		   variable_name(plain_dep.variable_name)
@@ -333,7 +335,8 @@ class Dynamic_Dep
 /*
  * The Dep::flags field has the F_TARGET_DYNAMIC set. 
  */
-	:  public Dep
+	:  public Dep,
+	   private Counted <Dynamic_Dep>
 {
 public:
 
@@ -411,7 +414,8 @@ class Concat_Dep
  *
  *         ( X )( Y )( Z )...
  */ 
-	:  public Dep
+	:  public Dep,
+	   private Counted <Concat_Dep>
 {
 public:
 
@@ -499,7 +503,8 @@ class Compound_Dep
  * concatenated dependencies.  Otherwise, they also appear after parsing
  * to denote syntactic groups of dependencies. 
  */
-	:  public Dep
+	:  public Dep,
+	   private Counted <Compound_Dep>
 {
 public:
 
@@ -561,7 +566,8 @@ class Root_Dep
  * is just one possible value of this, and it is never shown to the
  * user, but used internally with the root execution object. 
  */
-	:  public Dep
+	:  public Dep,
+	   private Counted <Root_Dep>
 {
 public:
 	virtual shared_ptr <const Dep> instantiate(const map <string, string> &) const {
@@ -360,15 +360,32 @@ public:
 };
 
 class Printer
-/* Interface that has the << operator like Place.  Only used at one
- * place for now.  The parameter MESSAGE may be "" to print a generic
- * error message (i.e., only the traces).  */
+/* Interface that has the << operator like Place.  The parameter
+ * MESSAGE may be "" to print a generic error message (i.e., only the
+ * traces).  */
 {
 public:
 	virtual void operator<<(string message) const= 0; 
 	virtual ~Printer();
 };
 
+class Place_Printer
+/* Prints messages at a given place */
+	:  public Printer
+{
+public:
+	Place_Printer(const Place &place_)
+		:  place(place_)  {  }
+
+	virtual void operator<<(string message) const {
+		if (message != "")
+			place << message; 
+	}
+
+private:
+	const Place &place;
+};
+
 const Place Place::place_empty;
 
 const Place &Place::operator<<(string message) const
@@ -382,7 +399,7 @@ void Place::print(string message,
 		  const char *color_word) const
 {
 	assert(message != "");
-	assert(line >= 1); 
+	assert(type != Type::INPUT_FILE || line >= 1); 
 
 	switch (type) {
 	default:  
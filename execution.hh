@@ -4,7 +4,7 @@
 /* 
  * Code for executing the building process itself.  
  *
- * If there is ever a "libstu", this will be its main entry point. 
+ * Execution::main() is the main entry point of libstu (see libstu.hh). 
  * 
  * OVERVIEW OF TYPES
  *
@@ -26,11 +26,19 @@
  * objects, i.e., F_RESULT_* flags.   
  */
 
+#include <limits.h>
 #include <sys/stat.h>
 
+#include <unordered_set>
+
 #include "buffer.hh"
 #include "parser.hh"
+#include "plan.hh"
+#include "prefetch.hh"
+#include "probe.hh"
 #include "job.hh"
+#include "progress.hh"
+#include "reverse.hh"
 #include "tokenizer.hh"
 #include "rule.hh"
 #include "timestamp.hh"
@@ -107,12 +115,44 @@ public:
 		/* At least one file target is known not to exist (only
 		 * possible if there is at least one file target in
 		 * File_Execution).  */
+
+		B_PLANNED	= 1 << 4,
+		/* In plan mode (-Q):  the command would have been run, but
+		 * was not (only in File_Execution).  */
+
+		B_SPECULATED	= 1 << 5,
+		/* The trivial dependencies have been started
+		 * speculatively (-A).  */
+
+		B_LOOKED_AHEAD	= 1 << 6,
+		/* The files have been looked up in the lookahead (-L)
+		 * (only in File_Execution).  */
+
+		B_INDEXED	= 1 << 7,
+		/* The targets have been looked up in the reverse
+		 * dependency index (-R) (only in File_Execution).  */
+
+		B_PRUNED	= 1 << 8,
+		/* The targets are not affected by the changed files
+		 * (-u), and the dependencies are not visited (only in
+		 * File_Execution).  */
+
+		B_BATCHED	= 1 << 9,
+		/* The command is run for this target in a batch
+		 * ($STU_BATCH) that is waiting to be started or running
+		 * (only in File_Execution).  */
 	};
 
 	void raise(int error_);
 	/* All errors by Execution objects call this function.  Set the
 	 * error code, and throw an error except with the keep-going
-	 * option.  Does not print any error message.  */
+	 * option, or when this execution is only needed by a
+	 * speculatively started dependency (-A).  Does not print any
+	 * error message.  */
+
+	bool is_speculative() const;
+	/* Whether each path from this execution to the root contains a
+	 * dependency that was started speculatively (-A) */
 
 	Proceed execute_base_A(shared_ptr <const Dep> dep_link);
 	/* DEPENDENCY_LINK must not be null.  In the return value, at
@@ -171,6 +211,10 @@ public:
 
 	virtual string format_src() const= 0;
 
+	virtual const vector <Target> *get_targets() const {  return nullptr;  }
+	/* The targets, for executions that correspond to targets, i.e.,
+	 * File_Execution and Transient_Execution; null otherwise */
+
 	virtual void notify_result(shared_ptr <const Dep> dep,
 				   Execution *source,
 				   Flags flags,
@@ -262,13 +306,38 @@ protected:
 	 * used.  Null by default, and set by individual implementations
 	 * in their constructor if necessary.  */ 
 
+	vector <size_t> jobs_plan;
+	/* In plan mode (-Q):  the indices of the planned jobs on which
+	 * this execution depends directly, or only the planned job of
+	 * this execution itself once it has been planned.  Empty when
+	 * not in plan mode.  */
+
+	const size_t index_created;
+	/* Executions are numbered in the order of their creation */ 
+
+	unsigned pass_executed; 
+	Flags flags_executed;
+	Proceed proceed_executed; 
+	/* In breadth-first order (-m bfs):  the last pass of the main loop
+	 * in which the execution was executed without finishing, the
+	 * flags of the link, and the result */ 
+
 	Execution(shared_ptr <const Rule> param_rule_= nullptr)
 		:  bits(0),
 		   error(0),
 		   timestamp(Timestamp::UNDEFINED),
-		   param_rule(param_rule_)
+		   param_rule(param_rule_),
+		   index_created(count_created++),
+		   pass_executed(0)
 	{  }
 
+	Proceed execute_child(Execution *child, shared_ptr <const Dep> dep_child); 
+	/* Execute CHILD, which is connected via DEP_CHILD.  In
+	 * breadth-first order, many executions are connected at the
+	 * same time, and an execution with multiple parents may be
+	 * reached over an exponential number of paths; it is then only
+	 * executed once per pass of the main loop.  */
+
 	Proceed execute_children();
 	/* Execute already-active children */
 
@@ -291,6 +360,10 @@ protected:
 	 * non-normalized dependencies while doing so.  DEP does not
 	 * have to be normalized.  */
 
+	void prefetch(shared_ptr <const Dep> dep); 
+	/* Queue the dependency for matching and stat(2) by the threads
+	 * started with -X, unless its execution already exists */
+
 	void push_result(shared_ptr <const Dep> dd); 
 	void disconnect(Execution *const child,
 			shared_ptr <const Dep> dep_child);
@@ -298,6 +371,11 @@ protected:
 	 * information from CHILD to THIS, and then delete CHILD if
 	 * necessary.  */
 
+	void record_edge(const Execution *child);
+	/* Record that the nearest executions with targets at or above
+	 * THIS depend on the targets of CHILD:  in the reverse dependency
+	 * index (-R), and as input files of jobs run by workers (-W) */
+
 	const Place &get_place() const 
 	/* The place for the execution; e.g. the rule; empty if there is no place */
 	{
@@ -334,7 +412,10 @@ protected:
 
 	static unordered_map <Target, Execution *> executions_by_target;
 	/* All cached Execution objects by each of their Target.  Such
-	 * Execution objects are never deleted.  */
+	 * Execution objects are never deleted, except for file
+	 * executions that are released with -N.  */
+
+	friend void memory_collect(vector <Memory::Entry> &entries); 
 
 	static bool find_cycle(Execution *parent,
 			       Execution *child,
@@ -348,10 +429,14 @@ protected:
 
 	static bool find_cycle(vector <Execution *> &path,
 			       Execution *child,
-			       shared_ptr <const Dep> dep_link); 
+			       shared_ptr <const Dep> dep_link,
+			       unordered_set <const Execution *> &visited); 
 	/* Helper function.  PATH is the currently explored path.
 	 * PATH[0] is the original PARENT; PATH[end] is the oldest
-	 * grandparent found yet.  */ 
+	 * grandparent found yet.  VISITED contains the executions that
+	 * have already been explored; they are not explored again, as
+	 * the number of paths may be exponential when executions have
+	 * multiple parents.  */ 
 
 	static void cycle_print(const vector <Execution *> &path,
 				shared_ptr <const Dep> dep);
@@ -373,6 +458,64 @@ protected:
 	shared_ptr <const Dep> set_top(shared_ptr <const Dep> dep,
 				       shared_ptr <const Dep> top); 
 
+	static size_t count_created;
+	/* The number of executions created so far */ 
+
+	static int depth_current;
+	/* The depth of the execution that is currently executed, the
+	 * root execution having depth zero */ 
+
+	static int depth_limit; 
+	/* In breadth-first order (-m bfs), executions deeper than this
+	 * are left for a later pass of the main loop.  Otherwise, not
+	 * used.  */
+
+	static bool deferred;
+	/* Whether an execution was left for a later pass because of
+	 * DEPTH_LIMIT in the current pass */
+
+	static unsigned pass_current;
+	/* The number of the current pass of the main loop, starting at
+	 * one */ 
+
+	static long depth_lookahead; 
+	/* The number of executions in the current chain of execute()
+	 * calls that were entered while all job slots were in use */
+
+	static bool slots_full()
+	/* Whether all job slots are in use.  With -I, this is never the
+	 * case, as jobs with a higher priority may be started by
+	 * stopping running jobs.  */
+	{
+		return jobs == 0 && ! option_preempt; 
+	}
+
+	static bool slots_exhausted() 
+	/* Whether no further children can be connected:  all job slots
+	 * are in use, and the lookahead given by -L has been reached */
+	{
+		return slots_full() && depth_lookahead >= option_lookahead; 
+	}
+
+	class Descent
+	/* Keeps track of the depth while a child execution is being
+	 * executed */
+	{
+	public:
+		Descent()
+			:  lookahead(slots_full())
+		{
+			++ depth_current;
+			depth_lookahead += lookahead; 
+		}
+		~Descent() {
+			-- depth_current;
+			depth_lookahead -= lookahead; 
+		}
+	private:
+		const bool lookahead;
+	};
+
 private: 
 
 	Buffer buffer_A;
@@ -394,6 +537,19 @@ private:
 	/* Add an edge to the dependency graph.  Deploy a new child
 	 * execution.  DEP_CHILD must be normalized.  */
 
+	Proceed connect_speculative(shared_ptr <const Dep> dep_this,
+				    shared_ptr <const Dep> dep_child);
+	/* Connect the trivial dependency DEP_CHILD with the flag
+	 * F_SPECULATIVE, unless it is already connected or finished, or
+	 * is not a plain file dependency */
+
+	static bool lookahead_possible(shared_ptr <const Dep> dep); 
+	/* Whether DEP can be connected in the lookahead (-L).  This is
+	 * not the case when the outcome depends on whether a file
+	 * exists, as running jobs may still create it:  optional
+	 * dependencies, and missing files that have no rule.  Only
+	 * called with -L.  */
+
 	Execution *get_execution(shared_ptr <const Dep> dep);
 	/* Get an existing Execution or create a new one for the
 	 * given DEPENDENCY.  Return null when a strong cycle was found;
@@ -443,21 +599,34 @@ class File_Execution
  * other Execution subclasses only delegate their tasks to child
  * executions. 
  */
-	:  public Execution 
+	:  public Execution,
+	   private Counted <File_Execution>
 {
 public:
 
+	struct Released
+	/* What is kept of a released execution (-N) */
+	{
+		Done done;
+		Bits bits;
+		int error;
+		Timestamp timestamp;
+	};
+
 	File_Execution(shared_ptr <const Dep> dep_link,
 		       Execution *parent,
 		       shared_ptr <const Rule> rule,
 		       shared_ptr <const Rule> param_rule,
 		       map <string, string> &mapping_parameter_,
-		       int &error_additional);
+		       int &error_additional,
+		       const Released *released= nullptr);
 	/* ERROR_ADDITIONAL indicates whether an error will be thrown
 	 * after the call.  (Because an error can only be thrown after
 	 * the execution has been connected to a parent, which is not
 	 * done in the constructor.  The parent is connected to this iff
-	 * ERROR_ADDITIONAL is zero after the call.  */
+	 * ERROR_ADDITIONAL is zero after the call.  When RELEASED is not
+	 * null, the execution is finished as the released execution of
+	 * its target was, and its dependencies are not visited.  */
 
 	void read_variable(shared_ptr <const Dep> dep); 
 	/* Read the content of the file into a string as the
@@ -478,21 +647,25 @@ public:
 		assert(targets.size()); 
 		return targets.front().format_src(); 
 	}
+	virtual const vector <Target> *get_targets() const {  return &targets;  }
 	virtual void notify_variable(const map <string, string> &result_variable_child) {  
 		mapping_variable.insert(result_variable_child.begin(), result_variable_child.end()); 
 	}
 
-	static size_t executions_by_pid_size;
+	static size_t executions_by_pid_size, executions_by_pid_capacity;
 	static pid_t *executions_by_pid_key;
 	static File_Execution **executions_by_pid_value; 
 	/* The currently running executions by process IDs.  Write
 	 * access to this is enclosed in a Signal_Blocker.  */
 	/* Both arrays are malloc'ed, have the same length, and are both
-	 * sorted by PID.  malloc() is only called once for each array,
-	 * giving the allocated memory a length that will be enough for
-	 * all jobs we will ever run, based on the value passed via the
-	 * -j option, so we avoid excessive calling of realloc(), and
-	 * race conditions while accessing this.  */
+	 * sorted by PID.  They are allocated with a length that is
+	 * enough for all jobs based on the value passed via the -j
+	 * option, so we avoid excessive calling of realloc().  They are
+	 * only enlarged when more processes than job slots are running,
+	 * i.e., when jobs are stopped (-I).  */
+	/* The value is null for a job that was killed in favor of its
+	 * backup job or vice versa (-e), and that has not been reaped
+	 * yet; its result is ignored.  */
 	/* For all file executions stored here, the following variables
 	 * are never changed as long as the File_Execution objects are
 	 * stored there, such that they can be accessed from
@@ -503,6 +676,23 @@ public:
 	/* Wait for next job to finish and finish it.  Do not start anything
 	 * new.  */ 
 
+	static void resume();
+	/* Continue stopped jobs (-I) in free job slots, highest priority
+	 * first */
+
+	static void start_backups();
+	/* Start the backup jobs that are due, and set the timer for the
+	 * next one (-e) */
+
+	static vector <File_Execution *> batches_pending; 
+	/* The first executions of the batches that have not been
+	 * started yet */
+
+	static void start_batches();
+	/* Start pending batches in free job slots.  Called when no
+	 * other job can be started, such that no more targets can be
+	 * added to them.  */
+
 protected:
 
 	virtual bool optional_finished(shared_ptr <const Dep> dep_link);
@@ -520,6 +710,7 @@ private:
 	friend void job_print_jobs(); 
 	/* The print-all-jobs signal was received - we must print all
 	 * jobs */
+	friend void memory_collect(vector <Memory::Entry> &entries); 
 
 	vector <Target> targets; 
 	/* The targets to which this execution object corresponds.
@@ -546,6 +737,10 @@ private:
 	 * C++ container because we access it from async-signal safe
 	 * functions.  Used to delete partially-built files.  */
 
+	vector <string> filenames_input;
+	/* With workers (-W):  the direct file dependencies, which are
+	 * sent to the worker */
+
 	shared_ptr <const Rule> rule;
 	/* The instantiated file rule for this execution.  Null when
 	 * there is no rule for this file (this happens for instance
@@ -571,6 +766,39 @@ private:
 	 * first C_PLACED flags are used; the other bits have an
 	 * unspecified value.  */
 
+	long priority;
+	/* The priority of the job, from the variable $STU_PRIORITY
+	 * (-I); 0 by default */
+
+	bool stopped;
+	/* Whether the job was stopped to free its slot for a job with a
+	 * higher priority (-I).  A stopped job does not use a slot.  */
+
+	static size_t count_stopped;
+
+	Job job_backup;
+	/* A second job running the same command, started when the job
+	 * takes longer than usual (-e).  Does not use a job slot.  */
+
+	char *filename_backup;
+	/* The temporary file into which the output of JOB_BACKUP is
+	 * redirected, and which replaces the target when the backup job
+	 * terminates first.  Null when no backup job is running.
+	 * Allocated with malloc(), as it is used in async signal-safe
+	 * functions.  */
+
+	double time_backup;
+	/* When to start the backup job, as CLOCK_MONOTONIC time, or -1
+	 * when no backup job is to be started */
+
+	map <string, string> mapping_backup; 
+	/* The variables of the job, used for the backup job */
+
+	vector <File_Execution *> batch;
+	/* In the first execution of a batch:  the other executions of
+	 * the batch, whose targets are built by JOB.  Each of them has
+	 * B_BATCHED set until JOB has terminated.  */
+
 	~File_Execution(); 
 
 	bool remove_if_existing(bool output); 
@@ -582,7 +810,22 @@ private:
 	void waited(pid_t pid, size_t index, int status); 
 	/* Called after the job was waited for.  The PID is only passed
 	 * for checking that it is correct.  INDEX is the index within
-	 * EXECUTIONS_BY_PID_*.  */
+	 * EXECUTIONS_BY_PID_* of the process that was waited for, which
+	 * is that of the backup job when it has replaced the job
+	 * (-e).  */
+
+	void finish_job(bool success, int status); 
+	/* Check the targets after the job that built them has
+	 * terminated with STATUS, or report its failure.  Called for
+	 * each execution of a batch.  */
+
+	size_t add_pid(pid_t pid); 
+	static void remove_pid(size_t index); 
+	/* Insert and remove entries in EXECUTIONS_BY_PID_*; must be
+	 * called with signals blocked.  add_pid() returns the index.  */
+
+	static size_t find_pid(pid_t pid); 
+	/* The index of PID in EXECUTIONS_BY_PID_*, or SIZE_MAX */
 
 	void warn_future_file(struct stat *buf, 
 			      const char *filename,
@@ -591,17 +834,66 @@ private:
 	/* Warn when the file has a modification time in the future.
 	 * MESSAGE_EXTRA may be null to not show an extra message.  */ 
 
-	void print_command() const; 
+	void print_command(const map <string, string> *parameters= nullptr) const; 
 	/* Print the command and its associated variable assignments,
-	 * according to the selected verbosity level.  */
-
-	void print_as_job() const;
-	/* Print a line to stdout for a running job, as output of SIGUSR1.
-	 * Is currently running.  */ 
+	 * according to the selected verbosity level.  PARAMETERS are
+	 * the parameter values to show, or null for those of this
+	 * execution.  */
+
+	void print_as_job(pid_t pid) const;
+	/* Print a line to stdout for a running job or backup job with
+	 * the given PID, as output of SIGUSR1.  Is currently running.  */ 
+
+	void prepare_backup(const map <string, string> &mapping); 
+	/* Called when the job has been started.  Set TIME_BACKUP when
+	 * a backup job can be started (-e):  the rule is marked as
+	 * idempotent by $STU_IDEMPOTENT, it has a single file target
+	 * which is written by output redirection, and its duration is
+	 * known from the history (-H).  */
+
+	void start_backup(); 
+
+	bool waited_backup(pid_t pid, size_t index, int &status); 
+	/* Called when the job or its backup job PID has terminated,
+	 * with INDEX in EXECUTIONS_BY_PID_*.  The job that terminated
+	 * first is used, and the other one is killed and marked as
+	 * abandoned in EXECUTIONS_BY_PID_*, except that a backup job
+	 * that failed is ignored.  Return whether the job is finished,
+	 * in which case STATUS is that of the job to use.  */
+
+	void discard_backup(); 
+	/* Remove the temporary file of the backup job */
+
+	bool preempt(); 
+	/* Called when a job with the priority PRIORITY is to be
+	 * started (-I).  Return whether it can be started now, which
+	 * may be done by stopping a running job with a lower priority.
+	 * Jobs are not started while a stopped job with at least the
+	 * same priority waits for a slot.  */
 
 	void write_content(const char *filename, const Command &command); 
 	/* Create the file FILENAME with content from COMMAND */
 
+	Proceed add_to_batch(size_t size); 
+	/* Instead of starting a job, add this execution to a pending
+	 * batch of the same parametrized rule with the same variables,
+	 * and start the batch when it contains SIZE executions.  */
+
+	void start_batch(); 
+	/* Start the job of the pending batch of which this is the
+	 * first execution */
+
+	static unordered_map <Target, Released> executions_released;
+	/* The released executions by each of their targets (-N) */
+
+	bool can_release() const; 
+	/* Whether the execution can be released:  it is finished, is not
+	 * connected, and no job refers to it */
+
+	void release(); 
+	/* Remove the execution from EXECUTIONS_BY_TARGET and record it
+	 * in EXECUTIONS_RELEASED; the caller deletes it */
+
 	static unordered_map <string, Timestamp> transients;
 	/* The timestamps for transient targets.  This container plays
 	 * the role of the file system for transient targets, holding
@@ -618,7 +910,8 @@ class Transient_Execution
 /* Used for non-dynamic transients that appear in rules that have only
  * transients as targets, and have no command.  If at least one file
  * target or a command is present in the rule, File_Execution is used.  */
-	:  public Execution 
+	:  public Execution,
+	   private Counted <Transient_Execution>
 {
 public:
 
@@ -636,6 +929,7 @@ public:
 	virtual bool finished() const;
 	virtual bool finished(Flags flags) const; 
 	virtual string format_src() const;
+	virtual const vector <Target> *get_targets() const {  return &targets;  }
 	virtual void notify_result(shared_ptr <const Dep> dep, 
 				   Execution *, 
 				   Flags flags,
@@ -674,11 +968,13 @@ private:
 };
 
 class Root_Execution
-	:  public Execution
+	:  public Execution,
+	   private Counted <Root_Execution>
 {
 public:
 
 	Root_Execution(const vector <shared_ptr <const Dep> > &dep); 
+	~Root_Execution(); 
 
 	virtual bool want_delete() const {  return true;  }
 	virtual Proceed execute(shared_ptr <const Dep> dep_this);
@@ -694,6 +990,33 @@ protected:
 private:
 
 	bool is_finished; 
+
+	vector <shared_ptr <const Dynamic_Dep> > deps_stream;
+	/* The -n and -0 dependencies whose entries are admitted one by
+	 * one (-N) */
+
+	size_t index_stream;
+	/* Index in DEPS_STREAM of the file being read */ 
+
+	bool is_built_stream;
+	/* Whether the files in DEPS_STREAM have been built; they are
+	 * read only afterwards */
+
+	FILE *file_stream;
+	/* The file being read; null when not yet opened */
+
+	Place place_stream;
+	/* Place of the last entry read from FILE_STREAM */
+
+	char *lineptr;
+	size_t size_lineptr; 
+	/* Buffer for getdelim(3) */
+
+	void admit(); 
+	/* Read entries from the files in DEPS_STREAM while fewer than
+	 * the given number of root dependencies are active */
+
+	void close_stream(); 
 };
 
 class Concat_Execution
@@ -709,7 +1032,8 @@ class Concat_Execution
  * cached, and they are deleted when done.  Thus, they also don't need
  * the 'done' field.  (But the parent class has it.)
  */
-	:  public Execution
+	:  public Execution,
+	   private Counted <Concat_Execution>
 {
 public:
 
@@ -772,7 +1096,8 @@ class Dynamic_Execution
  * which generates the list of dependencies that we are then adding as
  * children to ourselves. 
  */
-	:  public Execution 
+	:  public Execution,
+	   private Counted <Dynamic_Execution>
 {
 public:
 
@@ -842,6 +1167,12 @@ private:
 };
 
 long Execution::jobs= 1;
+size_t Execution::count_created= 0;
+int Execution::depth_current= 0;
+int Execution::depth_limit= INT_MAX;
+bool Execution::deferred= false;
+unsigned Execution::pass_current= 0;
+long Execution::depth_lookahead= 0;
 Rule_Set Execution::rule_set; 
 Timestamp Execution::timestamp_last;
 bool Execution::hide_out_message= false;
@@ -849,16 +1180,20 @@ bool Execution::out_message_done= false;
 unordered_map <Target, Execution *> Execution::executions_by_target;
 
 size_t File_Execution::executions_by_pid_size= 0;
+size_t File_Execution::executions_by_pid_capacity= 0;
 pid_t *File_Execution::executions_by_pid_key= nullptr;
 File_Execution **File_Execution::executions_by_pid_value= nullptr; 
+unordered_map <Target, File_Execution::Released> File_Execution::executions_released;
 unordered_map <string, Timestamp> File_Execution::transients;
+size_t File_Execution::count_stopped= 0;
+vector <File_Execution *> File_Execution::batches_pending;
 
 string Debug::padding_current= "";
 vector <const Execution *> Debug::executions; 
 
 Execution::~Execution()
 {
-	/* Nop */
+	++ Statistics::count_executions_deleted; 
 }
 
 void Execution::main(const vector <shared_ptr <const Dep> > &deps)
@@ -868,22 +1203,51 @@ void Execution::main(const vector <shared_ptr <const Dep> > &deps)
 	Root_Execution *root_execution= new Root_Execution(deps); 
 	int error= 0; 
 	shared_ptr <const Root_Dep> dep_root= make_shared <Root_Dep> (); 
+	Statistics::Timer timer(Statistics::PHASE_EXPAND); 
+	if (order == Order::BFS)
+		depth_limit= 1; 
 
 	try {
 		while (! root_execution->finished()) {
 			Proceed proceed;
+			/* In breadth-first order, each pass goes one level
+			 * deeper than the previous one.  The depth reached is
+			 * kept when a job has terminated, such that the upper
+			 * levels are not expanded again level by level.  */ 
 			do {
 				Debug::print(nullptr, "loop"); 
+				deferred= false; 
+				++ pass_current; 
 				proceed= root_execution->execute(dep_root);
 				assert(proceed); 
+				if (deferred) {
+					if (! slots_full()) 
+						++ depth_limit; 
+					else
+						proceed= P_WAIT; 
+				}
 			} while (proceed & P_PENDING); 
 
 			if (proceed & P_WAIT) {
+				if (File_Execution::count_stopped)
+					File_Execution::resume(); 
+				if (! File_Execution::batches_pending.empty()) {
+					File_Execution::start_batches(); 
+					/* Starting the batches failed */ 
+					if (File_Execution::executions_by_pid_size == 0)
+						continue;
+				}
 				File_Execution::wait();
 			}
 		}
 
 		assert(root_execution->finished()); 
+
+		/* Reap the jobs that were killed in favor of their
+		 * backup job or vice versa (-e) */
+		while (File_Execution::executions_by_pid_size)
+			File_Execution::wait(); 
+
 		assert(File_Execution::executions_by_pid_size == 0); 
 
 		bool success= (root_execution->error == 0);
@@ -892,8 +1256,11 @@ void Execution::main(const vector <shared_ptr <const Dep> > &deps)
 		error= root_execution->error; 
 		assert(error >= 0 && error <= 3); 
 
+		if (option_plan) 
+			Plan::print(jobs); 
+
 		if (success) {
-			if (! hide_out_message) {
+			if (! hide_out_message && ! option_plan) {
 				if (out_message_done)
 					print_out("Build successful");
 				else 
@@ -929,6 +1296,8 @@ void Execution::read_dynamic(shared_ptr <const Plain_Dep> dep_target,
 			     shared_ptr <const Dep> dep,
 			     Execution *dynamic_execution)
 {
+	Statistics::Timer timer(Statistics::PHASE_DYNAMIC); 
+
 	try {
 		const Place_Param_Target &place_param_target= to <Plain_Dep> (dep_target)->place_param_target; 
 
@@ -953,6 +1322,18 @@ void Execution::read_dynamic(shared_ptr <const Plain_Dep> dep_target,
 		assert(target.is_file()); 
 		string filename= target.get_name_nondynamic();
 
+		if (Reverse_Index::is_used())
+			Reverse_Index::dynamic(filename); 
+
+		/* In plan mode (-Q), the file was not rebuilt; its current
+		 * content is used, if it exists */
+		if (bits & B_PLANNED && access(filename.c_str(), F_OK) < 0) {
+			print_warning(dep_target->get_place(),
+				      fmt("Dependencies of %s are not known because it was not built in plan mode",
+					  dep_target->format_word()));
+			return; 
+		}
+
 		bool delim= (dep_target->flags & (F_NEWLINE_SEPARATED | F_NUL_SEPARATED));
 		/* Whether the dynamic dependency is delimiter-separated */
 
@@ -1044,7 +1425,7 @@ void Execution::read_dynamic(shared_ptr <const Plain_Dep> dep_target,
 			}
 		}
 
-		assert(! found_error || option_keep_going); 
+		assert(! found_error || option_keep_going || is_speculative()); 
 		vector <shared_ptr <const Dep> > deps_new;
 
 		shared_ptr <const Dep> top_top= dep_target->top;
@@ -1061,6 +1442,7 @@ void Execution::read_dynamic(shared_ptr <const Plain_Dep> dep_target,
 			}
 		}
 		swap(deps, deps_new); 
+		STU_PROBE2(dynamic_read, filename.c_str(), (long) deps.size()); 
 	} catch (int e) {
 		dynamic_execution->raise(e); 
 	}
@@ -1072,12 +1454,14 @@ bool Execution::find_cycle(Execution *parent,
 {
 	vector <Execution *> path;
 	path.push_back(parent); 
-	return find_cycle(path, child, dep_link); 
+	unordered_set <const Execution *> visited; 
+	return find_cycle(path, child, dep_link, visited); 
 }
 
 bool Execution::find_cycle(vector <Execution *> &path,
 			   Execution *child,
-			   shared_ptr <const Dep> dep_link)
+			   shared_ptr <const Dep> dep_link,
+			   unordered_set <const Execution *> &visited)
 {
 	if (same_rule(path.back(), child)) {
 		cycle_print(path, dep_link); 
@@ -1087,8 +1471,10 @@ bool Execution::find_cycle(vector <Execution *> &path,
 	for (auto &i:  path.back()->parents) {
 		Execution *next= i.first; 
 		assert(next != nullptr);
+		if (! visited.insert(next).second)
+			continue;
 		path.push_back(next); 
-		bool found= find_cycle(path, child, dep_link);
+		bool found= find_cycle(path, child, dep_link, visited);
 		if (found)
 			return true;
 		path.pop_back(); 
@@ -1214,9 +1600,11 @@ void Execution::operator<<(string text) const
 	string text_parent= depp->format_word(); 
 
 	while (true) {
-		if (dynamic_cast <const Root_Execution *> (execution)) {
+		/* With -N, children of the root execution may have a
+		 * top dependency, i.e., the -n or -0 option */ 
+		if (dynamic_cast <const Root_Execution *> (execution)
+		    && ! depp->top) {
 			/* We are in a child of the root execution */ 
-			assert(! depp->top); 
 			if (first && text != "") {
 				/* No text was printed yet, but there
 				 * was a TEXT passed:  Print it with the
@@ -1273,13 +1661,42 @@ Proceed Execution::execute_children()
 	vector <Execution *> executions_children_vector
 		(children.begin(), children.end()); 
 
+	/* Children are taken from the back.  In target order, they are
+	 * ordered by name.  In breadth-first order and with lookahead,
+	 * many children may be connected at once; they are continued in
+	 * the order in which they were created, which is the order of
+	 * their declaration in most cases.  Otherwise, there is mostly
+	 * only a single child in non-random orders, and the order does
+	 * not matter.  */ 
+	if (order == Order::TARGET) {
+		/* Compute each key only once */ 
+		vector <pair <uint64_t, Execution *> > keyed;
+		keyed.reserve(executions_children_vector.size()); 
+		for (Execution *child:  executions_children_vector)
+			keyed.emplace_back(order_key(child->format_src()), child); 
+		sort(keyed.begin(), keyed.end(),
+		     [](const pair <uint64_t, Execution *> &a,
+			const pair <uint64_t, Execution *> &b) {
+			     return a.first > b.first; 
+		     }); 
+		for (size_t i= 0;  i < keyed.size();  ++i)
+			executions_children_vector[i]= keyed[i].second; 
+	} else if (order == Order::BFS
+		   || (option_lookahead > 0 && order != Order::RANDOM)) {
+		sort(executions_children_vector.begin(),
+		     executions_children_vector.end(),
+		     [](const Execution *a, const Execution *b) {
+			     return a->index_created > b->index_created; 
+		     }); 
+	}
+
 	Proceed proceed_all= 0;
 
 	while (! executions_children_vector.empty()) {
 
 		assert(jobs >= 0);
 
-		if (order_vec) {
+		if (order == Order::RANDOM) {
 			/* Exchange a random position with last position */ 
 			size_t p_last= executions_children_vector.size() - 1;
 			size_t p_random= random_number(executions_children_vector.size());
@@ -1297,7 +1714,7 @@ Proceed Execution::execute_children()
 
 		shared_ptr <const Dep> dep_child= child->parents.at(this);
 
-		Proceed proceed_child= child->execute(dep_child);
+		Proceed proceed_child= execute_child(child, dep_child);
 		assert(proceed_child); 
 
 		proceed_all |= (proceed_child & ~(P_FINISHED | P_ABORT));
@@ -1318,7 +1735,7 @@ Proceed Execution::execute_children()
 	}
 
 	if (error) {
-		assert(option_keep_going); 
+		assert(option_keep_going || is_speculative()); 
 		/* Otherwise, Stu would have aborted */ 
 	}
 
@@ -1327,13 +1744,31 @@ Proceed Execution::execute_children()
 		 * WAIT or PENDING */ 
 		assert(children.empty()); 
 		if (error) {
-			assert(option_keep_going); 
+			assert(option_keep_going || is_speculative()); 
 		}
 	}
 
 	return proceed_all; 
 }
 
+Proceed Execution::execute_child(Execution *child, shared_ptr <const Dep> dep_child)
+{
+	if (order == Order::BFS
+	    && child->pass_executed == pass_current
+	    && child->flags_executed == dep_child->flags
+	    && ! child->finished(dep_child->flags)) 
+		return child->proceed_executed; 
+
+	Descent descent; 
+	Proceed proceed_child= child->execute(dep_child); 
+	if (order == Order::BFS && ! (proceed_child & P_FINISHED)) {
+		child->pass_executed= pass_current;
+		child->flags_executed= dep_child->flags;
+		child->proceed_executed= proceed_child; 
+	}
+	return proceed_child; 
+}
+
 void Execution::push(shared_ptr <const Dep> dep)
 {
 	assert(dep); 
@@ -1354,9 +1789,26 @@ void Execution::push(shared_ptr <const Dep> dep)
 		d->check(); 
 		assert(d->is_normalized()); 
 		buffer_A.push(d);
+		if (Prefetch::is_used())
+			prefetch(d); 
 	}
 }
 
+void Execution::prefetch(shared_ptr <const Dep> dep)
+{
+	shared_ptr <const Plain_Dep> plain_dep= to <Plain_Dep> (dep); 
+	if (! plain_dep 
+	    || plain_dep->place_param_target.place_name.get_n() != 0)
+		return;
+	Target target= dep->get_target(); 
+	if (executions_by_target.count(get_target_for_cache(target)))
+		return;
+	Target target_without_flags= target; 
+	target_without_flags.get_front_word_nondynamic() &= F_TARGET_TRANSIENT; 
+	Prefetch::request(target.get_name_nondynamic(), target.is_transient(), 
+			  ! rule_set.has_unparametrized(target_without_flags)); 
+}
+
 Proceed Execution::execute_base_A(shared_ptr <const Dep> dep_this)
 {
 	Debug debug(this);
@@ -1376,6 +1828,19 @@ Proceed Execution::execute_base_A(shared_ptr <const Dep> dep_this)
 		return proceed |= P_FINISHED; 
 	}
 
+	if (depth_current > depth_limit) {
+		Debug::print(this, "deferred"); 
+		deferred= true; 
+		return proceed |= P_PENDING; 
+	}
+
+	/* Beyond the lookahead while all job slots are in use:  don't
+	 * even continue the already-active children, as the number of
+	 * paths through them may be exponential */ 
+	if (option_lookahead > 0 && depth_lookahead > option_lookahead) {
+		return proceed |= P_WAIT; 
+	}
+
 	/* In DFS mode, first continue the already-open children, then
 	 * open new children.  In random mode, start new children first
 	 * and continue already-open children second */ 
@@ -1384,7 +1849,7 @@ Proceed Execution::execute_base_A(shared_ptr <const Dep> dep_this)
 		Proceed proceed_2= execute_children();
 		proceed |= proceed_2;
 		if (proceed & P_WAIT) {
-			if (jobs == 0) 
+			if (slots_exhausted()) 
 				return proceed; 
 		} else if (finished(dep_this->flags) && ! option_keep_going) { 
 			Debug::print(this, "finished"); 
@@ -1397,18 +1862,22 @@ Proceed Execution::execute_base_A(shared_ptr <const Dep> dep_this)
 		return proceed |= P_ABORT | P_FINISHED; 
 	}
 
-	assert(error == 0 || option_keep_going); 
+	assert(error == 0 || option_keep_going || is_speculative()); 
 
 	/* 
 	 * Deploy dependencies (first pass), with the F_NOTRIVIAL flag
 	 */ 
 
-	if (jobs == 0) {
-		return proceed |= P_WAIT;
-	}
-
 	while (! buffer_A.empty()) {
+		if (slots_exhausted()) {
+			return proceed |= P_WAIT;
+		}
 		shared_ptr <const Dep> dep_child= buffer_A.next(); 
+		if (option_lookahead > 0 && slots_full()
+		    && ! lookahead_possible(dep_child)) {
+			buffer_A.put_back(dep_child); 
+			return proceed |= P_WAIT; 
+		}
 		if ((dep_child->flags & (F_RESULT_NOTIFY | F_TRIVIAL)) == F_TRIVIAL) {
 			shared_ptr <Dep> dep_child_2= 
 				Dep::clone(dep_child);
@@ -1418,12 +1887,31 @@ Proceed Execution::execute_base_A(shared_ptr <const Dep> dep_this)
 		}
 		Proceed proceed_2= connect(dep_this, dep_child); 
 		proceed |= proceed_2;
-		if (jobs == 0) {
+		if (slots_exhausted()) {
 			return proceed |= P_WAIT; 
 		}
 	} 
 	assert(buffer_A.empty()); 
 
+	/* Start the trivial dependencies in free job slots while
+	 * non-trivial dependencies are still running (-A).  Entries are
+	 * taken from BUFFER_B and put back, as they are still needed
+	 * for the second pass.  */
+	if (option_speculative && ! (bits & B_SPECULATED)
+	    && ! children.empty() && jobs > 0) {
+		bits |= B_SPECULATED; 
+		for (size_t i= buffer_B.size();  i;  --i) {
+			shared_ptr <const Dep> dep_child= buffer_B.next(); 
+			buffer_B.push(dep_child); 
+			if (jobs == 0) {
+				/* Try the remaining ones later */ 
+				bits &= ~B_SPECULATED; 
+				continue;
+			}
+			proceed |= connect_speculative(dep_this, dep_child); 
+		}
+	}
+
 	if (order == Order::RANDOM) {
 		Proceed proceed_2= execute_children();
 		proceed |= proceed_2; 
@@ -1439,7 +1927,7 @@ Proceed Execution::execute_base_A(shared_ptr <const Dep> dep_this)
 
 	/* There was an error in a child */ 
 	if (error) {
-		assert(option_keep_going == true); 
+		assert(option_keep_going || is_speculative()); 
 		return proceed |= P_ABORT | P_FINISHED; 
 	}
 
@@ -1527,7 +2015,7 @@ Proceed Execution::connect(shared_ptr <const Dep> dep_this,
 		}
 	}
 
-	Proceed proceed_child= child->execute(dep_child);
+	Proceed proceed_child= execute_child(child, dep_child);
 	assert(proceed_child); 
 	if (proceed_child & (P_WAIT | P_PENDING))
 		return proceed_child; 
@@ -1539,25 +2027,123 @@ Proceed Execution::connect(shared_ptr <const Dep> dep_this,
 	return 0;
 }
 
+bool Execution::lookahead_possible(shared_ptr <const Dep> dep)
+{
+	if (dep->flags & F_OPTIONAL)
+		return false;
+
+	shared_ptr <const Plain_Dep> plain_dep= to <Plain_Dep> (dep); 
+	if (! plain_dep || (plain_dep->place_param_target.flags & F_TARGET_TRANSIENT))
+		return true;
+
+	Target target= dep->get_target(); 
+	if (executions_by_target.count(get_target_for_cache(target)))
+		return true;
+	target.get_front_word_nondynamic() &= F_TARGET_TRANSIENT; 
+	if (rule_set.has_rule(target))
+		return true;
+
+	/* A file without a rule is fine when it exists */ 
+	struct stat buf;
+	return stu_stat(target.get_name_c_str_nondynamic(), &buf) == 0; 
+}
+
+Proceed Execution::connect_speculative(shared_ptr <const Dep> dep_this,
+				       shared_ptr <const Dep> dep_child)
+{
+	if (! to <Plain_Dep> (dep_child) 
+	    || dep_child->flags & (F_VARIABLE | F_TARGET_TRANSIENT | F_RESULT_COPY)
+	    || (dep_child->flags & F_PERSISTENT && dep_child->flags & F_OPTIONAL))
+		return 0;
+
+	auto it= executions_by_target.find
+		(get_target_for_cache(dep_child->get_target())); 
+	if (it != executions_by_target.end()
+	    && (it->second->parents.count(this) 
+		|| it->second->finished(dep_child->flags)))
+		return 0;
+
+	shared_ptr <Dep> d= Dep::clone(dep_child);
+	d->flags |= F_SPECULATIVE; 
+	return connect(dep_this, d); 
+}
+
 void Execution::raise(int error_)
 {
 	assert(error_ >= 1 && error_ <= 3); 
 	error |= error_;
-	if (! option_keep_going)
+	if (! option_keep_going && ! is_speculative())
 		throw error;
 }
 
+bool Execution::is_speculative() const
+{
+	/* Search for a path to the root without speculative
+	 * dependencies.  Each execution is visited once, as the number
+	 * of paths may be exponential when executions have multiple
+	 * parents.  */ 
+	vector <const Execution *> todo{this};
+	unordered_set <const Execution *> seen{this}; 
+	while (! todo.empty()) {
+		const Execution *e= todo.back();
+		todo.pop_back();
+		if (e->parents.empty())
+			return false;
+		for (const auto &i:  e->parents) 
+			if (! (i.second->flags & F_SPECULATIVE) 
+			    && seen.insert(i.first).second)
+				todo.push_back(i.first); 
+	}
+	return true; 
+}
+
+void Execution::record_edge(const Execution *child)
+{
+	const vector <Target> *targets_child= child->get_targets();
+	if (targets_child == nullptr)
+		return;
+
+	/* Dynamic and concatenated executions are passed through */ 
+	vector <Execution *> todo{this};
+	unordered_set <Execution *> seen; 
+	while (! todo.empty()) {
+		Execution *e= todo.back();
+		todo.pop_back();
+		if (! seen.insert(e).second)
+			continue;
+		if (e->get_targets()) {
+			if (Reverse_Index::is_used())
+				for (const Target &target:  *e->get_targets())
+					Reverse_Index::edge(target, *targets_child); 
+			File_Execution *file_execution= dynamic_cast <File_Execution *> (e); 
+			if ((Worker::is_used() || Cache::is_used()) && file_execution)
+				for (const Target &target:  *targets_child)
+					if (target.is_file())
+						file_execution->filenames_input.push_back
+							(target.get_name_nondynamic()); 
+			continue;
+		}
+		for (auto &i:  e->parents)
+			todo.push_back(i.first); 
+	}
+}
+
 void Execution::disconnect(Execution *const child,
 			   shared_ptr <const Dep> dep_child)
 {
 	Debug::print(this, fmt("disconnect %s", dep_child->format_src())); 
+	STU_PROBE3(disconnect, (void *) this, (void *) child, child->error); 
 
 	assert(child != nullptr); 
 	assert(child != this); 
 	assert(child->finished(dep_child->flags)); 
-	assert(option_keep_going || child->error == 0); 
 	dep_child->check(); 
 
+	/* Without -k, an error is raised where it occurs, except in
+	 * dependencies started speculatively (-A).  Their errors are
+	 * raised here when they are needed.  */ 
+	int error_raise= 0;
+
 	if (dep_child->flags & F_RESULT_NOTIFY
 	    && dynamic_cast <File_Execution *> (child)
 	    ) {
@@ -1572,6 +2158,15 @@ void Execution::disconnect(Execution *const child,
 		notify_result(d, child, F_RESULT_COPY, dep_child); 
 	}
 
+	/* A speculatively started trivial dependency must not influence
+	 * whether THIS is rebuilt; it is connected again in the second
+	 * pass when it is needed */
+	if (dep_child->flags & F_SPECULATIVE) 
+		goto remove; 
+
+	if (Reverse_Index::is_used() || Worker::is_used() || Cache::is_used())
+		record_edge(child); 
+
 	/* Propagate timestamp */
 	/* Don't propagate the timestamp of the dynamic dependency itself */ 
 	if (! (dep_child->flags & F_PERSISTENT) && 
@@ -1603,6 +2198,8 @@ void Execution::disconnect(Execution *const child,
 	 * before.  */ 
 
 	error |= child->error; 
+	if (! option_keep_going)
+		error_raise= child->error; 
 
 	/* Don't propagate the NEED_BUILD flag via DYNAMIC_LEFT links:
 	 * It just means the list of depenencies have changed, not the
@@ -1612,6 +2209,11 @@ void Execution::disconnect(Execution *const child,
 		bits |= B_NEED_BUILD; 
 	}
 
+	/* Propagate the planned jobs (-Q) */
+	jobs_plan.insert(jobs_plan.end(),
+			 child->jobs_plan.begin(), child->jobs_plan.end()); 
+
+ remove:
 	/* Remove the links between them */ 
 	assert(children.count(child) == 1); 
 	assert(child->parents.count(this) == 1);
@@ -1621,6 +2223,18 @@ void Execution::disconnect(Execution *const child,
 	/* Delete the Execution object */
 	if (child->want_delete())
 		delete child; 
+	else if (option_admission > 0) {
+		/* With -N, finished file executions are not kept, such
+		 * that memory is bounded by the admitted targets */ 
+		File_Execution *file_child= dynamic_cast <File_Execution *> (child); 
+		if (file_child && file_child->can_release()) {
+			file_child->release(); 
+			delete file_child; 
+		}
+	}
+
+	if (error_raise)
+		raise(error_raise); 
 }
 
 Proceed Execution::execute_base_B(shared_ptr <const Dep> dep_link)
@@ -1628,10 +2242,15 @@ Proceed Execution::execute_base_B(shared_ptr <const Dep> dep_link)
 	Proceed proceed= 0;
 	while (! buffer_B.empty()) {
 		shared_ptr <const Dep> dep_child= buffer_B.next(); 
+		if (option_lookahead > 0 && slots_full()
+		    && ! lookahead_possible(dep_child)) {
+			buffer_B.put_back(dep_child); 
+			return proceed |= P_WAIT; 
+		}
 		Proceed proceed_2= connect(dep_link, dep_child);
 		proceed |= proceed_2; 
 		assert(jobs >= 0);
-		if (jobs == 0) {
+		if (slots_exhausted()) {
 			return proceed |= P_WAIT; 
 		}
 	} 
@@ -1651,6 +2270,7 @@ Execution *Execution::get_execution(shared_ptr <const Dep> dep)
 		int error_additional= 0; 
 		Concat_Execution *execution= new Concat_Execution(concat_dep, this, error_additional); 
 		assert(execution); 
+		STU_PROBE2(execution_create, (void *) execution, ""); 
 		if (error_additional) {
 			error |= error_additional; 
 			assert(execution->want_delete());
@@ -1666,6 +2286,7 @@ Execution *Execution::get_execution(shared_ptr <const Dep> dep)
 		Dynamic_Execution *execution= new Dynamic_Execution
 			(to <const Dynamic_Dep> (dep), this, error_additional);
 		assert(execution);
+		STU_PROBE2(execution_create, (void *) execution, ""); 
 		if (error_additional) {
 			error |= error_additional;
 			assert(execution->want_delete()); 
@@ -1694,9 +2315,14 @@ Execution *Execution::get_execution(shared_ptr <const Dep> dep)
 			/* THIS and CHILD are already connected -- add the
 			 * necessary flags */ 
 			Flags flags= dep->flags; 
-			if (flags & ~execution->parents.at(this)->flags) {
+			Flags flags_old= execution->parents.at(this)->flags; 
+			if (flags & ~flags_old
+			    || (flags_old & ~flags & F_SPECULATIVE)) {
 				shared_ptr <Dep> dep_new= Dep::clone(execution->parents.at(this));
 				dep_new->flags |= flags;
+				/* The dependency is now needed (-A) */ 
+				if (! (flags & F_SPECULATIVE))
+					dep_new->flags &= ~F_SPECULATIVE; 
 				dep= dep_new;
 				/* No need to check for cycles here,
 				 * because a link between the two
@@ -1760,13 +2386,16 @@ Execution *Execution::get_execution(shared_ptr <const Dep> dep)
 		}
 		
 		if (use_file_execution) {
+			auto i= File_Execution::executions_released.find(target_for_cache); 
 			execution= new File_Execution
 				(dep, 
 				 this,
 				 rule_child, 
 				 param_rule_child, 
 				 mapping_parameter,
-				 error_additional); 
+				 error_additional,
+				 i == File_Execution::executions_released.end() 
+				 ? nullptr : &i->second); 
 		} else if (target.is_transient()) {
 			execution= new Transient_Execution
 				(dep, 
@@ -1780,6 +2409,7 @@ Execution *Execution::get_execution(shared_ptr <const Dep> dep)
 						 this,
 						 error_additional); 
 	}
+	STU_PROBE2(execution_create, (void *) execution, target.get_name_c_str_any()); 
 
 	if (error_additional) {
 		error |= error_additional; 
@@ -1872,13 +2502,12 @@ shared_ptr <const Dep> Execution::set_top(shared_ptr <const Dep> dep,
 }
 
 File_Execution::~File_Execution()
-/* Objects of this type are never deleted */ 
+/* Objects of this type are only deleted when released (-N) */ 
 {
-	assert(false);
-
-	/* We write this here as a reminder if this is ever activated */
+	assert(can_release()); 
 
 	free(timestamps_old); 
+	free(filename_backup); 
 	if (filenames) {
 		for (size_t i= 0;  i < targets.size();  ++i) {
 			if (filenames[i]) {
@@ -1900,13 +2529,151 @@ void File_Execution::wait()
 
 	assert(File_Execution::executions_by_pid_size); 
 
+	if (option_backup)
+		start_backups(); 
+
 	int status;
-	const pid_t pid= Job::wait(&status); 
+	pid_t pid;
+	{
+		Statistics::Timer timer(Statistics::PHASE_WAIT); 
+		pid= Job::wait(&status); 
+	}
+
+	/* The timer expired:  a backup job is started in the next
+	 * call */
+	if (pid < 0)
+		return; 
 
 	Debug::print(nullptr, frmt("pid = %ld", (long) pid)); 
 
 	timestamp_last= Timestamp::now(); 
 
+	size_t index= find_pid(pid); 
+	if (index == SIZE_MAX) {
+		/* No File_Execution is registered for the PID that
+		 * just finished.  Should not happen, but since the PID
+		 * value came from outside this process, we better
+		 * handle this case gracefully, i.e., do nothing.  */
+		print_warning(Place(), 
+			      frmt("The function waitpid(2) returned the invalid process ID %jd", 
+				   (intmax_t)pid)); 
+		return; 
+	}
+	
+	File_Execution *const execution= executions_by_pid_value[index]; 
+	if (execution == nullptr) {
+		/* A job that was abandoned (-e) */ 
+		Debug::print(nullptr, "abandoned job reaped"); 
+		{
+			Job::Signal_Blocker sb;
+			remove_pid(index); 
+		}
+		if (Cgroup::is_used())
+			Cgroup::remove(pid); 
+		return; 
+	}
+	if (execution->filename_backup) {
+		if (! execution->waited_backup(pid, index, status))
+			return; 
+		/* INDEX is that of the job that terminated, which may
+		 * be the backup job */ 
+		pid= execution->job.get_pid(); 
+	}
+	/* A stopped job may have been killed by another process; it
+	 * does not use a slot */
+	bool stopped= execution->stopped;
+	if (stopped) {
+		execution->stopped= false;
+		-- count_stopped; 
+	}
+	execution->waited(pid, index, status); 
+	if (! stopped)
+		++jobs; 
+	Timeline::job_waited(pid, status, jobs, Statistics::executions_live()); 
+}
+
+size_t File_Execution::add_pid(pid_t pid)
+{
+	if (executions_by_pid_size == executions_by_pid_capacity) {
+		/* This is executed once before we have executed
+		 * any job, and therefore JOBS plus the number
+		 * of stopped jobs is the value passed via -j
+		 * (or its default value 1).  Later, this is only
+		 * executed when stopped jobs (-I) or backup jobs
+		 * (-e) do not use a slot.  */
+		size_t capacity= executions_by_pid_capacity
+			? 2 * executions_by_pid_capacity
+			: jobs + count_stopped; 
+		if (SIZE_MAX / sizeof(*executions_by_pid_key) < capacity ||
+		    SIZE_MAX / sizeof(*executions_by_pid_value) < capacity) {
+			errno= ENOMEM;
+			perror("malloc"); 
+			exit(ERROR_FATAL); 
+		}
+		pid_t *key= (pid_t *)
+			realloc(executions_by_pid_key, capacity * sizeof(*executions_by_pid_key));
+		if (key)
+			executions_by_pid_key= key; 
+		File_Execution **value= (File_Execution **)
+			realloc(executions_by_pid_value, capacity * sizeof(*executions_by_pid_value)); 
+		if (value)
+			executions_by_pid_value= value; 
+		if (!key || !value) {
+			perror("realloc"); 
+			exit(ERROR_FATAL); 
+		}
+		executions_by_pid_capacity= capacity; 
+	}
+
+	size_t mi= 0, ma= executions_by_pid_size;
+	/* Both are exclusive */
+	assert(mi <= ma); 
+	while (mi < ma) {
+		size_t ne= mi + (ma - mi) / 2;
+		assert(ne < ma); 
+		assert(ne < executions_by_pid_size); 
+		assert(executions_by_pid_key[ne] != pid); 
+		if (executions_by_pid_key[ne] < pid) {
+			mi= ne + 1;
+		} else {
+			ma= ne;
+		}
+	}
+	assert(mi == ma); 
+	assert(mi <= executions_by_pid_size); 
+	assert(mi == 0 || executions_by_pid_key[mi - 1] < pid); 
+	assert(mi == executions_by_pid_size || executions_by_pid_key[mi] > pid); 
+	size_t index= mi; 
+
+	memmove(executions_by_pid_key + index + 1,
+		executions_by_pid_key + index,
+		sizeof(*executions_by_pid_key) * (executions_by_pid_size - index));
+	memmove(executions_by_pid_value + index + 1,
+		executions_by_pid_value + index,
+		sizeof(*executions_by_pid_value) * (executions_by_pid_size - index)); 
+	++ executions_by_pid_size; 
+	executions_by_pid_key[index]= pid;
+	executions_by_pid_value[index]= this;
+	return index; 
+}
+
+void File_Execution::remove_pid(size_t index)
+{
+	assert(executions_by_pid_size > 0); 
+	assert(executions_by_pid_size >= index + 1); 
+	memmove(executions_by_pid_key + index,
+		executions_by_pid_key + index + 1,
+		sizeof(*executions_by_pid_key) * (executions_by_pid_size - index - 1)); 
+	memmove(executions_by_pid_value + index,
+		executions_by_pid_value + index + 1,
+		sizeof(*executions_by_pid_value) * (executions_by_pid_size - index - 1)); 
+	-- executions_by_pid_size; 
+}
+
+size_t File_Execution::find_pid(pid_t pid)
+{
+	if (executions_by_pid_size == 0)
+		return SIZE_MAX; 
 	size_t mi= 0, ma= executions_by_pid_size - 1;
 	/* Both are inclusive */
 	assert(mi <= ma); 
@@ -1923,24 +2690,9 @@ void File_Execution::wait()
 			ma= ne - 1;
 		}
 	}
-	if (mi > ma || mi == SIZE_MAX) {
-		/* No File_Execution is registered for the PID that
-		 * just finished.  Should not happen, but since the PID
-		 * value came from outside this process, we better
-		 * handle this case gracefully, i.e., do nothing.  */
-		print_warning(Place(), 
-			      frmt("The function waitpid(2) returned the invalid process ID %jd", 
-				   (intmax_t)pid)); 
-		return; 
-	}
-	assert(mi == ma); 
-	const size_t index= mi; 
-	assert(index < executions_by_pid_size); 
-	assert(executions_by_pid_key[index] == pid); 
-	
-	File_Execution *const execution= executions_by_pid_value[index]; 
-	execution->waited(pid, index, status); 
-	++jobs; 
+	if (mi > ma || mi == SIZE_MAX || executions_by_pid_key[mi] != pid)
+		return SIZE_MAX; 
+	return mi; 
 }
 
 void File_Execution::waited(pid_t pid, size_t index, int status) 
@@ -1950,27 +2702,38 @@ void File_Execution::waited(pid_t pid, size_t index, int status)
 
 	Execution::check_waited(); 
 
-	done= ~0;
+	if (Prefetch::is_used())
+		Prefetch::invalidate(); 
 
+	vector <File_Execution *> executions_batch; 
 	{
 		Job::Signal_Blocker sb;
-		/* Remove entry from EXECUTIONS_BY_PID_* */
-		assert(executions_by_pid_size > 0); 
-		assert(executions_by_pid_size >= index + 1); 
-		memmove(executions_by_pid_key + index,
-			executions_by_pid_key + index + 1,
-			sizeof(*executions_by_pid_key) * (executions_by_pid_size - index - 1)); 
-		memmove(executions_by_pid_value + index,
-			executions_by_pid_value + index + 1,
-			sizeof(*executions_by_pid_value) * (executions_by_pid_size - index - 1)); 
-		-- executions_by_pid_size; 
+		remove_pid(index); 
+		swap(executions_batch, batch); 
 	}
 
+	bool success= job.waited(status, pid); 
+	Profile::job(param_rule.get(), job.get_time_wall(), job.get_time_cpu(), success); 
+	Progress::job_waited(pid, success); 
+	if (Job::listener)
+		Job::listener->job_waited(pid, targets.front().format_src(), success); 
+	STU_PROBE3(job_reap, (int) pid, status, (long) (job.get_time_wall() * 1e6)); 
+
+	finish_job(success, status); 
+	for (File_Execution *execution:  executions_batch)
+		execution->finish_job(success, status); 
+}
+
+void File_Execution::finish_job(bool success, int status)
+{
+	done= ~0;
+	bits &= ~B_BATCHED; 
+
 	/* The file(s) may have been built, so forget that it was known
 	 * to not exist */
 	bits &= ~B_MISSING; 
 
-	if (job.waited(status, pid)) {
+	if (success) {
 		/* Command was successful */ 
 
 		bits |=  B_EXISTING; 
@@ -1988,7 +2751,7 @@ void File_Execution::waited(pid_t pid, size_t index, int status)
 			const char *const filename= target.get_name_c_str_nondynamic();
 			struct stat buf;
 
-			if (0 == stat(filename, &buf)) {
+			if (0 == stu_stat(filename, &buf)) {
 
 				/* The file exists */ 
 
@@ -2089,14 +2852,20 @@ File_Execution::File_Execution(shared_ptr <const Dep> dep,
 			       shared_ptr <const Rule> rule_,
 			       shared_ptr <const Rule> param_rule_,
 			       map <string, string> &mapping_parameter_,
-			       int &error_additional)
+			       int &error_additional,
+			       const Released *released)
 	:  Execution(param_rule_),
 	   timestamps_old(nullptr),
 	   filenames(nullptr),
 	   rule(rule_),
-	   done(0)
+	   done(0),
+	   priority(0),
+	   stopped(false),
+	   filename_backup(nullptr),
+	   time_backup(-1)
 {
 	assert((param_rule_ == nullptr) == (rule_ == nullptr)); 
+	++ Statistics::count_executions[Statistics::E_FILE]; 
 
 	swap(mapping_parameter, mapping_parameter_); 
 	Target target_= dep->get_target(); 
@@ -2132,11 +2901,19 @@ File_Execution::File_Execution(shared_ptr <const Dep> dep,
 		executions_by_target[target]= this; 
 	}
 
-	if (rule != nullptr) {
+	if (released != nullptr) {
+		/* The execution was released (-N) */ 
+		done= released->done; 
+		bits= released->bits; 
+		error= released->error; 
+		timestamp= released->timestamp; 
+	} else if (rule != nullptr) {
 		/* There is a rule for this execution */ 
 		for (auto &d:  rule->deps) {
 			push(d); 
 		}
+		if (rule->command && Progress::is_used())
+			Progress::queued(targets.front().format_src()); 
 	} else {
 		/* There is no rule for this execution */ 
 
@@ -2148,7 +2925,7 @@ File_Execution::File_Execution(shared_ptr <const Dep> dep,
 				/* Check that the file is present,
 				 * or make it an error */ 
 				struct stat buf;
-				int ret_stat= stat(target_.get_name_c_str_nondynamic(), &buf);
+				int ret_stat= stu_stat(target_.get_name_c_str_nondynamic(), &buf);
 				if (0 > ret_stat) {
 					if (errno != ENOENT) {
 						string text= target_.format_word();
@@ -2160,9 +2937,11 @@ File_Execution::File_Execution(shared_ptr <const Dep> dep,
 				} else {
 					/* File exists:  Do nothing, and there are no
 					 * dependencies to build */  
-					if (dynamic_cast <Root_Execution *> (parent)) {
+					if (dynamic_cast <Root_Execution *> (parent) && ! dep->top) {
 						/* Output this only for top-level targets, and
-						 * therefore we don't need traces */ 
+						 * therefore we don't need traces.  Files
+						 * given by -n and -0 with -N and targets read
+						 * from them have a top dependency.  */ 
 						print_out(fmt("No rule for building %s, but the file exists", 
 							      target_.format_out_print_word())); 
 						hide_out_message= true; 
@@ -2250,6 +3029,33 @@ File_Execution::File_Execution(shared_ptr <const Dep> dep,
 	parents[parent]= dep; 
 }
 
+bool File_Execution::can_release() const
+{
+	return finished()
+		&& parents.empty()
+		&& children.empty()
+		&& ! job.started()
+		&& ! job_backup.started()
+		&& filename_backup == nullptr
+		&& batch.empty()
+		&& ! (bits & B_BATCHED)
+		&& ! stopped
+		&& ! option_plan; 
+}
+
+void File_Execution::release()
+{
+	assert(can_release()); 
+	Debug::print(this, "release"); 
+	Released released{done, bits, error, timestamp}; 
+	for (const Target &target:  targets) {
+		auto i= executions_by_target.find(target); 
+		if (i != executions_by_target.end() && i->second == this)
+			executions_by_target.erase(i); 
+		executions_released[target]= released; 
+	}
+}
+
 bool File_Execution::finished() const 
 {
 	return (~done & D_ALL) == 0; 
@@ -2280,11 +3086,27 @@ void job_terminate_all()
 		Job::kill(pid); 
 	}
 
+	/* Also kills processes that left the process group of their job */
+	Cgroup::kill_all(); 
+
 	size_t count_terminated= 0;
 
 	for (size_t i= 0;  i < File_Execution::executions_by_pid_size;  ++i) {
-		if (File_Execution::executions_by_pid_value[i]->remove_if_existing(false))
+		File_Execution *execution= File_Execution::executions_by_pid_value[i];
+		/* Abandoned jobs (-e) don't have files to remove */
+		if (execution == nullptr)
+			continue;
+		/* A backup job (-e) shares the execution with its job */
+		if (execution->filename_backup) {
+			unlink(execution->filename_backup); 
+			if (File_Execution::executions_by_pid_key[i] != execution->job.get_pid())
+				continue;
+		}
+		if (execution->remove_if_existing(false))
 			++count_terminated;
+		for (File_Execution *execution_batch:  execution->batch)
+			if (execution_batch->remove_if_existing(false))
+				++count_terminated;
 	}
 
 	if (count_terminated) {
@@ -2329,10 +3151,52 @@ void job_print_jobs()
 	for (size_t i= 0;  
 	     i < File_Execution::executions_by_pid_size;
 	     ++i) {
-		File_Execution::executions_by_pid_value[i]->print_as_job(); 
+		if (File_Execution::executions_by_pid_value[i] == nullptr)
+			continue;
+		File_Execution::executions_by_pid_value[i]->print_as_job
+			(File_Execution::executions_by_pid_key[i]); 
 	}
 }
 
+void memory_collect(vector <Memory::Entry> &entries)
+/* Collect the memory statistics of all data structures of Stu */ 
+{
+	Memory::add_objects <File_Execution>      (entries, "File_Execution");
+	Memory::add_objects <Transient_Execution> (entries, "Transient_Execution");
+	Memory::add_objects <Root_Execution>      (entries, "Root_Execution");
+	Memory::add_objects <Concat_Execution>    (entries, "Concat_Execution");
+	Memory::add_objects <Dynamic_Execution>   (entries, "Dynamic_Execution");
+	Memory::add_objects <Plain_Dep>           (entries, "Plain_Dep");
+	Memory::add_objects <Dynamic_Dep>         (entries, "Dynamic_Dep");
+	Memory::add_objects <Concat_Dep>          (entries, "Concat_Dep");
+	Memory::add_objects <Compound_Dep>        (entries, "Compound_Dep");
+	Memory::add_objects <Root_Dep>            (entries, "Root_Dep");
+	Memory::add_objects <Target>              (entries, "Target");
+	Memory::add_objects <Rule>                (entries, "Rule");
+	Memory::add_objects <Operator>            (entries, "Operator");
+	Memory::add_objects <Flag_Token>          (entries, "Flag_Token");
+	Memory::add_objects <Name_Token>          (entries, "Name_Token");
+	Memory::add_objects <Command>             (entries, "Command");
+	Memory::add_map(entries, "executions_by_target", Execution::executions_by_target); 
+	Memory::add_map(entries, "transients", File_Execution::transients); 
+	Memory::add_map(entries, "executions_released", File_Execution::executions_released); 
+	Execution::rule_set.add_memory(entries); 
+}
+
+void job_print_memory()
+{
+	vector <Memory::Entry> entries;
+	memory_collect(entries); 
+	Memory::print(entries); 
+}
+
+void memory_print_json(FILE *file)
+{
+	vector <Memory::Entry> entries;
+	memory_collect(entries); 
+	Memory::print_json(file, entries); 
+}
+
 bool File_Execution::remove_if_existing(bool output) 
 {
 	/* [ASYNC-SIGNAL-SAFE] We use only async signal-safe functions
@@ -2370,6 +3234,10 @@ bool File_Execution::remove_if_existing(bool output)
 			
 		removed= true;
 
+		/* Prefetch is not async signal-safe */ 
+		if (output && Prefetch::is_used())
+			Prefetch::forget(filename); 
+
 		if (0 > unlink(filename)) {
 			if (output) {
 				rule->place << system_format(name_format_word(filename)); 
@@ -2406,7 +3274,7 @@ void File_Execution::warn_future_file(struct stat *buf,
 	}
 }
 
-void File_Execution::print_command() const
+void File_Execution::print_command(const map <string, string> *parameters) const
 {
 	static const size_t SIZE_MAX_PRINT_CONTENT= 20;
 	
@@ -2480,7 +3348,9 @@ void File_Execution::print_command() const
 	}
 
 	/* Print the parameter values (variable assignments are not printed) */ 
-	for (auto i= mapping_parameter.begin(); i != mapping_parameter.end();  ++i) {
+	if (parameters == nullptr)
+		parameters= &mapping_parameter; 
+	for (auto i= parameters->begin(); i != parameters->end();  ++i) {
 		string name= i->first;
 		string value= i->second;
 		if (! begin)
@@ -2507,6 +3377,37 @@ Proceed File_Execution::execute(shared_ptr <const Dep> dep_this)
 {
 	assert(! job.started() || children.empty()); 
 
+	/* Targets that are not affected by the changed files (-u) are
+	 * up to date when their files exist, and their dependencies are
+	 * not visited */ 
+	if (Reverse_Index::is_used() && ! (bits & B_INDEXED)) {
+		bits |= B_INDEXED; 
+		if (Reverse_Index::is_pruned(targets)) {
+			bits |= B_PRUNED; 
+			for (const Target &target:  targets) {
+				if (! target.is_file())
+					continue;
+				struct stat buf;
+				if (stu_stat(target.get_name_c_str_nondynamic(), &buf) < 0) {
+					bits &= ~B_PRUNED; 
+					timestamp= Timestamp::UNDEFINED; 
+					break;
+				}
+				Timestamp timestamp_file(&buf); 
+				if (! timestamp.defined() || timestamp < timestamp_file)
+					timestamp= timestamp_file; 
+			}
+		}
+		if (bits & B_PRUNED) 
+			Debug::print(this, "not affected by the changed files"); 
+		else
+			Reverse_Index::expanded(targets); 
+	}
+	if (bits & B_PRUNED) {
+		done |= done_from_flags(dep_this->flags); 
+		return P_FINISHED; 
+	}
+
 	Proceed proceed= execute_base_A(dep_this); 
 	assert(proceed); 
 	if (proceed & P_ABORT) {
@@ -2528,8 +3429,9 @@ Proceed File_Execution::execute(shared_ptr <const Dep> dep_this)
 		return proceed |= P_FINISHED; 
 	}
 
-	/* Job has already been started */ 
-	if (job.started_or_waited()) {
+	/* Job has already been started, or will be started in a
+	 * batch */ 
+	if (job.started_or_waited() || bits & B_BATCHED) {
 		return proceed |= P_WAIT;
 	}
 
@@ -2542,6 +3444,22 @@ Proceed File_Execution::execute(shared_ptr <const Dep> dep_this)
 	assert(children.empty()); 
 	assert(error == 0);
 
+	/* In the lookahead (-L), the files are only looked up once,
+	 * without deciding anything, because running jobs may still
+	 * create or change them.  This brings their metadata into the
+	 * cache of the operating system.  */
+	if (depth_lookahead > 0 && ! (bits & B_CHECKED)) {
+		if (! (bits & B_LOOKED_AHEAD)) {
+			bits |= B_LOOKED_AHEAD; 
+			for (const Target &target:  targets) {
+				struct stat buf;
+				if (target.is_file())
+					stu_stat(target.get_name_c_str_nondynamic(), &buf); 
+			}
+		}
+		return proceed |= P_WAIT; 
+	}
+
 	/*
 	 * Check whether execution has to be built
 	 */
@@ -2591,7 +3509,7 @@ Proceed File_Execution::execute(shared_ptr <const Dep> dep_this)
 
 			/* We save the return value of stat() and handle errors later */ 
 			struct stat buf;
-			int ret_stat= stat(target.get_name_c_str_nondynamic(), &buf);
+			int ret_stat= stu_stat(target.get_name_c_str_nondynamic(), &buf);
 
 			/* Warn when file has timestamp in the future */ 
 			if (ret_stat == 0) { 
@@ -2716,6 +3634,11 @@ Proceed File_Execution::execute(shared_ptr <const Dep> dep_this)
 
 	if (! (bits & B_NEED_BUILD)) {
 		/* The file does not have to be built */ 
+		if (done == 0 && rule != nullptr && rule->command) {
+			Profile::up_to_date(param_rule.get()); 
+			if (Progress::is_used())
+				Progress::up_to_date(targets.front().format_src()); 
+		}
 		done |= done_from_flags(dep_this->flags); 
 		return proceed |= P_FINISHED; 
 	}
@@ -2726,11 +3649,19 @@ Proceed File_Execution::execute(shared_ptr <const Dep> dep_this)
 	/* Re-deploy all dependencies (second pass to execute also all
 	 * transient targets) */
 	Proceed proceed_2= Execution::execute_base_B(dep_this); 
-	if (proceed_2 & P_WAIT) {
+	if (proceed_2 & (P_WAIT | P_PENDING)) {
 		return proceed_2; 
 	}
 	assert(children.empty()); 
 
+	/* A trivial dependency that was started speculatively (-A) and
+	 * that is now needed has failed */ 
+	if (error) {
+		assert(option_keep_going || is_speculative()); 
+		done |= done_from_flags(dep_this->flags); 
+		return proceed |= P_ABORT | P_FINISHED; 
+	}
+
 	if (no_execution) {
 		/* A target without a command:  Nothing to do anymore */ 
 		done |= done_from_flags(dep_this->flags); 
@@ -2744,6 +3675,20 @@ Proceed File_Execution::execute(shared_ptr <const Dep> dep_this)
 		exit(ERROR_BUILD);
 	}
 
+	if (option_plan) {
+		/* Record the job instead of running it, and continue as if
+		 * it had been run successfully */
+		size_t index= Plan::add(targets.front().format_src(), jobs_plan); 
+		jobs_plan.assign(1, index); 
+		for (const Target &target:  targets) {
+			if (target.is_transient()) 
+				transients[target.get_name_nondynamic()]= Timestamp::now(); 
+		}
+		bits |= B_PLANNED; 
+		done= ~0;
+		return proceed |= P_FINISHED; 
+	}
+
 	out_message_done= true;
 
 	assert(jobs >= 0); 
@@ -2766,7 +3711,47 @@ Proceed File_Execution::execute(shared_ptr <const Dep> dep_this)
 
 	/* We know that a job has to be started now */
 
-	if (jobs == 0) {
+	if (option_preempt && mapping_variable.count("STU_PRIORITY")) {
+		const string &text= mapping_variable.at("STU_PRIORITY"); 
+		char *endptr;
+		errno= 0;
+		priority= strtol(text.c_str(), &endptr, 10);
+		if (errno || text.empty() || *endptr != '\0') {
+			rule->place << fmt("variable %s must contain an integer, not %s",
+					   prefix_format_word("STU_PRIORITY", "$"), 
+					   name_format_word(text)); 
+			*this << fmt("in job for %s", targets.front().format_word());
+			raise(ERROR_BUILD);
+			done |= done_from_flags(dep_this->flags); 
+			assert(proceed == 0); 
+			return proceed |= P_ABORT | P_FINISHED; 
+		}
+	}
+
+	if (mapping_variable.count("STU_BATCH")) {
+		const string &text= mapping_variable.at("STU_BATCH"); 
+		char *endptr;
+		errno= 0;
+		long size= strtol(text.c_str(), &endptr, 10);
+		if (errno || text.empty() || *endptr != '\0' || size < 1) {
+			rule->place << fmt("variable %s must contain a positive integer, not %s",
+					   prefix_format_word("STU_BATCH", "$"), 
+					   name_format_word(text)); 
+			*this << fmt("in job for %s", targets.front().format_word());
+			raise(ERROR_BUILD);
+			done |= done_from_flags(dep_this->flags); 
+			assert(proceed == 0); 
+			return proceed |= P_ABORT | P_FINISHED; 
+		}
+		/* Only the parameters may differ between the jobs of a
+		 * batch */ 
+		if (size > 1 && ! mapping_parameter.empty() && ! rule->is_copy
+		    && rule->redirect_index < 0 && rule->filename.unparametrized().empty()
+		    && ! Claim::is_used() && ! Worker::is_used() && ! Cache::is_used())
+			return proceed |= add_to_batch(size); 
+	}
+
+	if (option_preempt ? ! preempt() : jobs == 0) {
 		return proceed |= P_WAIT;
 	}
        
@@ -2799,6 +3784,19 @@ Proceed File_Execution::execute(shared_ptr <const Dep> dep_this)
 	mapping_parameter.clear();
 	mapping_variable.clear(); 
 
+	if (Claim::is_used() || Worker::is_used() || Cache::is_used()) {
+		vector <string> filenames_target;
+		for (const Target &target:  targets)
+			if (target.is_file())
+				filenames_target.push_back(target.get_name_nondynamic()); 
+		if (Claim::is_used())
+			Claim::prepare(filenames_target); 
+		if (Worker::is_used() && ! rule->is_copy)
+			Worker::prepare(filenames_input, filenames_target); 
+		if (Cache::is_used() && ! rule->is_copy)
+			Cache::prepare(filenames_input, filenames_target); 
+	}
+
 	pid_t pid; 
 	size_t index; /* In EXECUTIONS_BY_PID_* */
 	{
@@ -2874,61 +3872,32 @@ Proceed File_Execution::execute(shared_ptr <const Dep> dep_this)
 
 		assert(!executions_by_pid_key == !executions_by_pid_value);
 
-		if (!executions_by_pid_key) {
-			/* This is executed just once, before we have
-			 * executed any job, and therefore JOBS is the
-			 * value passed via -j (or its default value 1),
-			 * and thus we can allocate arrays of that size
-			 * once and for all.  */
-			if (SIZE_MAX / sizeof(*executions_by_pid_key) < (size_t)jobs ||
-			    SIZE_MAX / sizeof(*executions_by_pid_value) < (size_t)jobs) {
-				errno= ENOMEM;
-				perror("malloc"); 
-				exit(ERROR_FATAL); 
-			}
-			executions_by_pid_key  = (pid_t *)          malloc(jobs * sizeof(*executions_by_pid_key));
-			executions_by_pid_value= (File_Execution **)malloc(jobs * sizeof(*executions_by_pid_value)); 
-			if (!executions_by_pid_key || !executions_by_pid_value) {
-				perror("malloc"); 
-				exit(ERROR_FATAL); 
-			}
-		}
-
-		size_t mi= 0, ma= executions_by_pid_size;
-		/* Both are exclusive */
-		assert(mi <= ma); 
-		while (mi < ma) {
-			size_t ne= mi + (ma - mi) / 2;
-			assert(ne < ma); 
-			assert(ne < executions_by_pid_size); 
-			assert(executions_by_pid_key[ne] != pid); 
-			if (executions_by_pid_key[ne] < pid) {
-				mi= ne + 1;
-			} else {
-				ma= ne;
-			}
-		}
-		assert(mi == ma); 
-		assert(mi <= executions_by_pid_size); 
-		assert(mi == 0 || executions_by_pid_key[mi - 1] < pid); 
-		assert(mi == executions_by_pid_size || executions_by_pid_key[mi] > pid); 
-		index= mi; 
-
-		memmove(executions_by_pid_key + index + 1,
-			executions_by_pid_key + index,
-			sizeof(*executions_by_pid_key) * (executions_by_pid_size - index));
-		memmove(executions_by_pid_value + index + 1,
-			executions_by_pid_value + index,
-			sizeof(*executions_by_pid_value) * (executions_by_pid_size - index)); 
-		++ executions_by_pid_size; 
-		executions_by_pid_key[index]= pid;
-		executions_by_pid_value[index]= this;
+		index= add_pid(pid); 
 	}
 
 	assert(executions_by_pid_value[index]->job.started()); 
 	assert(pid == executions_by_pid_value[index]->job.get_pid()); 
 	--jobs;
 	assert(jobs >= 0);
+	if (Timeline::is_open()) {
+		Timeline::job_started(pid, targets.front().format_src(), 
+				      jobs, Statistics::executions_live()); 
+	}
+	if (Progress::is_used())
+		Progress::job_started(pid, targets.front().format_src()); 
+	if (Job::listener)
+		Job::listener->job_started(pid, targets.front().format_src()); 
+	if (option_backup)
+		prepare_backup(mapping); 
+	if (Prefetch::is_used())
+		Prefetch::invalidate(); 
+	if (Daemon::is_child()) {
+		/* The cached state of the targets is outdated */ 
+		for (const Target &target:  targets)
+			if (target.is_file())
+				Daemon::forget(target.get_name_c_str_nondynamic()); 
+	}
+	STU_PROBE2(job_start, (int) pid, targets.front().get_name_c_str_any()); 
 
 	proceed |= P_WAIT; 
 	if (order == Order::RANDOM && jobs > 0)
@@ -2936,16 +3905,330 @@ Proceed File_Execution::execute(shared_ptr <const Dep> dep_this)
 	return proceed;
 }
 
-void File_Execution::print_as_job() const
+void File_Execution::print_as_job(pid_t pid) const
 {
-	pid_t pid= job.get_pid();
 	string text_target= targets.front().format_src(); 
 	printf("%9ld %s\n", (long) pid, text_target.c_str());
 }
 
+bool File_Execution::preempt()
+{
+	for (size_t i= 0;  count_stopped && i < executions_by_pid_size;  ++i) {
+		const File_Execution *execution= executions_by_pid_value[i]; 
+		if (execution && execution->stopped && execution->priority >= priority)
+			return false;
+	}
+	if (jobs > 0)
+		return true;
+
+	/* Stop the running job with the lowest priority */
+	File_Execution *execution_stop= nullptr;
+	for (size_t i= 0;  i < executions_by_pid_size;  ++i) {
+		File_Execution *execution= executions_by_pid_value[i]; 
+		if (execution && ! execution->stopped && execution->priority < priority
+		    && (! execution_stop || execution->priority < execution_stop->priority))
+			execution_stop= execution;
+	}
+	if (! execution_stop)
+		return false;
+
+	pid_t pid= execution_stop->job.get_pid(); 
+	Debug::print(execution_stop, frmt("stop pid = %ld", (long) pid)); 
+	Job::stop(pid); 
+	execution_stop->stopped= true;
+	++ count_stopped; 
+	++jobs; 
+	return true; 
+}
+
+void File_Execution::resume()
+{
+	while (jobs > 0 && count_stopped) {
+		File_Execution *execution_resume= nullptr;
+		for (size_t i= 0;  i < executions_by_pid_size;  ++i) {
+			File_Execution *execution= executions_by_pid_value[i]; 
+			if (execution && execution->stopped
+			    && (! execution_resume || execution->priority > execution_resume->priority))
+				execution_resume= execution;
+		}
+		assert(execution_resume); 
+		pid_t pid= execution_resume->job.get_pid(); 
+		Debug::print(execution_resume, frmt("continue pid = %ld", (long) pid)); 
+		Job::resume(pid); 
+		execution_resume->stopped= false;
+		-- count_stopped; 
+		--jobs; 
+	}
+}
+
+Proceed File_Execution::add_to_batch(size_t size)
+{
+	Debug::print(this, "add to batch"); 
+	bits |= B_BATCHED; 
+
+	File_Execution *execution_first= nullptr;
+	for (File_Execution *execution:  batches_pending) {
+		if (execution->param_rule == param_rule
+		    && execution->mapping_variable == mapping_variable) {
+			execution_first= execution;
+			break;
+		}
+	}
+	if (execution_first) 
+		execution_first->batch.push_back(this); 
+	else {
+		execution_first= this;
+		batches_pending.push_back(this); 
+	}
+
+	if (execution_first->batch.size() + 1 >= size
+	    && (option_preempt ? execution_first->preempt() : jobs > 0))
+		execution_first->start_batch(); 
+
+	Proceed proceed= P_WAIT; 
+	if (order == Order::RANDOM && jobs > 0)
+		proceed |= P_PENDING; 
+	return proceed;
+}
+
+void File_Execution::start_batches()
+{
+	while (! batches_pending.empty()) {
+		File_Execution *execution= batches_pending.front(); 
+		if (option_preempt ? ! execution->preempt() : jobs == 0)
+			break;
+		execution->start_batch(); 
+	}
+}
+
+void File_Execution::start_batch()
+{
+	auto i= find(batches_pending.begin(), batches_pending.end(), this); 
+	assert(i != batches_pending.end()); 
+	batches_pending.erase(i); 
+	assert(jobs >= 1); 
+
+	Debug::print(this, frmt("start batch of %zu", batch.size() + 1)); 
+
+	/* Each parameter contains the values of all executions of the
+	 * batch, separated by newlines.  Variables override parameters,
+	 * as for single jobs.  The command is printed with the values
+	 * separated by spaces.  */ 
+	map <string, string> mapping, parameters_print;
+	mapping.insert(mapping_variable.begin(), mapping_variable.end());
+	for (const auto &parameter:  mapping_parameter) {
+		string value= parameter.second, value_print= parameter.second;
+		for (const File_Execution *execution:  batch) {
+			const string &v= execution->mapping_parameter.at(parameter.first); 
+			value += '\n' + v;
+			value_print += ' ' + v;
+		}
+		mapping.insert(make_pair(parameter.first, value)); 
+		parameters_print[parameter.first]= value_print; 
+	}
+	print_command(&parameters_print); 
+	mapping_parameter.clear();
+	mapping_variable.clear(); 
+	for (File_Execution *execution:  batch) {
+		execution->mapping_parameter.clear();
+		execution->mapping_variable.clear(); 
+	}
+
+	Timestamp timestamp_now= Timestamp::now(); 
+	for (File_Execution *execution:  batch) 
+		for (const Target &target:  execution->targets) 
+			if (target.is_transient()) 
+				transients[target.get_name_nondynamic()]= timestamp_now; 
+	for (const Target &target:  targets) 
+		if (target.is_transient()) 
+			transients[target.get_name_nondynamic()]= timestamp_now; 
+
+	pid_t pid; 
+	{
+		Job::Signal_Blocker sb;
+		pid= job.start(rule->command->command, mapping, "", "", 
+			       rule->command->place); 
+		assert(pid != 0 && pid != 1); 
+		Debug::print(this, frmt("execute batch: pid = %ld", (long) pid)); 
+		if (pid >= 0)
+			add_pid(pid); 
+	}
+
+	if (pid < 0) {
+		/* Starting the job failed */ 
+		*this << fmt("error executing command for %s", 
+			     targets.front().format_word()); 
+		vector <File_Execution *> executions_batch; 
+		swap(executions_batch, batch); 
+		executions_batch.push_back(this); 
+		for (File_Execution *execution:  executions_batch) {
+			execution->done= ~0;
+			execution->bits &= ~B_BATCHED; 
+			execution->raise(ERROR_BUILD); 
+		}
+		return;
+	}
+
+	--jobs;
+	assert(jobs >= 0);
+	if (Timeline::is_open()) {
+		Timeline::job_started(pid, targets.front().format_src(), 
+				      jobs, Statistics::executions_live()); 
+	}
+	if (Progress::is_used())
+		Progress::job_started(pid, targets.front().format_src()); 
+	if (Job::listener)
+		Job::listener->job_started(pid, targets.front().format_src()); 
+	if (Prefetch::is_used())
+		Prefetch::invalidate(); 
+	if (Daemon::is_child()) {
+		/* The cached state of the targets is outdated */ 
+		for (const File_Execution *execution:  batch) 
+			for (const Target &target:  execution->targets)
+				if (target.is_file())
+					Daemon::forget(target.get_name_c_str_nondynamic()); 
+		for (const Target &target:  targets)
+			if (target.is_file())
+				Daemon::forget(target.get_name_c_str_nondynamic()); 
+	}
+	STU_PROBE2(job_start, (int) pid, targets.front().get_name_c_str_any()); 
+}
+
+void File_Execution::start_backups()
+{
+	double now= Progress::now(CLOCK_MONOTONIC); 
+	double next= -1;
+	vector <File_Execution *> executions_due;
+	for (size_t i= 0;  i < executions_by_pid_size;  ++i) {
+		File_Execution *execution= executions_by_pid_value[i]; 
+		/* Stopped jobs (-I) are not expected to progress */
+		if (! execution || execution->time_backup < 0 || execution->stopped)
+			continue;
+		if (execution->time_backup <= now)
+			executions_due.push_back(execution); 
+		else if (next < 0 || execution->time_backup < next)
+			next= execution->time_backup; 
+	}
+	for (File_Execution *execution:  executions_due)
+		execution->start_backup(); 
+	Job::alarm(next < 0 ? 0 : next - now); 
+}
+
+void File_Execution::prepare_backup(const map <string, string> &mapping)
+{
+	if (rule->is_copy || rule->redirect_index < 0 || targets.size() != 1)
+		return;
+	auto i= mapping.find("STU_IDEMPOTENT"); 
+	if (i == mapping.end() || i->second == "" || i->second == "0")
+		return;
+	double duration= Progress::duration(targets.front().format_src()); 
+	if (duration < 0)
+		return;
+	/* Jobs that take less than a second are not worth a backup
+	 * job */ 
+	time_backup= Progress::now(CLOCK_MONOTONIC) 
+		+ max(option_backup * duration, 1.0); 
+	mapping_backup= mapping; 
+}
+
+void File_Execution::start_backup()
+{
+	assert(! job_backup.started_or_waited()); 
+	assert(! filename_backup); 
+	time_backup= -1;
+
+	string filename= frmt("%s.stu-backup-%ld", 
+			      targets.front().get_name_c_str_nondynamic(), 
+			      (long) getpid()); 
+	Debug::print(this, frmt("start backup job into %s", filename.c_str())); 
+	if (! option_silent) {
+		string text= targets.front().format_src(); 
+		printf("Starting backup job for %s\n", text.c_str()); 
+	}
+
+	Job::Signal_Blocker sb;
+	pid_t pid= job_backup.start
+		(rule->command->command, 
+		 mapping_backup,
+		 filename,
+		 rule->filename.unparametrized(),
+		 rule->command->place); 
+	mapping_backup.clear(); 
+	/* On error, a message was output, and the job continues */ 
+	if (pid < 0)
+		return;
+	filename_backup= strdup(filename.c_str()); 
+	if (! filename_backup) {
+		perror("strdup"); 
+		exit(ERROR_FATAL); 
+	}
+	add_pid(pid); 
+}
+
+bool File_Execution::waited_backup(pid_t pid, size_t index, int &status)
+{
+	const pid_t pid_job= job.get_pid(), pid_backup= job_backup.get_pid(); 
+	assert(pid == pid_job || pid == pid_backup); 
+	assert(executions_by_pid_key[index] == pid); 
+
+	if (pid == pid_backup && ! (WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
+		Debug::print(this, "backup job failed"); 
+		job_backup.waited(status, pid_backup); 
+		{
+			Job::Signal_Blocker sb;
+			remove_pid(index); 
+		}
+		discard_backup(); 
+		return false;
+	}
+
+	/* The other job is killed, and reaped later by wait() */ 
+	const pid_t pid_other= pid == pid_job ? pid_backup : pid_job; 
+	Job::abandon(pid_other); 
+	{
+		Job::Signal_Blocker sb;
+		size_t index_other= find_pid(pid_other); 
+		assert(index_other != SIZE_MAX); 
+		executions_by_pid_value[index_other]= nullptr; 
+	}
+
+	if (pid == pid_job) {
+		Debug::print(this, "kill backup job"); 
+		job_backup.abandoned(pid_backup); 
+		discard_backup(); 
+		return true;
+	}
+
+	Debug::print(this, "backup job succeeded"); 
+	job_backup.waited(status, pid_backup); 
+	const char *filename= targets.front().get_name_c_str_nondynamic(); 
+	if (Prefetch::is_used())
+		Prefetch::forget(filename); 
+	if (0 > rename(filename_backup, filename)) {
+		rule->place_param_targets[0]->place <<
+			system_format(name_format_word(filename)); 
+		/* Report the job as failed */ 
+		status= ERROR_BUILD << 8; 
+	}
+	discard_backup(); 
+	return true;
+}
+
+void File_Execution::discard_backup()
+{
+	Job::Signal_Blocker sb;
+	if (0 > unlink(filename_backup) && errno != ENOENT)
+		print_error_system(filename_backup); 
+	free(filename_backup); 
+	filename_backup= nullptr;
+}
+
 void File_Execution::write_content(const char *filename, 
 				   const Command &command)
 {
+	if (Prefetch::is_used())
+		Prefetch::forget(filename); 
+
 	FILE *file= fopen(filename, "w"); 
 
 	if (file == nullptr) {
@@ -2999,7 +4282,7 @@ void File_Execution::read_variable(shared_ptr <const Dep> dep)
 	 * no reason to check.  In such cases, we don't need the
 	 * variable.  */
 	if (!(bits & B_EXISTING)) {
-		assert(dep->flags & F_TRIVIAL); 
+		assert(dep->flags & F_TRIVIAL || bits & B_PLANNED); 
 		return;
 	}
 
@@ -3101,7 +4384,7 @@ bool File_Execution::optional_finished(shared_ptr <const Dep> dep_link)
 			->place_param_target.place_name.unparametrized().c_str();
 
 		struct stat buf;
-		int ret_stat= stat(name, &buf);
+		int ret_stat= stu_stat(name, &buf);
 		if (ret_stat < 0) {
 			bits |= B_MISSING;
 			bits &= ~B_EXISTING; 
@@ -3138,24 +4421,63 @@ bool Root_Execution::finished(Flags flags) const
 }
 
 Root_Execution::Root_Execution(const vector <shared_ptr <const Dep> > &deps)
-	:  is_finished(false)
+	:  is_finished(false),
+	   index_stream(0),
+	   is_built_stream(false),
+	   file_stream(nullptr),
+	   lineptr(nullptr),
+	   size_lineptr(0)
 {
+	++ Statistics::count_executions[Statistics::E_ROOT]; 
 	for (auto &d:  deps) {
+		/* With -N, the files given by -n and -0 are built as
+		 * plain dependencies, and then read incrementally */ 
+		if (option_admission > 0 && to <Dynamic_Dep> (d)) {
+			shared_ptr <const Dynamic_Dep> dynamic_dep= to <Dynamic_Dep> (d);
+			if (dynamic_dep->dep->flags & F_ATTRIBUTE) {
+				deps_stream.push_back(dynamic_dep);
+				shared_ptr <Dep> dep_file= make_shared <Plain_Dep> 
+					(0, to <Plain_Dep> (dynamic_dep->dep)->place_param_target); 
+				dep_file->top= dynamic_dep; 
+				push(dep_file); 
+				continue;
+			}
+		}
 		push(d); 
 	}
 }
 
+Root_Execution::~Root_Execution()
+{
+	close_stream(); 
+	free(lineptr); 
+}
+
 Proceed Root_Execution::execute(shared_ptr <const Dep> dep_this)
 {
 	/* This is an example of a "plain" execute() function,
 	 * containing the minimal wrapper around execute_base_?()  */ 
 	
-	Proceed proceed= execute_base_A(dep_this); 
-	assert(proceed); 
-	if (proceed & (P_WAIT | P_PENDING)) {
-		assert((proceed & P_FINISHED) == 0); 
-		return proceed;
-	}
+	Proceed proceed; 
+	do {
+		if (is_built_stream)
+			admit(); 
+		proceed= execute_base_A(dep_this); 
+		assert(proceed); 
+		if (proceed & (P_WAIT | P_PENDING)) {
+			assert((proceed & P_FINISHED) == 0); 
+			return proceed;
+		}
+		if (! is_built_stream) {
+			/* The files to read are built.  With -k, don't
+			 * read them when building them failed.  */
+			is_built_stream= true; 
+			if (error)
+				index_stream= deps_stream.size(); 
+		}
+		/* All admitted dependencies are finished, but entries
+		 * remain to be read */ 
+	} while (proceed & P_FINISHED && index_stream < deps_stream.size()); 
 	if (proceed & P_FINISHED) {
 		is_finished= true; 
 		return proceed; 
@@ -3173,12 +4495,64 @@ Proceed Root_Execution::execute(shared_ptr <const Dep> dep_this)
 	return proceed; 
 }
 
+void Root_Execution::admit()
+{
+	while (index_stream < deps_stream.size()
+	       && children.size() + get_buffer_A().size() < (size_t) option_admission) {
+		shared_ptr <const Dynamic_Dep> dep= deps_stream[index_stream]; 
+		shared_ptr <const Plain_Dep> plain_dep= to <Plain_Dep> (dep->dep); 
+		string filename= plain_dep->place_param_target.unparametrized()
+			.get_name_nondynamic(); 
+		bool is_nul= plain_dep->flags & F_NUL_SEPARATED; 
+		shared_ptr <const Plain_Dep> dep_child; 
+		try {
+			if (file_stream == nullptr) {
+				file_stream= fopen(filename.c_str(), "r"); 
+				if (file_stream == nullptr) {
+					print_error_system(filename); 
+					throw ERROR_BUILD; 
+				}
+				place_stream= Place(Place::Type::INPUT_FILE, filename, 0, 0); 
+			}
+			dep_child= Parser::get_dep_delim
+				(file_stream, filename.c_str(), 
+				 is_nul ? '\0' : '\n', is_nul ? '0' : 'n',
+				 place_stream, lineptr, size_lineptr,
+				 Place_Printer(plain_dep->get_place())); 
+		} catch (int e) {
+			close_stream(); 
+			++index_stream; 
+			raise(e); 
+			continue; 
+		}
+		if (dep_child == nullptr) {
+			close_stream(); 
+			++index_stream; 
+			continue; 
+		}
+		shared_ptr <Dep> dep_child_top= Dep::clone(dep_child); 
+		dep_child_top->top= dep; 
+		push(dep_child_top); 
+	}
+}
+
+void Root_Execution::close_stream()
+{
+	if (file_stream == nullptr)
+		return;
+	if (fclose(file_stream)) {
+		print_error_system(place_stream.get_filename_str()); 
+	}
+	file_stream= nullptr; 
+}
+
 Concat_Execution::Concat_Execution(shared_ptr <const Concat_Dep> dep_,
 				   Execution *parent,
 				   int &error_additional)
 	:  dep(dep_),
 	   stage(0)
 {
+	++ Statistics::count_executions[Statistics::E_CONCAT]; 
 	assert(dep_); 
 	assert(dep_->is_normalized()); 
 	assert(dep->is_normalized()); 
@@ -3344,6 +4718,7 @@ Dynamic_Execution::Dynamic_Execution(shared_ptr <const Dynamic_Dep> dep_,
 	:  dep(dep_),
 	   is_finished(false)
 {
+	++ Statistics::count_executions[Statistics::E_DYNAMIC]; 
 	assert(dep_); 
 	assert(dep_->is_normalized()); 
 	assert(parent); 
@@ -3514,6 +4889,7 @@ Transient_Execution::Transient_Execution(shared_ptr <const Dep> dep_link,
 	   rule(rule_),
 	   is_finished(false)
 {
+	++ Statistics::count_executions[Statistics::E_TRANSIENT]; 
 	swap(mapping_parameter, mapping_parameter_); 
 
 	assert(to <Plain_Dep> (dep_link)); 
@@ -3554,6 +4930,9 @@ Transient_Execution::Transient_Execution(shared_ptr <const Dep> dep_link,
 
 	assert((param_rule == nullptr) == (rule == nullptr)); 
 
+	if (Reverse_Index::is_used())
+		Reverse_Index::expanded(targets); 
+
 	/* Fill EXECUTIONS_BY_TARGET with all targets from the rule, not
 	 * just the one given in the dependency.  Also, add the flags.  */
 	for (Target t:  targets) {
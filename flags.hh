@@ -48,6 +48,7 @@ enum
 	I_INPUT,		/* <                                            */
 	I_RESULT_NOTIFY,        /* -*                                           */
 	I_RESULT_COPY,          /* -%                                           */
+	I_SPECULATIVE,          /* -~                                           */
 
 	C_ALL,                 
 	C_PLACED           	= 3,  /* Flags for which we store a place in Dep */
@@ -98,6 +99,12 @@ enum
 	/* The link A ---> B between two executions annotated with this
 	 * flags means that the results B will be copied into A's result  */
 
+	F_SPECULATIVE		= 1 << I_SPECULATIVE,
+	/* The link A ---> B between two executions annotated with this
+	 * flag means that B is a trivial dependency of A that was started
+	 * before it was known whether A must be rebuilt (-A option).
+	 * Only errors are propagated from B to A.  */
+
 	/*
 	 * Aggregates
 	 */
@@ -128,7 +135,7 @@ enum
 	D_ALL_OPTIONAL		  	= D_NONPERSISTENT_TRANSIENT | D_NONPERSISTENT_NONTRANSIENT,
 };
 
-const char *const FLAGS_CHARS= "pot[@$n0<*%"; 
+const char *const FLAGS_CHARS= "pot[@$n0<*%~"; 
 /* Characters representing the individual flags -- used in debug mode
  * output, and in other cases  */ 
 
@@ -234,4 +234,27 @@ string prefix_format_word(string name, string prefix)
 		   Color::end); 
 }
 
+string name_format_json(string name)
+/* A JSON string literal, including the double quotes.  Bytes that are
+ * not printable ASCII are output as \u00XX escapes, such that the
+ * output is valid JSON for arbitrary filenames, at the price of not
+ * preserving UTF-8 sequences.  */
+{
+	string ret= "\"";
+	for (char c:  name) {
+		if (c == '"' || c == '\\') {
+			ret += '\\';
+			ret += c;
+		} else if (c >= 0x20 && c < 0x7F) {
+			ret += c;
+		} else {
+			char buf[7];
+			sprintf(buf, "\\u%04x", (unsigned)(unsigned char) c);
+			ret += buf;
+		}
+	}
+	ret += '"';
+	return ret; 
+}
+
 #endif /* ! FORMAT_HH */
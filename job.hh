@@ -8,8 +8,17 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <sys/resource.h>
+#include <sys/time.h>
 #include <sys/wait.h>
 
+#include "affinity.hh"
+#include "cache.hh"
+#include "cgroup.hh"
+#include "claim.hh"
+#include "statistics.hh"
+#include "worker.hh"
+#include "profile.hh"
+
 void job_terminate_all(); 
 /* Called to terminate all running processes, and remove their target
  * files if present.  Implemented in execution.hh, and called from
@@ -17,6 +26,9 @@ void job_terminate_all();
 
 void job_print_jobs(); 
 
+void job_print_memory(); 
+/* Print the memory statistics; implemented in execution.hh */
+
 /* 
  * Macro to write in an async signal-safe manner. 
  *   - FD must be '1' or '2'.
@@ -47,6 +59,16 @@ void job_print_jobs();
 #	define assert_async(X)  ((void)( (X) || (write(2, "assert_async failed\n", 20), abort(), 0)))
 #endif /* ! NDEBUG */
 
+class Job_Listener
+/* Receives the events of jobs; set in Job::listener by programs that
+ * use Stu as a library (see libstu.hh) */
+{
+public:
+	virtual void job_started(pid_t pid, const string &target)= 0;
+	virtual void job_waited(pid_t pid, const string &target, bool success)= 0;
+	virtual ~Job_Listener() {  }
+};
+
 class Job
 /*
  * A job is a child process of Stu that executes the command for a given
@@ -55,13 +77,17 @@ class Job
 {
 public:
 
-	Job():  pid(-2) { }
+	Job():  pid(-2), slot(-1), time_wall(0), time_cpu(0) { }
 
 	bool waited(int status, pid_t pid_check);
 	/* Called after having returned this process from wait_do().
 	 * Return TRUE if the child was successful.  The PID is passed
 	 * to verify that it is the correct one.  */
 
+	void abandoned(pid_t pid_check);
+	/* Like waited(), for a job that was killed with abandon() and
+	 * has not been waited for.  The job counts as failed.  */
+
 	bool started() const {
 		return pid >= 0;
 	}
@@ -89,24 +115,53 @@ public:
 	 * PID (>= 0).  MAPPING contains the environment variables to
 	 * set.  */
 
+	double get_time_wall() const {  return time_wall;  }
+	double get_time_cpu() const {  return time_cpu;  }
+	/* The wall time and CPU time of the job in seconds.  Set by
+	 * waited() when statistics are enabled, and zero otherwise.  The
+	 * CPU time includes that of all descendant processes that were
+	 * waited for.  */
+
 	pid_t start_copy(string target, string source);
 	/* Start a copy job.  The return value has the same semantics as
 	 * in start().  */  
 
 	static pid_t wait(int *status);
 	/* Wait for the next process to terminate; provide the STATUS as
-	 * used in wait(2).  Return the PID of the waited-for process (>=0). */  
+	 * used in wait(2).  Return the PID of the waited-for process
+	 * (>=0), or -1 when the timer set by alarm() has expired.  */  
+
+	static void alarm(double seconds);
+	/* Make wait() return after the given time, or never with zero */
+
+	static void abandon(pid_t pid);
+	/* Kill this job with SIGKILL, without waiting for it.  Used when
+	 * the job is not needed anymore, as it or its backup job (-e)
+	 * has terminated first.  The process is reaped later by wait(),
+	 * and its result is ignored.  */
 
 	static void print_statistics(bool allow_unterminated_jobs= false); 
 	/* Print the statistics about jobs, regardless of OPTION_STATISTICS.  If
 	 * the argument is set, there must not be unterminated jobs.  */ 
 
+	static void print_statistics_json(FILE *file);
+	/* Print the statistics about jobs as members of a JSON object,
+	 * followed by a comma */
+
 	static void kill(pid_t pid); 
 	/* Kill this job */
 
+	static void stop(pid_t pid);
+	static void resume(pid_t pid);
+	/* Stop and continue this job, to free its slot for another job
+	 * (-I) */
+
 	static void init_tty(); 
 
 	static pid_t get_tty()  {  return tty;  }
+
+	static Job_Listener *listener;
+	/* Null when not used */
 	
 	class Signal_Blocker
 	/* Block termination signals for the lifetime of an object of this
@@ -134,6 +189,25 @@ private:
 	 * -1:    process has been waited for. 
 	 */
 
+	int slot;
+	/* The job slot to whose CPUs the job is bound (-B), or -1 */
+
+	struct timespec time_start;
+	/* When the job was started; only set when statistics are enabled */
+
+	double time_wall, time_cpu; 
+
+	static struct rusage usage_waited;
+	static pid_t pid_usage_waited; 
+	/* The resource usage of the process last returned by wait(),
+	 * as returned by wait4(), and its PID */
+
+	void measure_start();
+	void measure_end(); 
+
+	void finish(bool success);
+	/* Common part of waited() and abandoned() */ 
+
 	static void handler_termination(int sig);
 	static void handler_productive(int sig, siginfo_t *, void *);
 	
@@ -174,12 +248,15 @@ private:
 size_t Job::count_jobs_exec=    0;
 size_t Job::count_jobs_success= 0;
 size_t Job::count_jobs_fail=    0;
+struct rusage Job::usage_waited;
+pid_t Job::pid_usage_waited= -1;
 sigset_t Job::set_termination;
 sigset_t Job::set_productive;
 sigset_t Job::set_termination_productive;
 sig_atomic_t Job::in_child= 0; 
 pid_t Job::foreground_pid= -1;
 int Job::tty= -1;
+Job_Listener *Job::listener= nullptr;
 bool Job::signals_initialized; 
 
 #ifndef NDEBUG
@@ -219,11 +296,102 @@ pid_t Job::start(string command,
 	/* c_str() never returns nullptr, as by the standard */ 
 	assert(arg != nullptr);
 
+	/* The environment and the arguments of the shell are prepared
+	 * before fork(), such that the child process does as little as
+	 * possible before exec() */ 
+
+	/* Set variables */ 
+	size_t v_old= 0;
+
+	map <string, size_t> old;
+	/* Index of old variables */ 
+
+	while (envp_global[v_old]) {
+		const char *p= envp_global[v_old];
+		const char *q= p;
+		while (*q && *q != '=')  ++q;
+		string key_old(p, q-p);
+		old[key_old]= v_old;
+		++v_old;
+	}
+
+	vector <string> combined;
+	combined.reserve(mapping.size()); 
+	for (auto j= mapping.begin();  j != mapping.end();  ++j) {
+		assert(j->first.find('=') == string::npos); 
+		combined.push_back(j->first + '=' + j->second); 
+	}
+	vector <const char *> envp(envp_global, envp_global + v_old); 
+	size_t k= 0;
+	for (auto j= mapping.begin();  j != mapping.end();  ++j, ++k) {
+		if (old.count(j->first)) 
+			envp[old.at(j->first)]= combined[k].c_str();
+		else
+			envp.push_back(combined[k].c_str()); 
+	}
+	envp.push_back("STU_STATUS=1"); 
+	envp.push_back(nullptr); 
+
+	/* As $0 of the process, we pass the filename of the command
+	 * followed by a colon, the line number, a colon and the column
+	 * number.  This makes the shell if it reports an error make the
+	 * most useful output.  */
+	string argv0= place_command.as_argv0();
+	if (argv0 == "")
+		argv0= shell; 
+
+	/* The one-character options to the shell */
+	/* We use the -e option ('error'), which makes the shell abort
+	 * on a command that fails.  This is also what POSIX prescribes
+	 * for Make.  It is particularly important for Stu, as Stu
+	 * invokes the whole (possibly multiline) command in one step. */
+	const char *shell_options= option_individual ? "-ex" : "-e"; 
+
+	/* 
+	 * Special handling of the case when the command starts with '-'
+	 * or '+'.  In that case, we prepend a space to the command.  We
+	 * cannot use '--' as prescribed by POSIX because Linux and
+	 * FreeBSD handle '--' differently: 
+	 *
+	 *      /bin/sh -c -- '+x' 
+	 *      on Linux: Execute the command '+x'
+	 *      on FreeBSD: Execute the command '--' and set
+	 *                  the +x option
+	 *
+	 *      /bin/sh -c +x
+	 *      on Linux: Set the +x option, and missing
+	 *                argument to -c
+	 *      on FreeBSD: Execute the command '+x'
+	 *
+	 * See:
+	 * http://stackoverflow.com/questions/37886661/handling-of-in-arguments-of-bin-sh-posix-vs-implementations-by-bash-dash 
+	 *
+	 * It seems that FreeBSD violates POSIX in this regard. 
+	 */
+	if (arg[0] == '-' || arg[0] == '+') {
+		command= ' ' + command;
+		arg= command.c_str();
+	}
+
+	const char *argv[]= {argv0.c_str(), 
+			     shell_options, "-c", arg, nullptr}; 
+
+	if (Affinity::is_used())
+		slot= Affinity::acquire(); 
+
+	if (Prefetch::is_used())
+		Prefetch::pause(); 
 	pid= fork();
+	if (pid != 0 && Prefetch::is_used())
+		Prefetch::resume(); 
 
 	if (pid < 0) {
 		print_error_system("fork"); 
 		assert(pid == -1); 
+		if (slot >= 0) {
+			Affinity::release(slot);
+			slot= -1;
+		}
 		return -1; 
 	}
 
@@ -259,107 +427,27 @@ pid_t Job::start(string command,
 		}
 		::signal(SIGTTIN, SIG_DFL);
 		::signal(SIGTTOU, SIG_DFL); 
-		
-		/* Set variables */ 
-		size_t v_old= 0;
-
-		map <string, size_t> old;
-		/* Index of old variables */ 
-
-		while (envp_global[v_old]) {
-			const char *p= envp_global[v_old];
-			const char *q= p;
-			while (*q && *q != '=')  ++q;
-			string key_old(p, q-p);
-			old[key_old]= v_old;
-			++v_old;
-		}
 
-		const size_t v_new= mapping.size() + 1; 
-		/* Maximal size of added variables.  The "+1" is for $STU_STATUS */ 
+		/* Placement into a cgroup (-G) and binding to CPUs (-B) */ 
+		if (Cgroup::is_used())
+			Cgroup::enter(mapping); 
+		if (slot >= 0)
+			Affinity::apply(slot); 
 
-		const char** envp= (const char **)
-			malloc(sizeof(char **) * (v_old + v_new + 1));
-		if (!envp) {
-			assert(false);
-			perror("malloc");
-			_Exit(127); 
-		}
-		memcpy(envp, envp_global, v_old * sizeof(char **)); 
-		size_t i= v_old;
-		for (auto j= mapping.begin();  j != mapping.end();  ++j) {
-			string key= j->first;
-			string value= j->second;
-			assert(key.find('=') == string::npos); 
-			size_t len_combined= key.size() + 1 + value.size() + 1;
-			char *combined= (char *)malloc(len_combined);
-			if (! combined) {
-				assert(false);
-				perror("malloc");
-				_Exit(127); 
-			}
-			if ((ssize_t)(len_combined - 1) != snprintf(combined, len_combined, "%s=%s", key.c_str(), value.c_str())) {
-				perror("snprintf");
-				_Exit(127); 
-			}
-			if (old.count(key)) {
-				size_t v_index= old.at(key);
-				envp[v_index]= combined;
-			} else {
-				assert(i < v_old + v_new); 
-				envp[i++]= combined;
-			}
-		}
-		envp[i++]= "STU_STATUS=1";
-		assert(i <= v_old + v_new);
-		envp[i]= nullptr;
-
-		/* As $0 of the process, we pass the filename of the
-		 * command followed by a colon, the line number, a colon
-		 * and the column number.  This makes the shell if it
-		 * reports an error make the most useful output.  */
-		string argv0= place_command.as_argv0();
-		if (argv0 == "")
-			argv0= shell; 
-
-		/* The one-character options to the shell */
-		/* We use the -e option ('error'), which makes the shell abort
-		 * on a command that fails.  This is also what POSIX prescribes
-		 * for Make.  It is particularly important for Stu, as Stu
-		 * invokes the whole (possibly multiline) command in one step. */
-		const char *shell_options= option_individual ? "-ex" : "-e"; 
-
-		const char *argv[]= {argv0.c_str(), 
-				     shell_options, "-c", arg, nullptr}; 
-
-		/* 
-		 * Special handling of the case when the command
-		 * starts with '-' or '+'.  In that case, we prepend
-		 * a space to the command.  We cannot use '--' as
-		 * prescribed by POSIX because Linux and FreeBSD handle
-		 * '--' differently: 
-		 *
-		 *      /bin/sh -c -- '+x' 
-		 *      on Linux: Execute the command '+x'
-		 *      on FreeBSD: Execute the command '--' and set
-		 *                  the +x option
-		 *
-		 *      /bin/sh -c +x
-		 *      on Linux: Set the +x option, and missing
-		 *                argument to -c
-		 *      on FreeBSD: Execute the command '+x'
-		 *
-		 * See:
-		 * http://stackoverflow.com/questions/37886661/handling-of-in-arguments-of-bin-sh-posix-vs-implementations-by-bash-dash 
-		 *
-		 * It seems that FreeBSD violates POSIX in this regard. 
-		 */
-
-		if (arg[0] == '-' || arg[0] == '+') {
-			command= ' ' + command;
-			arg= command.c_str();
-			argv[3]= arg;
-		}
+		/* Claim the targets (-l); this must be done before the
+		 * output redirection truncates the target */ 
+		if (Claim::is_used() && Claim::acquire())
+			_Exit(0); 
+		
+		/* Use the output cache (-O); returns only when the
+		 * command is to be executed */
+		if (Cache::is_used())
+			Cache::run(arg, mapping, filename_output, filename_input); 
+
+		/* Execute the command on a worker (-W) */ 
+		if (Worker::is_used())
+			Worker::run(argv0.c_str(), shell_options, arg, mapping,
+				    filename_output, filename_input); 
 
 		/* Output redirection */
 		if (filename_output != "") {
@@ -405,7 +493,7 @@ pid_t Job::start(string command,
 			}
 		}
 
-		int r= execve(shell, (char *const *) argv, (char *const *) envp); 
+		int r= execve(shell, (char *const *) argv, (char *const *) envp.data()); 
 
 		/* If execve() returns, there is an error, and its return value is -1 */
 		assert(r == -1); 
@@ -425,6 +513,7 @@ pid_t Job::start(string command,
 	}
 		
 	++ count_jobs_exec;
+	measure_start(); 
 
 	return pid; 
 }
@@ -440,7 +529,27 @@ pid_t Job::start_copy(string target,
 
 	init_signals(); 
 
+	static const char *cp_command= nullptr;
+	if (cp_command == nullptr) {
+		cp_command= getenv("STU_CP");
+		if (cp_command == nullptr || cp_command[0] == '\0') 
+			cp_command= "/bin/cp"; 
+	}
+
+	/* Using '--' as an argument guarantees that the two filenames
+	 * will be interpreted as filenames and not as options, in
+	 * particular when they begin with a dash.  */
+	const char *argv[]= {cp_command,
+			     "--",
+			     source.c_str(),
+			     target.c_str(),
+			     nullptr};
+
+	if (Prefetch::is_used())
+		Prefetch::pause(); 
 	pid= fork();
+	if (pid != 0 && Prefetch::is_used())
+		Prefetch::resume(); 
 
 	if (pid < 0) {
 		print_error_system("fork"); 
@@ -458,23 +567,10 @@ pid_t Job::start_copy(string target,
 	if (pid == 0) {
 		/* We are the child process */ 
 
-		/* We don't set $STU_STATUS for copy jobs */ 
-
-		static const char *cp_command= nullptr;
-		if (cp_command == nullptr) {
-			cp_command= getenv("STU_CP");
-			if (cp_command == nullptr || cp_command[0] == '\0') 
-				cp_command= "/bin/cp"; 
-		}
+		if (Claim::is_used() && Claim::acquire())
+			_Exit(0); 
 
-		/* Using '--' as an argument guarantees that the two
-		 * filenames will be interpreted as filenames and not as
-		 * options, in particular when they begin with a dash.  */
-		const char *argv[]= {cp_command,
-				     "--",
-				     source.c_str(),
-				     target.c_str(),
-				     nullptr};
+		/* We don't set $STU_STATUS for copy jobs */ 
 
 		int r= execv(cp_command, (char *const *) argv); 
 
@@ -485,6 +581,7 @@ pid_t Job::start_copy(string target,
 
 	/* Parent execution */
 	++ count_jobs_exec;
+	measure_start(); 
 
 	assert(pid >= 1); 
 	return pid; 
@@ -500,19 +597,21 @@ pid_t Job::wait(int *status)
 	/* First, try wait() without blocking.  WUNTRACED is used to
 	 * also get notified when a job is suspended (e.g. with
 	 * Ctrl-Z).  */ 
-	pid_t pid= waitpid(-1, status, 
-			   WNOHANG | (option_interactive ? WUNTRACED : 0));
+	pid_t pid= wait4(-1, status, 
+			 WNOHANG | (option_interactive ? WUNTRACED : 0),
+			 &usage_waited);
 	if (pid < 0) {
 		/* Should not happen as there is always something
 		 * running when this function is called.  However, this
 		 * may be common enough that we may want Stu to act
 		 * correctly.  */ 
 		assert(false); 
-		perror("waitpid"); 
+		perror("wait4"); 
 		abort(); 
 	}
 
 	if (pid > 0) {
+		pid_usage_waited= pid; 
 		if (WIFSTOPPED(*status)) {
 
 			/* The process was suspended. This can have
@@ -551,7 +650,7 @@ pid_t Job::wait(int *status)
 
 	/* Any SIGCHLD sent after the last call to sigwait() will be
 	 * ready for receiving, even those SIGCHLD signals received
-	 * between the last call to waitpid() and the following call to
+	 * between the last call to wait4() and the following call to
 	 * sigwait().  This excludes a deadlock which would be
 	 * possible if we would only use sigwait(). */
 
@@ -602,16 +701,20 @@ pid_t Job::wait(int *status)
 	case SIGCHLD:
 		/* Don't act on the signal here.  We could get the PID
 		 * and STATUS from siginfo, but then the process would
-		 * stay a zombie.  Therefore, we have to call waitpid().
-		 * The call to waitpid() will then return the proper
+		 * stay a zombie.  Therefore, we have to call wait4().
+		 * The call to wait4() will then return the proper
 		 * signal.  */
 		goto begin; 
 
 	case SIGUSR1:
 		print_statistics(true); 
 		job_print_jobs(); 
+		job_print_memory(); 
 		goto retry; 
 
+	case SIGALRM:
+		return -1; 
+
 	default:
 		/* We didn't wait for this signal */ 
 		assert(false);
@@ -620,6 +723,29 @@ pid_t Job::wait(int *status)
 	}
 }
 
+void Job::alarm(double seconds)
+{
+	struct itimerval value;
+	value.it_interval.tv_sec= 0;
+	value.it_interval.tv_usec= 0;
+	value.it_value.tv_sec= (time_t) seconds;
+	value.it_value.tv_usec= (suseconds_t) ((seconds - (time_t) seconds) * 1e6);
+	/* A zero value would disarm the timer */
+	if (seconds > 0 && value.it_value.tv_sec == 0 && value.it_value.tv_usec == 0)
+		value.it_value.tv_usec= 1;
+	if (0 > setitimer(ITIMER_REAL, &value, nullptr)) {
+		perror("setitimer");
+		exit(ERROR_FATAL); 
+	}
+}
+
+void Job::abandon(pid_t pid)
+{
+	assert(pid > 1); 
+	if (0 > ::kill(-pid, SIGKILL) && errno != ESRCH)
+		print_error_system("kill"); 
+}
+
 bool Job::waited(int status, pid_t pid_check) 
 {
 	assert(pid_check >= 0);
@@ -627,12 +753,35 @@ bool Job::waited(int status, pid_t pid_check)
 	assert(pid_check == pid); 
 
 	bool success= WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	finish(success); 
+	return success; 
+}
+
+void Job::abandoned(pid_t pid_check)
+{
+	assert(pid_check >= 0);
+	assert(pid >= 0); 
+	assert(pid_check == pid); 
 
+	finish(false); 
+}
+
+void Job::finish(bool success)
+{
 	if (success)
 		++ count_jobs_success;
 	else
 		++ count_jobs_fail; 
 
+	measure_end(); 
+
+	if (Cgroup::is_used())
+		Cgroup::remove(pid); 
+	if (slot >= 0) {
+		Affinity::release(slot);
+		slot= -1;
+	}
+
 	if (pid == foreground_pid) {
 		assert(tty >= 0);
 		assert(option_interactive); 
@@ -641,7 +790,6 @@ bool Job::waited(int status, pid_t pid_check)
 	}
 	
 	pid= -1;
-	return success; 
 }
 
 void Job::print_statistics(bool allow_unterminated_jobs)
@@ -678,6 +826,59 @@ void Job::print_statistics(bool allow_unterminated_jobs)
 	       (intmax_t) usage.ru_stime.tv_sec,
 	       (long)     usage.ru_stime.tv_usec); 
 	printf("STATISTICS  Note: children execution times exclude running jobs\n"); 
+
+	Statistics::print(); 
+	Profile::print(); 
+}
+
+void Job::print_statistics_json(FILE *file)
+{
+	struct rusage usage;
+	if (getrusage(RUSAGE_CHILDREN, &usage) < 0) {
+		print_error_system("getrusage");
+		throw ERROR_BUILD; 
+	}
+
+	fprintf(file, 
+		"\"jobs\": {\"started\": %zu, \"succeeded\": %zu, \"failed\": %zu},\n"
+		"\"children\": {\"user\": %ju.%06lu, \"system\": %ju.%06lu},\n",
+		count_jobs_exec, count_jobs_success, count_jobs_fail,
+		(intmax_t) usage.ru_utime.tv_sec, (long) usage.ru_utime.tv_usec,
+		(intmax_t) usage.ru_stime.tv_sec, (long) usage.ru_stime.tv_usec); 
+}
+
+void Job::measure_start()
+{
+	if (! Statistics::enabled && ! USE_SDT)
+		return;
+	if (clock_gettime(CLOCK_MONOTONIC, &time_start) < 0)
+		print_error_system("clock_gettime"); 
+}
+
+void Job::measure_end()
+/* The CPU time is taken from the resource usage that wait4() returned
+ * for this job, which includes the processes it waited for itself.
+ * Jobs that were abandoned are not waited for before they are
+ * finished, and have no CPU time.  */
+{
+	if (! Statistics::enabled && ! USE_SDT)
+		return;
+
+	struct timespec time_end;
+	if (clock_gettime(CLOCK_MONOTONIC, &time_end) < 0) {
+		print_error_system("clock_gettime"); 
+		return;
+	}
+	time_wall= (time_end.tv_sec - time_start.tv_sec)
+		+ (time_end.tv_nsec - time_start.tv_nsec) * 1e-9; 
+
+	if (pid != pid_usage_waited) {
+		time_cpu= 0;
+		return;
+	}
+	time_cpu= 
+		usage_waited.ru_utime.tv_sec + usage_waited.ru_utime.tv_usec * 1e-6 +
+		usage_waited.ru_stime.tv_sec + usage_waited.ru_stime.tv_usec * 1e-6; 
 }
 
 void Job::handler_termination(int sig)
@@ -768,15 +969,16 @@ void Job::init_signals()
  *      something:   
  *         + SIGCHLD (to know when child processes are done) 
  *         + SIGUSR1 (to output statistics)
+ *         + SIGALRM (to start backup jobs; see Job::alarm())
  *      These signals are blocked, and then waited for specifically.
  *      The handlers thus do not have to be async-signal safe. 
  *    - The job control signals SIGTTIN and SIGTTOU.  They are both
  *      produced by certain job control events that Stu triggers, and
  *      ignored by Stu. 
  * 
- * The signals SIGCHLD and SIGUSR1 are the signals that we wait for in
- * the main loop.  They are blocked.  At the same time, each blocked
- * signal must have a signal handler (which can do nothing), as
+ * The signals SIGCHLD, SIGUSR1 and SIGALRM are the signals that we wait
+ * for in the main loop.  They are blocked.  At the same time, each
+ * blocked signal must have a signal handler (which can do nothing), as
  * otherwise POSIX allows the signal to be discarded.  Thus, we setup a
  * no-op signal handler.  (Note that Linux does not discard such
  * signals, while FreeBSD does.)
@@ -844,6 +1046,7 @@ void Job::init_signals()
 	act_productive.sa_flags= SA_SIGINFO;
 	sigaction(SIGCHLD, &act_productive, nullptr);
 	sigaction(SIGUSR1, &act_productive, nullptr);
+	sigaction(SIGALRM, &act_productive, nullptr);
 
 	if (0 != sigemptyset(&set_productive)) {
 		perror("sigemptyset");
@@ -857,6 +1060,10 @@ void Job::init_signals()
 		perror("sigaddset");
 		exit(ERROR_FATAL); 
 	}
+	if (0 != sigaddset(&set_productive, SIGALRM)) {
+		perror("sigaddset");
+		exit(ERROR_FATAL); 
+	}
 	if (0 != sigaddset(&set_termination_productive, SIGCHLD)) {
 		perror("sigaddset");
 		exit(ERROR_FATAL);
@@ -865,6 +1072,10 @@ void Job::init_signals()
 		perror("sigaddset");
 		exit(ERROR_FATAL); 
 	}
+	if (0 != sigaddset(&set_termination_productive, SIGALRM)) {
+		perror("sigaddset");
+		exit(ERROR_FATAL); 
+	}
 	if (0 != sigprocmask(SIG_BLOCK, &set_productive, nullptr)) {
 		perror("sigprocmask");
 		exit(ERROR_FATAL); 
@@ -914,6 +1125,20 @@ void Job::kill(pid_t pid)
 	}
 }
 
+void Job::stop(pid_t pid)
+{
+	assert(pid > 1); 
+	if (0 > ::kill(-pid, SIGSTOP) && errno != ESRCH)
+		print_error_system("kill"); 
+}
+
+void Job::resume(pid_t pid)
+{
+	assert(pid > 1); 
+	if (0 > ::kill(-pid, SIGCONT) && errno != ESRCH)
+		print_error_system("kill"); 
+}
+
 void Job::init_tty()
 {
 	assert(tty == -1); 
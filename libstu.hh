@@ -0,0 +1,280 @@
+#ifndef LIBSTU_HH
+#define LIBSTU_HH
+
+/*
+ * Interface for using Stu as a library.  Programs that generate build
+ * descriptions create rules and dependencies directly as objects,
+ * instead of writing Stu source code that is then tokenized and parsed
+ * again.  Like stu.cc, a program includes this header into a single
+ * translation unit, and is built with the same flags.  The header is
+ * self-contained; like all of Stu, it uses 'using namespace std'.  The
+ * stu program itself uses this interface to perform the build after
+ * having parsed its arguments and input files.  The test 'test/libstu'
+ * builds and runs the example below.
+ *
+ * A typical use is:
+ *
+ *	Libstu::init(argv[0], envp);
+ *	Libstu::add_rule({Libstu::file(Libstu::name("A"))},
+ *			 {Libstu::file(Libstu::name("B"))},
+ *			 "cp B A");
+ *	Libstu::target(Libstu::file(Libstu::name("A")));
+ *	int error= Libstu::run();
+ *
+ * Errors, e.g. duplicate rules, are output to stderr as by Stu, and
+ * cause ERROR_LOGICAL or ERROR_BUILD to be thrown as an int.  run()
+ * returns the exit status of Stu instead (see the manpage).  The
+ * options of Stu are set through the variables in options.hh, and the
+ * number of jobs through set_jobs().  Events of jobs are received
+ * through a Job_Listener set in Job::listener.
+ */
+
+/* Set by 'configure' when building Stu itself; used in messages */ 
+#ifndef PACKAGE
+#   define PACKAGE "stu"
+#endif
+
+#include <assert.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std; 
+
+#include "dep.hh"
+#include "execution.hh"
+
+class Libstu
+{
+public:
+
+	static void init(const char *argv0, char **envp);
+	/* Must be called first.  ARGV0 is used in error messages, and
+	 * ENVP is the environment of jobs.  */
+
+	static void set_source(const string &source_);
+	/* The name used as the filename in the places of names created
+	 * afterwards, i.e., in error messages.  Each name gets the next
+	 * line number.  Default "libstu".  */
+
+	static Place_Name name(const string &text);
+	/* An unparametrized name */
+
+	static Place_Name name(const vector <string> &texts,
+			       const vector <string> &parameters);
+	/* A parametrized name consisting of TEXTS[0] PARAMETERS[0]
+	 * TEXTS[1] ... TEXTS[N].  TEXTS has one more element than
+	 * PARAMETERS.  Two parameters must not be adjacent.  */
+
+	static shared_ptr <const Dep> file(const Place_Name &name, Flags flags= 0);
+	static shared_ptr <const Dep> transient(const Place_Name &name, Flags flags= 0);
+	/* A file or transient target, as used for both the targets of
+	 * rules and dependencies.  FLAGS may contain F_PERSISTENT,
+	 * F_OPTIONAL and F_TRIVIAL, which are only allowed for
+	 * dependencies.  */
+
+	static shared_ptr <const Dep> dynamic(shared_ptr <const Dep> dep,
+					      Flags flags= 0);
+	/* The dynamic dependency [DEP].  FLAGS may contain
+	 * F_NEWLINE_SEPARATED or F_NUL_SEPARATED (as -n and -0).  */
+
+	static void add_rule(const vector <shared_ptr <const Dep> > &targets,
+			     const vector <shared_ptr <const Dep> > &deps,
+			     const char *command,
+			     int redirect_index= -1,
+			     const string &filename_input= "");
+	/* Add a rule.  TARGETS are created by file() and transient()
+	 * without flags.  COMMAND is null for a rule without command.
+	 * REDIRECT_INDEX is the index of the target in TARGETS to which
+	 * the output is redirected (as '>'), or -1.  FILENAME_INPUT is
+	 * the name of the dependency from which the input is read (as
+	 * '<'), or empty.  */
+
+	static void target(shared_ptr <const Dep> dep);
+	/* Request a target to be built by run() */
+
+	static void set_jobs(int jobs);
+	/* The number of jobs run in parallel (as -j) */
+
+	static int run();
+	/* Build the targets requested by target().  Return 0 on success,
+	 * or the exit status of Stu.  Must be called at most once, as
+	 * the state of targets is kept.  */
+
+	static int run(const vector <shared_ptr <const Dep> > &deps);
+	/* Build the given targets */
+
+private:
+
+	static string source;
+	static size_t line;
+
+	static vector <shared_ptr <const Dep> > deps_requested;
+
+	static Place place();
+	/* The place of the next name */
+
+	static shared_ptr <const Dep> plain(const Place_Name &name,
+					    Flags flags, Flags flags_target);
+};
+
+string Libstu::source= "libstu";
+size_t Libstu::line= 0;
+vector <shared_ptr <const Dep> > Libstu::deps_requested;
+
+void Libstu::init(const char *argv0, char **envp)
+{
+	dollar_zero= argv0;
+	envp_global= (const char **) envp;
+	Job::init_tty();
+	Color::set();
+	/* Statistics are only measured by the stu program (-z) */
+	Statistics::disable();
+}
+
+void Libstu::set_source(const string &source_)
+{
+	source= source_;
+	line= 0;
+}
+
+Place_Name Libstu::name(const string &text)
+{
+	return Place_Name(text, place());
+}
+
+Place_Name Libstu::name(const vector <string> &texts,
+			const vector <string> &parameters)
+{
+	assert(texts.size() == parameters.size() + 1);
+	Place place_name= place();
+	Place_Name ret(texts[0], place_name);
+	for (size_t i= 0;  i < parameters.size();  ++i) {
+		if (ret.last_text() == "" && i > 0) {
+			place_name << fmt("parameters %s and %s must be separated",
+					  prefix_format_word(parameters[i - 1], "$"),
+					  prefix_format_word(parameters[i], "$"));
+			throw ERROR_LOGICAL;
+		}
+		ret.append_parameter(parameters[i], place_name);
+		ret.append_text(texts[i + 1]);
+	}
+	return ret;
+}
+
+shared_ptr <const Dep> Libstu::file(const Place_Name &name, Flags flags)
+{
+	return plain(name, flags, 0);
+}
+
+shared_ptr <const Dep> Libstu::transient(const Place_Name &name, Flags flags)
+{
+	return plain(name, flags, F_TARGET_TRANSIENT);
+}
+
+shared_ptr <const Dep> Libstu::dynamic(shared_ptr <const Dep> dep, Flags flags)
+{
+	assert((flags & ~F_ATTRIBUTE) == 0);
+	if (flags) {
+		shared_ptr <Dep> dep_attribute= Dep::clone(dep);
+		dep_attribute->flags |= flags;
+		dep= dep_attribute;
+	}
+	return make_shared <Dynamic_Dep> (0, dep);
+}
+
+void Libstu::add_rule(const vector <shared_ptr <const Dep> > &targets,
+		      const vector <shared_ptr <const Dep> > &deps,
+		      const char *command,
+		      int redirect_index,
+		      const string &filename_input)
+{
+	assert(! targets.empty());
+	assert(redirect_index >= -1 && redirect_index < (ssize_t) targets.size());
+
+	vector <shared_ptr <const Place_Param_Target> > place_param_targets;
+	for (const auto &dep:  targets) {
+		shared_ptr <const Plain_Dep> plain_dep= to <Plain_Dep> (dep);
+		assert(plain_dep);
+		if (plain_dep->flags & F_PLACED) {
+			plain_dep->get_place() << fmt("target %s must not have flags",
+						      plain_dep->format_word());
+			throw ERROR_LOGICAL;
+		}
+		place_param_targets.push_back
+			(make_shared <Place_Param_Target> (plain_dep->place_param_target));
+	}
+	if (redirect_index >= 0
+	    && place_param_targets[redirect_index]->flags & F_TARGET_TRANSIENT) {
+		place_param_targets[redirect_index]->place <<
+			fmt("transient target %s is invalid",
+			    place_param_targets[redirect_index]->format_word());
+		throw ERROR_LOGICAL;
+	}
+
+	shared_ptr <const Command> cmd;
+	if (command) {
+		const Place &place_command= place_param_targets[0]->place;
+		cmd= make_shared <Command> (command, place_command, place_command, false);
+	}
+
+	Name name_input;
+	if (filename_input != "")
+		name_input= Name(filename_input);
+
+	vector <shared_ptr <const Rule> > rules
+		{make_shared <Rule> (move(place_param_targets), deps, cmd,
+				     false, redirect_index, name_input)};
+	Execution::rule_set.add(rules);
+}
+
+void Libstu::target(shared_ptr <const Dep> dep)
+{
+	deps_requested.push_back(dep);
+}
+
+void Libstu::set_jobs(int jobs)
+{
+	assert(jobs >= 1);
+	Execution::jobs= jobs;
+	option_parallel= jobs > 1;
+}
+
+int Libstu::run()
+{
+	vector <shared_ptr <const Dep> > deps;
+	swap(deps, deps_requested);
+	return run(deps);
+}
+
+int Libstu::run(const vector <shared_ptr <const Dep> > &deps)
+{
+	try {
+		Execution::main(deps);
+	} catch (int e) {
+		assert(e >= 1 && e <= 3);
+		return e;
+	}
+	return 0;
+}
+
+Place Libstu::place()
+{
+	return Place(Place::Type::INPUT_FILE, source, ++line, 0);
+}
+
+shared_ptr <const Dep> Libstu::plain(const Place_Name &name,
+				     Flags flags, Flags flags_target)
+{
+	assert((flags & ~(F_PERSISTENT | F_OPTIONAL | F_TRIVIAL)) == 0);
+	Place places[C_PLACED];
+	for (int i= 0;  i < C_PLACED;  ++i)
+		if (flags & (1 << i))
+			places[i]= name.place;
+	return make_shared <Plain_Dep>
+		(flags | flags_target, places, Place_Param_Target(flags_target, name));
+}
+
+#endif /* ! LIBSTU_HH */
@@ -0,0 +1,104 @@
+#ifndef MEMORY_HH
+#define MEMORY_HH
+
+/*
+ * Accounting of the memory used by Stu's own data structures, output
+ * with the statistics (-z, -Z and SIGUSR1).
+ *
+ * Classes whose objects are counted derive from Counted <T>, with T
+ * being the class itself.  This maintains the number of live objects
+ * of each class in all builds, at the cost of an increment in every
+ * constructor and destructor; the counts are only output when
+ * statistics are requested.  Only classes of which objects are created
+ * derive from Counted <T>, not their abstract base classes, such that
+ * each object is counted once, with the size of its actual class.
+ *
+ * Bytes of objects are shallow:  they are the number of objects times
+ * the size of the class, i.e., they don't include memory pointed to by
+ * an object, such as the characters of strings.  For hash maps, they
+ * are estimated from the number of entries and buckets.
+ */
+
+#include <stdio.h>
+
+#include <vector>
+
+template <typename T>
+class Counted
+{
+public:
+	static size_t count;
+
+	Counted()                 {  ++ count;  }
+	Counted(const Counted &)  {  ++ count;  }
+	~Counted()                {  -- count;  }
+
+	Counted &operator=(const Counted &)= default;
+};
+
+template <typename T>
+size_t Counted <T> ::count= 0;
+
+class Memory
+{
+public:
+
+	struct Entry
+	{
+		const char *name;
+		size_t count;
+		size_t bytes;
+		bool shallow;
+		/* Whether BYTES is the shallow size of objects, rather
+		 * than an estimate of the whole size of a hash map */
+	};
+
+	template <typename T>
+	static void add_objects(vector <Entry> &entries, const char *name)
+	{
+		entries.push_back(Entry{name, Counted <T> ::count,
+					Counted <T> ::count * sizeof(T), true});
+	}
+
+	template <typename M>
+	static void add_map(vector <Entry> &entries, const char *name,
+			    const M &map)
+	/* A hash map.  Each entry is assumed to be a node containing the
+	 * value and one pointer, plus one pointer per bucket. */
+	{
+		entries.push_back(Entry{name, map.size(),
+					map.size() * (sizeof(typename M::value_type) + sizeof(void *))
+					+ map.bucket_count() * sizeof(void *),
+					false});
+	}
+
+	static void print(const vector <Entry> &entries);
+	/* In the format of the -z option */
+
+	static void print_json(FILE *file, const vector <Entry> &entries);
+	/* As a member of a JSON object, followed by a comma */
+};
+
+void Memory::print(const vector <Entry> &entries)
+{
+	for (const Entry &entry:  entries) {
+		printf("STATISTICS  memory %-24s count = %zu, %s = %zu\n",
+		       entry.name, entry.count,
+		       entry.shallow ? "shallow bytes" : "bytes", entry.bytes);
+	}
+}
+
+void Memory::print_json(FILE *file, const vector <Entry> &entries)
+{
+	fprintf(file, "\"memory\": {");
+	for (size_t i= 0;  i < entries.size();  ++i) {
+		fprintf(file, "%s\n  \"%s\": {\"count\": %zu, \"%s\": %zu}",
+			i ? "," : "",
+			entries[i].name, entries[i].count,
+			entries[i].shallow ? "shallow_bytes" : "bytes",
+			entries[i].bytes);
+	}
+	fprintf(file, "},\n");
+}
+
+#endif /* ! MEMORY_HH */
@@ -0,0 +1,407 @@
+/*
+ * Microbenchmarks of the core primitives of Stu.  This is a separate
+ * program that is not installed; it includes the same headers as
+ * stu.cc and is built with 'make microbench'.  The results are written
+ * as a JSON object on standard output.
+ *
+ * INVOCATION
+ *
+ *	microbench [-s SIZE] [BENCHMARK...]
+ *
+ * Without arguments, run all benchmarks.  SIZE is the size of the
+ * inputs, e.g., the number of rules (default 1000).  Each benchmark is
+ * run repeatedly for at least a fixed wall time, and the mean time per
+ * operation is output.
+ */
+
+#include <unistd.h>
+
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+#include "dep.hh"
+#include "execution.hh"
+#include "rule.hh"
+#include "parser.hh"
+#include "tokenizer.hh"
+
+class Microbench
+/* A single benchmark.  RUN() performs one operation and returns a
+ * value that depends on the result, such that the operation cannot be
+ * optimized away.  */
+{
+public:
+	const char *const key;
+	const size_t size;
+
+	Microbench(const char *name_, size_t size_)
+		:  key(name_), size(size_)  {  }
+
+	virtual ~Microbench()  {  }
+
+	virtual size_t run()= 0;
+};
+
+class Printer_Bench
+	:  public Printer
+{
+public:
+	void operator<<(string message) const {
+		fprintf(stderr, "microbench: %s\n", message.c_str());
+	}
+};
+
+/* The minimal wall time in seconds to run each benchmark */
+const double time_min= 0.2;
+
+size_t size_bench= 1000;
+
+volatile size_t sink;
+/* The results of all operations are written here */
+
+double now()
+{
+	struct timespec t;
+	if (clock_gettime(CLOCK_MONOTONIC, &t) < 0) {
+		perror("clock_gettime");
+		exit(ERROR_FATAL);
+	}
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+string rules_text(size_t n)
+/* Stu source code with N unparametrized rules and 2*N parametrized
+ * rules with overlapping patterns, as generated by 'sh/mkbench rules'.  */
+{
+	string ret;
+	for (size_t i= 1;  i <= n;  ++i) {
+		ret += frmt("u%zu: s.%zu { : >u%zu }\n", i, i, i);
+		ret += frmt("r%zu.$a:    { : >\"r%zu.$a\" }\n", i, i);
+		ret += frmt("r%zu.$a.o:  s.%zu { : >\"r%zu.$a.o\" }\n", i, i, i);
+	}
+	return ret;
+}
+
+class Bench_Name_Match
+	:  public Microbench
+{
+public:
+	Bench_Name_Match()
+		:  Microbench("name_match", size_bench) {
+		name_param.append_text("src/");
+		name_param.append_parameter("dir");
+		name_param.append_text("/");
+		name_param.append_parameter("name");
+		name_param.append_text(".c.o");
+		for (size_t i= 0;  i < size;  ++i) {
+			names.push_back(i % 4 == 0
+					? frmt("src/d%zu/f%zu.c.h", i % 10, i)
+					: frmt("src/d%zu/f%zu.c.o", i % 10, i));
+		}
+	}
+	size_t run() {
+		size_t ret= 0;
+		for (const string &name:  names) {
+			map <string, string> mapping;
+			vector <size_t> anchoring;
+			ret += name_param.match(name, mapping, anchoring);
+		}
+		return ret;
+	}
+private:
+	Name name_param;
+	vector <string> names;
+};
+
+class Bench_Anchoring_Dominates
+	:  public Microbench
+{
+public:
+	Bench_Anchoring_Dominates()
+		:  Microbench("anchoring_dominates", size_bench) {
+		Name name_a, name_b;
+		name_a.append_text("r");
+		name_a.append_parameter("a");
+		name_a.append_text(".o");
+		name_b.append_text("r");
+		name_b.append_parameter("a");
+		for (size_t i= 0;  i < size;  ++i) {
+			string name= frmt("r%zu.x.o", i);
+			map <string, string> mapping_a, mapping_b;
+			vector <size_t> anchoring_a, anchoring_b;
+			name_a.match(name, mapping_a, anchoring_a);
+			name_b.match(name, mapping_b, anchoring_b);
+			anchorings_a.push_back(anchoring_a);
+			anchorings_b.push_back(anchoring_b);
+		}
+	}
+	size_t run() {
+		size_t ret= 0;
+		for (size_t i= 0;  i < anchorings_a.size();  ++i) {
+			ret += Name::anchoring_dominates(anchorings_a[i], anchorings_b[i]);
+			ret += Name::anchoring_dominates(anchorings_b[i], anchorings_a[i]);
+		}
+		return ret;
+	}
+private:
+	vector <vector <size_t> > anchorings_a, anchorings_b;
+};
+
+class Bench_Rule_Set_Get
+	:  public Microbench
+{
+public:
+	Bench_Rule_Set_Get()
+		:  Microbench("rule_set_get", size_bench) {
+		shared_ptr <const Rule> rule_first;
+		Parser::get_string(rules_text(size).c_str(), rule_set, rule_first);
+		for (size_t i= 1;  i <= size;  ++i)
+			targets.push_back(Target(0, i % 2 ? frmt("r%zu.x.o", i) : frmt("u%zu", i)));
+	}
+	size_t run() {
+		size_t ret= 0;
+		for (const Target &target:  targets) {
+			shared_ptr <const Rule> param_rule;
+			map <string, string> mapping_parameter;
+			ret += rule_set.get(target, param_rule, mapping_parameter,
+					    Place::place_empty) != nullptr;
+		}
+		return ret;
+	}
+private:
+	Rule_Set rule_set;
+	vector <Target> targets;
+};
+
+class Bench_Target_Hash
+	:  public Microbench
+{
+public:
+	Bench_Target_Hash()
+		:  Microbench("target_hash", size_bench) {
+		for (size_t i= 0;  i < size;  ++i)
+			targets.push_back(Target(0, frmt("build/obj/module%zu/file%zu.o", i % 50, i)));
+	}
+	size_t run() {
+		size_t ret= 0;
+		for (const Target &target:  targets)
+			ret += hash <Target> ()(target);
+		return ret;
+	}
+private:
+	vector <Target> targets;
+};
+
+class Bench_Target_Compare
+	:  public Microbench
+{
+public:
+	Bench_Target_Compare()
+		:  Microbench("target_compare", size_bench) {
+		for (size_t i= 0;  i < size;  ++i) {
+			targets_a.push_back(Target(0, frmt("build/obj/module%zu/file%zu.o", i % 50, i)));
+			targets_b.push_back(Target(0, frmt("build/obj/module%zu/file%zu.o", i % 50, i - i % 2)));
+		}
+	}
+	size_t run() {
+		size_t ret= 0;
+		for (size_t i= 0;  i < targets_a.size();  ++i)
+			ret += targets_a[i] == targets_b[i];
+		return ret;
+	}
+private:
+	vector <Target> targets_a, targets_b;
+};
+
+class Bench_Tokenize
+	:  public Microbench
+{
+public:
+	Bench_Tokenize()
+		:  Microbench("tokenize", size_bench), text(rules_text(size))  {  }
+	size_t run() {
+		vector <shared_ptr <Token> > tokens;
+		Place place_end;
+		Tokenizer::parse_tokens_string(tokens, Tokenizer::OPTION_F,
+					       place_end, text,
+					       Place(Place::Type::OPTION, 'F'));
+		return tokens.size();
+	}
+private:
+	const string text;
+};
+
+class Bench_Expression_List_Delim
+	:  public Microbench
+{
+public:
+	Bench_Expression_List_Delim()
+		:  Microbench("expression_list_delim", size_bench) {
+		char name[]= "/tmp/microbench.XXXXXX";
+		int fd= mkstemp(name);
+		if (fd < 0) {
+			perror("mkstemp");
+			exit(ERROR_FATAL);
+		}
+		filename= name;
+		FILE *file= fdopen(fd, "w");
+		for (size_t i= 0;  i < size;  ++i)
+			fprintf(file, "src/module%zu/file%zu.c\n", i % 50, i);
+		if (fclose(file)) {
+			perror(filename.c_str());
+			exit(ERROR_FATAL);
+		}
+	}
+	~Bench_Expression_List_Delim() {
+		unlink(filename.c_str());
+	}
+	size_t run() {
+		vector <shared_ptr <const Dep> > deps;
+		Parser::get_expression_list_delim(deps, filename.c_str(), '\n', 'n',
+						  printer);
+		return deps.size();
+	}
+private:
+	string filename;
+	Printer_Bench printer;
+};
+
+class Bench_Normalize
+	:  public Microbench
+{
+public:
+	Bench_Normalize()
+		:  Microbench("normalize_concat", size_bench) {
+		/* Two lists of about sqrt(SIZE) names each, such that
+		 * the concatenation has about SIZE elements */
+		size_t k= 1;
+		while ((k + 1) * (k + 1) <= size)
+			++k;
+		string list;
+		for (size_t i= 1;  i <= k;  ++i)
+			list += frmt(" %zu", i);
+		string text= "p.(" + list + ").(" + list + ")";
+		vector <shared_ptr <Token> > tokens;
+		Place place_end;
+		Tokenizer::parse_tokens_string(tokens, Tokenizer::OPTION_C,
+					       place_end, text,
+					       Place(Place::Type::OPTION, 'C'));
+		vector <shared_ptr <const Dep> > deps;
+		Place_Name input;
+		Place place_input;
+		Parser::get_expression_list(deps, tokens, place_end,
+					    input, place_input);
+		assert(deps.size() == 1);
+		dep= deps[0];
+	}
+	size_t run() {
+		vector <shared_ptr <const Dep> > deps;
+		int error= 0;
+		Dep::normalize(dep, deps, error);
+		return deps.size() + error;
+	}
+private:
+	shared_ptr <const Dep> dep;
+};
+
+void measure(Microbench &bench, bool first)
+{
+	size_t count= 0;
+	double begin= now(), end;
+	do {
+		sink= sink + bench.run();
+		++count;
+		end= now();
+	} while (end - begin < time_min);
+
+	printf("%s\n  \"%s\": {\"size\": %zu, \"iterations\": %zu, "
+	       "\"time\": %.9f, \"ns_per_op\": %.3f}",
+	       first ? "" : ",",
+	       bench.key, bench.size, count, end - begin,
+	       (end - begin) * 1e9 / ((double) count * bench.size));
+	fflush(stdout);
+}
+
+Microbench *create(const char *name)
+{
+	if (! strcmp(name, "name_match"))             return new Bench_Name_Match();
+	if (! strcmp(name, "anchoring_dominates"))    return new Bench_Anchoring_Dominates();
+	if (! strcmp(name, "rule_set_get"))           return new Bench_Rule_Set_Get();
+	if (! strcmp(name, "target_hash"))            return new Bench_Target_Hash();
+	if (! strcmp(name, "target_compare"))         return new Bench_Target_Compare();
+	if (! strcmp(name, "tokenize"))               return new Bench_Tokenize();
+	if (! strcmp(name, "expression_list_delim"))  return new Bench_Expression_List_Delim();
+	if (! strcmp(name, "normalize_concat"))       return new Bench_Normalize();
+	return nullptr;
+}
+
+const char *const names_all[]= {
+	"name_match",
+	"anchoring_dominates",
+	"rule_set_get",
+	"target_hash",
+	"target_compare",
+	"tokenize",
+	"expression_list_delim",
+	"normalize_concat",
+};
+
+int main(int argc, char **argv)
+{
+	/* The primitives themselves measure times when statistics are
+	 * enabled, which would dominate the results */
+	Statistics::enabled= false;
+
+	int c;
+	while ((c= getopt(argc, argv, "s:")) != -1) {
+		switch (c) {
+		case 's':  {
+			char *endptr;
+			errno= 0;
+			long s= strtol(optarg, &endptr, 10);
+			if (errno != 0 || *endptr != '\0' || s < 1) {
+				fprintf(stderr, "microbench: invalid size '%s'\n", optarg);
+				exit(ERROR_FATAL);
+			}
+			size_bench= s;
+			break;
+		}
+		default:
+			fprintf(stderr, "Usage:  microbench [-s SIZE] [BENCHMARK...]\n");
+			exit(ERROR_FATAL);
+		}
+	}
+
+	vector <const char *> names;
+	for (int i= optind;  i < argc;  ++i)
+		names.push_back(argv[i]);
+	if (names.empty())
+		for (const char *name:  names_all)
+			names.push_back(name);
+
+	try {
+		printf("{\"version\": \"%s\", \"benchmarks\": {", STU_VERSION);
+		bool first= true;
+		for (const char *name:  names) {
+			unique_ptr <Microbench> bench(create(name));
+			if (bench == nullptr) {
+				fprintf(stderr, "microbench: unknown benchmark '%s'\n", name);
+				exit(ERROR_FATAL);
+			}
+			measure(*bench, first);
+			first= false;
+		}
+		printf("\n}}\n");
+	} catch (int e) {
+		exit(e);
+	}
+
+	if (fflush(stdout)) {
+		perror("stdout");
+		exit(ERROR_FATAL);
+	}
+
+	return 0;
+}
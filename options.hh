@@ -10,18 +10,45 @@
 static bool option_nontrivial= false;
 /* The -a option (consider all trivial dependencies to be non-trivial) */ 
 
+static bool option_speculative= false;
+/* The -A option (start trivial dependencies early in free job slots) */ 
+
+static const char *option_cpus= nullptr; 
+/* The -B option (bind the job slots to the given sets of CPUs); NULL
+ * when not used */
+
+static const char *option_cache_server= nullptr; 
+/* The -b option (run as a cache server on the given socket); NULL when
+ * not used */
+
 static bool option_debug= false;
 /* The -d option (debug mode) */ 
 
+static double option_backup= 0;
+/* The -e option (start a backup job for jobs of idempotent rules that
+ * take longer than the given factor times their recorded duration); 0
+ * when not used */
+
 static bool option_explain= false;
 /* The -E option (explain error messages) */
 
 static bool option_nonoptional= false;
 /* The -g option (consider all optional dependencies to be non-optional) */
 
+static const char *option_cgroup_directory= nullptr; 
+/* The -G option (place each job into its own cgroup within the given
+ * cgroup directory); NULL when not used */
+
+static const char *option_history_file= nullptr; 
+/* The -H option (read and write the durations of jobs from and into
+ * the given file); NULL when not used */
+
 static bool option_interactive= false;
 /* The -i option (interactive mode) */
 
+static bool option_preempt= false;
+/* The -I option (stop jobs to run jobs with a higher priority) */
+
 static bool option_literal= false; 
 /* The -J option (literal interpretation of arguments) */
 
@@ -31,24 +58,72 @@ static bool option_keep_going= false;
 static bool option_no_delete= false;
 /* The -K option (don't delete partially built files) */
 
+static const char *option_claim_directory= nullptr; 
+/* The -l option (claim targets using lock files in the given
+ * directory); NULL when not used */
+
+static long option_lookahead= 0;
+/* The -L option (number of levels by which the dependency graph is
+ * expanded while all job slots are in use) */
+
+static long option_admission= 0;
+/* The -N option (maximal number of active dependencies read from the
+ * files given by -n and -0); 0 when not used */
+
+static const char *option_cache_store= nullptr; 
+/* The -O option (use the output cache in the given directory or cache
+ * server); NULL when not used */
+
 static bool option_print= false;
 /* The -P option (print rules) */
 
 static bool option_question= false; 
 /* The -q option (question mode) */
 
+static bool option_plan= false; 
+/* The -Q option (plan mode) */
+
+static const char *option_index_file= nullptr; 
+/* The -R option (read and write the reverse dependency index from and
+ * into the given file); NULL when not used */
+
 static bool option_silent= false;
 /* The -s option (silent) */
 
+static const char *option_progress_file= nullptr; 
+/* The -S option (write the progress into the given file); NULL when
+ * not used */
+
+static const char *option_timeline_file= nullptr; 
+/* The -T option (write a timeline into the given file); NULL when not
+ * used */
+
+static const char *option_changed_file= nullptr; 
+/* The -u option (read the changed files from the given file); NULL
+ * when not used */
+
+static bool option_watch= false;
+/* The -w option (watch mode) */
+
 static bool option_individual= false;
 /* The -x option (use sh -x) */ 
 
+static long option_prefetch= 0;
+/* The -X option (number of threads that prefetch the metadata of
+ * files); 0 when not used */
+
 static bool option_statistics= false;
 /* The -z option (output statistics) */
 
+static const char *option_statistics_file= nullptr; 
+/* The -Z option (write statistics as JSON into the given file); NULL
+ * when not used */
+
 enum class Order {
 	DFS   = 0,
 	RANDOM= 1,
+	BFS   = 2,
+	TARGET= 3,
 	
 	/* -M mode is coded as Order::RANDOM */ 
 };
@@ -58,7 +133,8 @@ bool option_parallel= false;
 /* Whether the -j option is used with a value >1 */ 
 
 static bool order_vec; 
-/* Whether to use vectors for randomization */ 
+/* Whether to use vectors for randomization, or for ordering by target
+ * name */ 
 
 const char **envp_global;
 /* The envp variable.  Set in main().  */
@@ -90,6 +90,19 @@ public:
 	/* Read delimiter-separated dynamic dependency from FILENAME,
 	 * delimited by C.  Write result into DEPS.  Throws errors.  */
 
+	static shared_ptr <const Plain_Dep> get_dep_delim(FILE *file,
+							  const char *filename,
+							  char c, char c_printed,
+							  Place &place,
+							  char *&lineptr, size_t &n,
+							  const Printer &printer);
+	/* Read the next entry of a delimiter-separated dynamic dependency
+	 * from FILE, which was opened from FILENAME.  PLACE is the place
+	 * of the previous entry and is updated.  LINEPTR and N are the
+	 * buffer as used by getdelim(3).  Return null at the end of the
+	 * file.  Throws errors; the caller closes FILE and frees
+	 * LINEPTR.  */
+
 	static void get_target_arg(vector <shared_ptr <const Dep> > &deps, 
 				   int argc, const char *const *argv); 
 	/* Parse a dependency as given on the command line outside of
@@ -1284,7 +1297,6 @@ void Parser::get_expression_list_delim(vector <shared_ptr <const Dep> > &deps,
 {
 	char *lineptr= nullptr;
 	size_t n= 0;
-	ssize_t len;
 			
 	FILE *file= fopen(filename, "r"); 
 	if (file == nullptr) {
@@ -1294,74 +1306,94 @@ void Parser::get_expression_list_delim(vector <shared_ptr <const Dep> > &deps,
 
 	Place place(Place::Type::INPUT_FILE, filename, 0, 0); 
 
-	while ((len= getdelim(&lineptr, &n, c, file)) >= 0) {
+	try {
+		while (shared_ptr <const Plain_Dep> dep=
+		       get_dep_delim(file, filename, c, c_printed, place, 
+				     lineptr, n, printer)) {
+			deps.push_back(dep); 
+		}
+	} catch (int) {
+		free(lineptr); 
+		fclose(file); 
+		throw; 
+	}
+	free(lineptr); 
+	if (fclose(file)) {
+		print_error_system(filename); 
+		throw ERROR_BUILD; 
+	}
+}
+
+shared_ptr <const Plain_Dep> Parser::get_dep_delim(FILE *file,
+						   const char *filename,
+						   char c, char c_printed,
+						   Place &place,
+						   char *&lineptr, size_t &n,
+						   const Printer &printer)
+{
+	ssize_t len= getdelim(&lineptr, &n, c, file); 
+	if (len < 0) {
+		if (ferror(file)) {
+			print_error_system(filename); 
+			throw ERROR_BUILD; 
+		}
+		return nullptr; 
+	}
 
-		++place.line;
+	++place.line;
 				
-		/* LEN is at least one by the specification of
-		 * getdelim().  */ 
-		assert(len >= 1); 
+	/* LEN is at least one by the specification of getdelim().  */ 
+	assert(len >= 1); 
 
-		assert(lineptr[len] == '\0'); 
+	assert(lineptr[len] == '\0'); 
 				
-		/* There may or may not be a terminating \n or \0.
-		 * getdelim(3) will include it if it is present, but the
-		 * file may not have one for the last entry.  */ 
+	/* There may or may not be a terminating \n or \0.  getdelim(3)
+	 * will include it if it is present, but the file may not have
+	 * one for the last entry.  */ 
 
-		if (lineptr[len - 1] == c) {
-			--len; 
-		}
+	if (lineptr[len - 1] == c) {
+		--len; 
+	}
 
-		/* An empty line: This corresponds to an empty filename,
-		 * and thus we treat is as a syntax error, because
-		 * filenames can never be empty.  */ 
-		if (len == 0) {
-			free(lineptr); 
-			fclose(file); 
-			place << "filename must not be empty"; 
-			printer <<
-				fmt("in %s-separated dynamic dependency %s "
-				    "declared with flag %s",
-				    c == '\0' ? "zero" : "newline",
-				    name_format_word(filename),
-				    multichar_format_word
-				    (frmt("-%c", c_printed)));
-			throw ERROR_LOGICAL; 
-		}
+	/* An empty line: This corresponds to an empty filename, and
+	 * thus we treat is as a syntax error, because filenames can
+	 * never be empty.  */ 
+	if (len == 0) {
+		place << "filename must not be empty"; 
+		printer <<
+			fmt("in %s-separated dynamic dependency %s "
+			    "declared with flag %s",
+			    c == '\0' ? "zero" : "newline",
+			    name_format_word(filename),
+			    multichar_format_word
+			    (frmt("-%c", c_printed)));
+		throw ERROR_LOGICAL; 
+	}
 				
-		string filename_dep= string(lineptr, len); 
-
-		if (c != '\0' && filename_dep.find('\0') != string::npos) {
-			free(lineptr); 
-			fclose(file);
-			place << fmt("filename %s must not contain %s",
-				     name_format_word(filename_dep),
-				     char_format_word('\0')); 
-			printer <<
-				fmt("in %s-separated dynamic dependency %s "
-				    "declared with flag %s",
-				    c == '\0' ? "zero" : "newline",
-				    name_format_word(filename),
-				    multichar_format_word
-				    (frmt("-%c", c_printed)));
-			throw ERROR_LOGICAL; 
-		}
-		if (c == '\0') {
-			assert(filename_dep.find('\0') == string::npos); 
-		}
-
-		deps.push_back
-			(make_shared <Plain_Dep>
-			 (0,
-			  Place_Param_Target
-			  (0, 
-			   Place_Name(filename_dep, place)))); 
+	string filename_dep= string(lineptr, len); 
+
+	if (c != '\0' && filename_dep.find('\0') != string::npos) {
+		place << fmt("filename %s must not contain %s",
+			     name_format_word(filename_dep),
+			     char_format_word('\0')); 
+		printer <<
+			fmt("in %s-separated dynamic dependency %s "
+			    "declared with flag %s",
+			    c == '\0' ? "zero" : "newline",
+			    name_format_word(filename),
+			    multichar_format_word
+			    (frmt("-%c", c_printed)));
+		throw ERROR_LOGICAL; 
 	}
-	free(lineptr); 
-	if (fclose(file)) {
-		print_error_system(filename); 
-		throw ERROR_BUILD; 
+	if (c == '\0') {
+		assert(filename_dep.find('\0') == string::npos); 
 	}
+
+	return make_shared <Plain_Dep>
+		(0,
+		 Place_Param_Target
+		 (0, 
+		  Place_Name(filename_dep, place))); 
 }
 
 void Parser::get_target_arg(vector <shared_ptr <const Dep> > &deps, 
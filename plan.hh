@@ -0,0 +1,150 @@
+#ifndef PLAN_HH
+#define PLAN_HH
+
+/*
+ * Plan mode (the -Q option).  The dependency graph is expanded and all
+ * up-to-date checks are performed as in a normal build, but instead of
+ * starting a job, each target that would be built is recorded as a
+ * planned job, and is then treated as if it had been rebuilt.  At the
+ * end, the planned jobs are output, followed by a simulation of the
+ * build with the number of job slots given by -j.  The durations of
+ * jobs are taken from the history file given by -H; jobs without a
+ * recorded duration are counted as taking no time.
+ *
+ * The simulation is a list scheduling:  whenever a job slot is free,
+ * the first planned job whose dependencies are all finished is
+ * started.  The projected makespan is the time at which the last job
+ * finishes.  The critical path is the chain of planned jobs, each
+ * depending on the previous one, with the largest total duration; it
+ * is a lower bound for the makespan regardless of the number of job
+ * slots.
+ */
+
+#include <algorithm>
+#include <queue>
+
+#include "progress.hh"
+
+class Plan
+{
+public:
+
+	static size_t add(string name, vector <size_t> &deps);
+	/* A job is planned for the target NAME, given in Stu syntax.
+	 * DEPS contains the indices of the planned jobs it depends on,
+	 * which must all be smaller than the returned index; it is
+	 * sorted and made unique.  Return the index of the new job.  */
+
+	static void print(long slots);
+	/* Output the planned jobs and the simulation on standard
+	 * output */
+
+private:
+
+	struct Job_Plan
+	{
+		string name;
+		double duration; /* -1 when unknown */
+		vector <size_t> deps;
+	};
+
+	static vector <Job_Plan> jobs;
+
+	static double simulate(long slots);
+	/* Return the projected makespan */
+};
+
+vector <Plan::Job_Plan> Plan::jobs;
+
+size_t Plan::add(string name, vector <size_t> &deps)
+{
+	sort(deps.begin(), deps.end());
+	deps.erase(unique(deps.begin(), deps.end()), deps.end());
+	assert(deps.empty() || deps.back() < jobs.size());
+	jobs.push_back(Job_Plan{name, Progress::duration(name), deps});
+	return jobs.size() - 1;
+}
+
+void Plan::print(long slots)
+{
+	assert(slots >= 1);
+
+	size_t count_unknown= 0;
+	for (const Job_Plan &job:  jobs) {
+		if (job.duration < 0) {
+			++ count_unknown;
+			printf("PLAN  job %s (unknown duration)\n", job.name.c_str());
+		} else {
+			printf("PLAN  job %s (%.3f s)\n", job.name.c_str(), job.duration);
+		}
+	}
+	printf("PLAN  number of jobs = %zu, with unknown duration = %zu\n",
+	       jobs.size(), count_unknown);
+
+	/* Critical path:  LENGTH[i] is the largest total duration of a
+	 * chain ending in job I, and PREV[i] the previous job in it */
+	vector <double> length(jobs.size());
+	vector <size_t> prev(jobs.size(), SIZE_MAX);
+	size_t last= SIZE_MAX;
+	for (size_t i= 0;  i < jobs.size();  ++i) {
+		double before= 0;
+		for (size_t j:  jobs[i].deps) {
+			if (length[j] > before || prev[i] == SIZE_MAX) {
+				before= length[j];
+				prev[i]= j;
+			}
+		}
+		length[i]= before + max(jobs[i].duration, 0.0);
+		if (last == SIZE_MAX || length[i] > length[last])
+			last= i;
+	}
+
+	printf("PLAN  makespan = %.3f s with %ld job slot%s\n",
+	       simulate(slots), slots, slots == 1 ? "" : "s");
+
+	vector <size_t> path;
+	for (size_t i= last;  i != SIZE_MAX;  i= prev[i])
+		path.push_back(i);
+	printf("PLAN  critical path = %.3f s:",
+	       last == SIZE_MAX ? 0.0 : length[last]);
+	for (auto i= path.rbegin();  i != path.rend();  ++i)
+		printf(" %s", jobs[*i].name.c_str());
+	printf("\n");
+}
+
+double Plan::simulate(long slots)
+{
+	vector <vector <size_t> > dependents(jobs.size());
+	vector <size_t> count_waiting(jobs.size());
+	priority_queue <size_t, vector <size_t>, greater <size_t> > ready;
+	for (size_t i= 0;  i < jobs.size();  ++i) {
+		for (size_t j:  jobs[i].deps)
+			dependents[j].push_back(i);
+		count_waiting[i]= jobs[i].deps.size();
+		if (count_waiting[i] == 0)
+			ready.push(i);
+	}
+
+	/* Running jobs by their end time */
+	typedef pair <double, size_t> Running;
+	priority_queue <Running, vector <Running>, greater <Running> > running;
+
+	double time= 0;
+	while (! ready.empty() || ! running.empty()) {
+		while ((long) running.size() < slots && ! ready.empty()) {
+			size_t i= ready.top();
+			ready.pop();
+			running.push(Running(time + max(jobs[i].duration, 0.0), i));
+		}
+		Running r= running.top();
+		running.pop();
+		time= r.first;
+		for (size_t j:  dependents[r.second]) {
+			if (-- count_waiting[j] == 0)
+				ready.push(j);
+		}
+	}
+	return time;
+}
+
+#endif /* ! PLAN_HH */
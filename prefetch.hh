@@ -0,0 +1,301 @@
+#ifndef PREFETCH_HH
+#define PREFETCH_HH
+
+/*
+ * Graph expansion by a pool of threads (the -X option).  When
+ * dependencies are pushed to the buffer of an execution, their names
+ * are queued, and the threads match them against the parametrized
+ * rules and call stat(2) on their files, such that the results are
+ * usually available by the time the main thread reaches these
+ * dependencies.  With many parametrized rules, or on a file system
+ * with a high latency, e.g., a network file system, this avoids that
+ * the main thread does this work for each dependency in turn while job
+ * slots are free.
+ *
+ * The threads only read the rule set, which is not changed after the
+ * rules are read, and call stat(2); the execution graph, errors and
+ * jobs are handled only by the main thread, which also instantiates
+ * the matched rules.  Each result is used at most once.  Results of
+ * stat(2) are discarded each time a job is started or has terminated,
+ * as a job may change files, and the result for a file is discarded
+ * when the main thread itself writes or removes the file; a result is
+ * thus never older than the last change of the file by Stu.  Matches
+ * only depend on the rules, and are never discarded.
+ *
+ * The threads are paused while a job is forked, such that no thread
+ * holds a lock of the memory allocator at the time of fork(), which
+ * would block the child process if it allocates memory before exec().
+ */
+
+#include <signal.h>
+#include <sys/stat.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "error.hh"
+
+class Rule;
+class Place_Param_Target;
+
+class Prefetch
+{
+public:
+
+	struct Match
+	/* The minimal matching parametrized rules for a name; element
+	 * [0] is the best rule */
+	{
+		vector <shared_ptr <const Rule> > rules;
+		vector <map <string, string> > mappings;
+		vector <vector <size_t> > anchorings;
+		vector <shared_ptr <const Place_Param_Target> > place_param_targets;
+
+		unsigned long count= 0;
+		/* Number of targets of rules that were tried */
+	};
+
+	typedef void (*Matcher)(const string &name, bool transient, Match &match);
+	/* Match a name against the parametrized rules.  Must not print
+	 * errors or change global state.  */
+
+	static void start(long count, Matcher matcher);
+	/* Start the given number of threads (-X) */
+
+	static bool is_used()  {  return state != nullptr;  }
+
+	static void request(const string &name, bool transient, bool match);
+	/* Queue the name for stat(2) (when it is a file) and for
+	 * matching (when MATCH is true) */
+
+	static bool get(const char *filename, struct stat *buf, int &ret);
+	/* When a current result for FILENAME is available, write it into
+	 * BUF and RET (and errno) as stat(2) would, and return true.  */
+
+	static bool get_match(const string &name, bool transient, Match &match);
+	/* When the rules matching NAME are available, move them into
+	 * MATCH and return true */
+
+	static void invalidate();
+	/* Discard all results of stat(2), because files may have been
+	 * changed */
+
+	static void forget(const char *filename);
+	/* The file is being changed by the main thread */
+
+	static void pause();
+	/* Wait until no thread is working, and don't start new work
+	 * until resume() is called; used around fork() */
+
+	static void resume();
+
+private:
+
+	struct Entry
+	{
+		int err; /* errno of stat(2), or 0 */
+		struct stat buf;
+	};
+
+	struct Request
+	{
+		string name;
+		bool transient, match;
+	};
+
+	struct State
+	/* Shared with the threads; all members are protected by MUTEX */
+	{
+		std::mutex mutex;
+		std::condition_variable condition;
+		/* Notified on new requests, and when resumed */
+
+		std::condition_variable condition_idle;
+		/* Notified when BUSY becomes zero */
+
+		deque <Request> requests;
+		unordered_map <string, Entry> results;
+		unordered_map <string, Match> matches[2];
+		/* Indexed by whether the name is transient */
+
+		Matcher matcher;
+
+		unsigned long generation;
+		/* Incremented each time results are invalidated */
+
+		int busy;
+		/* Number of threads that are working */
+
+		bool paused;
+	};
+
+	static State *state;
+	/* Never deleted, as the threads are not joined at exit */
+
+	static const size_t MAX_REQUESTS= 1 << 16;
+	/* Further requests are ignored while the queue is full, and
+	 * further results while that many results are unused */
+
+	static void run();
+	/* The main function of each thread */
+
+	static void work(std::unique_lock <std::mutex> &lock);
+	/* Handle the first request.  The lock is held on entry and on
+	 * return, and all memory used for the request is freed before
+	 * returning.  */
+};
+
+Prefetch::State *Prefetch::state= nullptr;
+
+void Prefetch::start(long count, Matcher matcher)
+{
+	assert(count > 0);
+	state= new State;
+	state->matcher= matcher;
+	state->generation= 0;
+	state->busy= 0;
+	state->paused= false;
+
+	/* The threads are started with all signals blocked, such that
+	 * signals are handled by the main thread */
+	sigset_t set, set_old;
+	sigfillset(&set);
+	if (0 != pthread_sigmask(SIG_SETMASK, &set, &set_old)) {
+		print_error_system("pthread_sigmask");
+		exit(ERROR_FATAL);
+	}
+	for (long i= 0;  i < count;  ++i) {
+		try {
+			std::thread(run).detach();
+		} catch (std::system_error &e) {
+			print_error(fmt("Cannot start thread: %s", e.what()));
+			exit(ERROR_FATAL);
+		}
+	}
+	if (0 != pthread_sigmask(SIG_SETMASK, &set_old, nullptr)) {
+		print_error_system("pthread_sigmask");
+		exit(ERROR_FATAL);
+	}
+}
+
+void Prefetch::request(const string &name, bool transient, bool match)
+{
+	if (transient && ! match)
+		return;
+	{
+		std::lock_guard <std::mutex> lock(state->mutex);
+		if (state->requests.size() >= MAX_REQUESTS)
+			return;
+		state->requests.push_back(Request{name, transient, match});
+	}
+	state->condition.notify_one();
+}
+
+bool Prefetch::get(const char *filename, struct stat *buf, int &ret)
+{
+	std::lock_guard <std::mutex> lock(state->mutex);
+	auto i= state->results.find(filename);
+	if (i == state->results.end())
+		return false;
+	if (i->second.err) {
+		errno= i->second.err;
+		ret= -1;
+	} else {
+		*buf= i->second.buf;
+		ret= 0;
+	}
+	state->results.erase(i);
+	return true;
+}
+
+bool Prefetch::get_match(const string &name, bool transient, Match &match)
+{
+	std::lock_guard <std::mutex> lock(state->mutex);
+	auto i= state->matches[transient].find(name);
+	if (i == state->matches[transient].end())
+		return false;
+	match= move(i->second);
+	state->matches[transient].erase(i);
+	return true;
+}
+
+void Prefetch::invalidate()
+{
+	std::lock_guard <std::mutex> lock(state->mutex);
+	++ state->generation;
+	state->results.clear();
+}
+
+void Prefetch::forget(const char *filename)
+{
+	std::lock_guard <std::mutex> lock(state->mutex);
+	/* A stat(2) of the file may be running */
+	++ state->generation;
+	state->results.erase(filename);
+}
+
+void Prefetch::pause()
+{
+	std::unique_lock <std::mutex> lock(state->mutex);
+	state->paused= true;
+	state->condition_idle.wait(lock, [] {
+			return state->busy == 0;
+		});
+}
+
+void Prefetch::resume()
+{
+	{
+		std::lock_guard <std::mutex> lock(state->mutex);
+		state->paused= false;
+	}
+	state->condition.notify_all();
+}
+
+void Prefetch::run()
+{
+	std::unique_lock <std::mutex> lock(state->mutex);
+	while (true) {
+		state->condition.wait(lock, [] {
+				return ! state->requests.empty() && ! state->paused;
+			});
+		++ state->busy;
+		work(lock);
+		if (-- state->busy == 0)
+			state->condition_idle.notify_all();
+	}
+}
+
+void Prefetch::work(std::unique_lock <std::mutex> &lock)
+{
+	Request request= move(state->requests.front());
+	state->requests.pop_front();
+	bool do_stat= ! request.transient && ! state->results.count(request.name);
+	bool do_match= request.match && ! state->matches[request.transient].count(request.name);
+	unsigned long generation= state->generation;
+	lock.unlock();
+
+	Entry entry;
+	if (do_stat)
+		entry.err= stat(request.name.c_str(), &entry.buf) == 0 ? 0 : errno;
+	Match match;
+	if (do_match)
+		state->matcher(request.name, request.transient, match);
+
+	lock.lock();
+	bool full= state->results.size() + state->matches[0].size()
+		+ state->matches[1].size() >= MAX_REQUESTS;
+	/* Files may have changed during the call */
+	if (do_stat && state->generation == generation && ! full)
+		state->results[request.name]= entry;
+	if (do_match && ! full)
+		state->matches[request.transient][request.name]= move(match);
+}
+
+#endif /* ! PREFETCH_HH */
@@ -0,0 +1,49 @@
+#ifndef PROBE_HH
+#define PROBE_HH
+
+/*
+ * Static tracepoints (USDT probes) at the main events of Stu, for use
+ * with bpftrace, perf, SystemTap, etc.  The provider name is "stu".
+ * Enabled at compile time when the header <sys/sdt.h> from SystemTap is
+ * found by 'configure', or explicitly with -DUSE_SDT=1.  An enabled probe is a single no-op
+ * instruction when no tracer is attached; its arguments are however
+ * always evaluated, and are therefore chosen to be cheap.  When
+ * disabled, probes and their arguments compile to nothing.
+ *
+ * Strings are passed as 'const char *', durations as 'long' in
+ * microseconds.  Executions are identified by their address.
+ *
+ * PROBE		ARGUMENTS
+ * execution_create	execution, target name ("" for uncached
+ *			executions)
+ * rule_match		target name, result (0 = no rule, 1 =
+ *			unparametrized rule, 2 = parametrized rule)
+ * stat			filename, errno (0 on success)
+ * job_start		PID, target name
+ * job_reap		PID, wait status, duration
+ * dynamic_read		filename, number of dependencies read
+ * disconnect		parent execution, child execution, error of child
+ *
+ * Example:
+ *
+ *	bpftrace -e 'usdt:./stu:stu:job_reap { @[arg0]= arg2; }'
+ */
+
+#ifndef USE_SDT
+#   ifdef HAVE_SYS_SDT_H
+#      define USE_SDT 1
+#   else
+#      define USE_SDT 0
+#   endif
+#endif
+
+#if USE_SDT
+#   include <sys/sdt.h>
+#   define STU_PROBE2(name, a, b)     DTRACE_PROBE2(stu, name, a, b)
+#   define STU_PROBE3(name, a, b, c)  DTRACE_PROBE3(stu, name, a, b, c)
+#else
+#   define STU_PROBE2(name, a, b)
+#   define STU_PROBE3(name, a, b, c)
+#endif /* ! USE_SDT */
+
+#endif /* ! PROBE_HH */
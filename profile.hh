@@ -0,0 +1,189 @@
+#ifndef PROFILE_HH
+#define PROFILE_HH
+
+/*
+ * Per-rule profile of the jobs, output as part of the statistics (-z
+ * and -Z).  Jobs are grouped by the rule they were instantiated from,
+ * i.e., by the parametrized rule, such that all jobs of a single
+ * parametrized rule are counted together.  For each rule, the number
+ * of jobs, the number of failed jobs, and the number of times a
+ * target of the rule was found to be up to date (so that its command
+ * did not have to be run) are counted, and the total, mean and 95th
+ * percentile of the wall time and CPU time of the jobs are computed.
+ * Rules are output in order of decreasing total wall time.
+ *
+ * Data is only collected when statistics are enabled.
+ */
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "rule.hh"
+
+class Profile
+{
+public:
+
+	static void job(const Rule *param_rule, double time_wall,
+			double time_cpu, bool success);
+	/* A job of the given rule was waited for */
+
+	static void up_to_date(const Rule *param_rule);
+	/* The targets of the given rule were up to date */
+
+	static void print();
+	/* Output on standard output, in the -z format */
+
+	static void print_json(FILE *file);
+	/* Output as a member of a JSON object, followed by a comma */
+
+private:
+
+	struct Entry
+	{
+		const Rule *rule;
+		size_t count_fail, count_up_to_date;
+		vector <double> times_wall, times_cpu;
+
+		Entry(const Rule *rule_)
+			:  rule(rule_), count_fail(0), count_up_to_date(0)  {  }
+
+		double total_wall() const {
+			double ret= 0;
+			for (double t:  times_wall)  ret += t;
+			return ret;
+		}
+	};
+
+	static unordered_map <const Rule *, Entry> entries;
+
+	static Entry &get(const Rule *param_rule);
+
+	static vector <const Entry *> sorted();
+	/* All entries, by decreasing total wall time */
+
+	static string format_place(const Rule *rule);
+
+	static void summarize(const vector <double> &times,
+			      double &total, double &mean, double &p95);
+};
+
+unordered_map <const Rule *, Profile::Entry> Profile::entries;
+
+void Profile::job(const Rule *param_rule, double time_wall,
+		  double time_cpu, bool success)
+{
+	if (! Statistics::enabled)
+		return;
+	assert(param_rule);
+	Entry &entry= get(param_rule);
+	entry.times_wall.push_back(time_wall);
+	entry.times_cpu.push_back(time_cpu);
+	if (! success)
+		++ entry.count_fail;
+}
+
+void Profile::up_to_date(const Rule *param_rule)
+{
+	if (! Statistics::enabled || param_rule == nullptr)
+		return;
+	++ get(param_rule).count_up_to_date;
+}
+
+Profile::Entry &Profile::get(const Rule *param_rule)
+{
+	auto i= entries.find(param_rule);
+	if (i == entries.end())
+		i= entries.insert(make_pair(param_rule, Entry(param_rule))).first;
+	return i->second;
+}
+
+vector <const Profile::Entry *> Profile::sorted()
+{
+	vector <pair <double, const Entry *> > totals;
+	for (auto &i:  entries)
+		totals.push_back(make_pair(i.second.total_wall(), &i.second));
+	stable_sort(totals.begin(), totals.end(),
+		    [](const pair <double, const Entry *> &a,
+		       const pair <double, const Entry *> &b) {
+			    return a.first > b.first;
+		    });
+	vector <const Entry *> ret;
+	for (auto &i:  totals)
+		ret.push_back(i.second);
+	return ret;
+}
+
+string Profile::format_place(const Rule *rule)
+{
+	const Place &place= rule->place;
+	if (place.get_type() == Place::Type::INPUT_FILE)
+		return frmt("%s:%zu:%zu", place.get_filename_str(),
+			    place.line, place.column + 1);
+	return place.as_argv0();
+}
+
+void Profile::summarize(const vector <double> &times,
+			double &total, double &mean, double &p95)
+{
+	total= mean= p95= 0;
+	if (times.empty())
+		return;
+	for (double t:  times)
+		total += t;
+	mean= total / times.size();
+	/* Nearest-rank percentile */
+	vector <double> times_sorted= times;
+	sort(times_sorted.begin(), times_sorted.end());
+	size_t k= (95 * times_sorted.size() + 99) / 100;
+	assert(k >= 1 && k <= times_sorted.size());
+	p95= times_sorted[k - 1];
+}
+
+void Profile::print()
+{
+	for (const Entry *entry:  sorted()) {
+		double wall_total, wall_mean, wall_p95;
+		double cpu_total, cpu_mean, cpu_p95;
+		summarize(entry->times_wall, wall_total, wall_mean, wall_p95);
+		summarize(entry->times_cpu, cpu_total, cpu_mean, cpu_p95);
+		printf("STATISTICS  rule %s %s:  "
+		       "jobs = %zu (%zu failed), up to date = %zu, "
+		       "wall time total = %.6f s, mean = %.6f s, p95 = %.6f s, "
+		       "CPU time total = %.6f s, mean = %.6f s, p95 = %.6f s\n",
+		       format_place(entry->rule).c_str(),
+		       entry->rule->place_param_targets[0]->format_src().c_str(),
+		       entry->times_wall.size(), entry->count_fail,
+		       entry->count_up_to_date,
+		       wall_total, wall_mean, wall_p95,
+		       cpu_total, cpu_mean, cpu_p95);
+	}
+}
+
+void Profile::print_json(FILE *file)
+{
+	fprintf(file, "\"rules\": [");
+	bool first= true;
+	for (const Entry *entry:  sorted()) {
+		double wall_total, wall_mean, wall_p95;
+		double cpu_total, cpu_mean, cpu_p95;
+		summarize(entry->times_wall, wall_total, wall_mean, wall_p95);
+		summarize(entry->times_cpu, cpu_total, cpu_mean, cpu_p95);
+		fprintf(file, "%s\n  {\"place\": %s, \"target\": %s, "
+			"\"jobs\": %zu, \"failed\": %zu, \"up_to_date\": %zu, "
+			"\"wall\": {\"total\": %.6f, \"mean\": %.6f, \"p95\": %.6f}, "
+			"\"cpu\": {\"total\": %.6f, \"mean\": %.6f, \"p95\": %.6f}}",
+			first ? "" : ",",
+			name_format_json(format_place(entry->rule)).c_str(),
+			name_format_json(entry->rule->place_param_targets[0]->format_src()).c_str(),
+			entry->times_wall.size(), entry->count_fail,
+			entry->count_up_to_date,
+			wall_total, wall_mean, wall_p95,
+			cpu_total, cpu_mean, cpu_p95);
+		first= false;
+	}
+	fprintf(file, "],\n");
+}
+
+#endif /* ! PROFILE_HH */
@@ -0,0 +1,329 @@
+#ifndef PROGRESS_HH
+#define PROGRESS_HH
+
+/*
+ * Machine-readable progress of the build, for polling by other
+ * programs (the -S option).  A JSON object is written into the given
+ * file each time a job is started or has terminated, and when Stu
+ * exits.  The file is written under a temporary name and then renamed,
+ * such that readers always see a complete file.  The object contains:
+ *
+ *   - The number of jobs started, succeeded and failed
+ *   - The running jobs, with their start time and elapsed time
+ *   - The number of queued targets, i.e., targets with a command for
+ *     which no job has been started yet, and which have not been found
+ *     to be up to date.  Queued targets may still turn out to be up to
+ *     date.
+ *   - An estimate of the remaining time, based on the durations of
+ *     jobs in previous runs (the -H option)
+ *
+ * Times are given as Unix times (CLOCK_REALTIME) and durations in
+ * seconds.
+ *
+ * The -H option names a file that contains the duration of the last job
+ * of each target.  It is read at startup if it exists, and written when
+ * Stu exits.  Each line contains a duration in seconds, a tab, and the
+ * target in Stu syntax.  The -H option can be used independently of -S.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include <unordered_map>
+#include <unordered_set>
+
+#include "format.hh"
+
+class Progress
+{
+public:
+
+	static void open(const char *filename_);
+	/* Write the progress into the given file (-S) */
+
+	static void start(long jobs);
+	/* The build starts, with the given number of job slots */
+
+	static void history_read(const char *filename_history_);
+	/* Read the durations from the given file, and write them back
+	 * into it at the end (-H) */
+
+	static bool is_used() {
+		return filename != nullptr || filename_history != nullptr;
+	}
+
+	static void queued(string name);
+	/* A target with a command was found */
+
+	static void up_to_date(string name);
+	/* A queued target was found to be up to date */
+
+	static void job_started(pid_t pid, string name);
+	static void job_waited(pid_t pid, bool success);
+
+	static void finish(int error);
+	/* Write the final state into the progress file, and write the
+	 * history file */
+
+	static void write();
+	/* Write the progress file, if used */
+
+	static double duration(string name);
+	/* The recorded duration, or -1 when unknown */
+
+	static double now(clockid_t clock);
+	/* The time of the given clock in seconds */
+
+private:
+
+	struct Running
+	{
+		string name;
+		double begin, begin_real;
+	};
+
+	static const char *filename, *filename_history;
+
+	static size_t count_started, count_succeeded, count_failed;
+
+	static unordered_map <pid_t, Running> running;
+
+	static unordered_set <string> names_queued;
+	static size_t count_queued_unknown;
+	static double duration_queued;
+	/* The queued targets, the number of them for which the duration
+	 * is unknown, and the sum of the known durations */
+
+	static long slots;
+
+	static unordered_map <string, double> durations;
+	/* From the history, updated with the durations in this run */
+
+	static double time_begin_real;
+
+	static void write(int error);
+	/* ERROR is -1 while Stu is running */
+
+	static void history_write();
+};
+
+const char *Progress::filename= nullptr;
+const char *Progress::filename_history= nullptr;
+size_t Progress::count_started= 0;
+size_t Progress::count_succeeded= 0;
+size_t Progress::count_failed= 0;
+unordered_map <pid_t, Progress::Running> Progress::running;
+unordered_set <string> Progress::names_queued;
+size_t Progress::count_queued_unknown= 0;
+double Progress::duration_queued= 0;
+unordered_map <string, double> Progress::durations;
+double Progress::time_begin_real;
+long Progress::slots= 1;
+
+void Progress::open(const char *filename_)
+{
+	filename= filename_;
+}
+
+void Progress::start(long jobs)
+{
+	slots= jobs;
+	time_begin_real= now(CLOCK_REALTIME);
+	write();
+}
+
+void Progress::history_read(const char *filename_history_)
+{
+	filename_history= filename_history_;
+	FILE *file= fopen(filename_history, "r");
+	if (file == nullptr) {
+		if (errno == ENOENT)
+			return;
+		print_error_system(filename_history);
+		exit(ERROR_FATAL);
+	}
+	char *line= nullptr;
+	size_t n= 0;
+	ssize_t len;
+	while ((len= getline(&line, &n, file)) >= 0) {
+		if (len > 0 && line[len - 1] == '\n')
+			line[--len]= '\0';
+		char *tab= strchr(line, '\t');
+		if (tab == nullptr)
+			continue;
+		*tab= '\0';
+		char *endptr;
+		double d= strtod(line, &endptr);
+		if (*endptr != '\0' || d < 0 || tab[1] == '\0')
+			continue;
+		durations[tab + 1]= d;
+	}
+	free(line);
+	if (ferror(file)) {
+		print_error_system(filename_history);
+		exit(ERROR_FATAL);
+	}
+	fclose(file);
+}
+
+void Progress::queued(string name)
+{
+	if (! is_used() || ! names_queued.insert(name).second)
+		return;
+	double d= duration(name);
+	if (d < 0)
+		++ count_queued_unknown;
+	else
+		duration_queued += d;
+}
+
+void Progress::up_to_date(string name)
+{
+	if (! is_used() || ! names_queued.erase(name))
+		return;
+	double d= duration(name);
+	if (d < 0)
+		-- count_queued_unknown;
+	else
+		duration_queued -= d;
+}
+
+void Progress::job_started(pid_t pid, string name)
+{
+	if (! is_used())
+		return;
+	up_to_date(name);
+	++ count_started;
+	running[pid]= Running{name, now(CLOCK_MONOTONIC), now(CLOCK_REALTIME)};
+	write();
+}
+
+void Progress::job_waited(pid_t pid, bool success)
+{
+	if (! is_used())
+		return;
+	auto i= running.find(pid);
+	if (i == running.end())
+		return;
+	if (success) {
+		++ count_succeeded;
+		durations[i->second.name]= now(CLOCK_MONOTONIC) - i->second.begin;
+	} else {
+		++ count_failed;
+	}
+	running.erase(i);
+	write();
+}
+
+void Progress::finish(int error)
+{
+	write(error);
+	if (filename_history)
+		history_write();
+}
+
+void Progress::write()
+{
+	write(-1);
+}
+
+double Progress::now(clockid_t clock)
+{
+	struct timespec t;
+	if (clock_gettime(clock, &t) < 0) {
+		print_error_system("clock_gettime");
+		return 0;
+	}
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+double Progress::duration(string name)
+{
+	auto i= durations.find(name);
+	return i == durations.end() ? -1 : i->second;
+}
+
+void Progress::write(int error)
+{
+	if (filename == nullptr)
+		return;
+
+	string filename_tmp= frmt("%s.%ld.tmp", filename, (long) getpid());
+	FILE *file= fopen(filename_tmp.c_str(), "w");
+	if (file == nullptr) {
+		print_error_system(filename_tmp);
+		return;
+	}
+
+	double time_real= now(CLOCK_REALTIME), time_mono= now(CLOCK_MONOTONIC);
+
+	/* The remaining time:  the queued targets and the remaining time
+	 * of running jobs, divided among the job slots.  Targets
+	 * without a recorded duration are not counted. */
+	double remaining= duration_queued;
+	for (auto &i:  running) {
+		double d= duration(i.second.name);
+		double elapsed= time_mono - i.second.begin;
+		if (d > elapsed)
+			remaining += d - elapsed;
+	}
+	fprintf(file, "{\n\"version\": \"%s\",\n\"pid\": %ld,\n"
+		"\"time\": %.3f,\n\"start\": %.3f,\n\"finished\": %s,\n",
+		STU_VERSION, (long) getpid(),
+		time_real, time_begin_real, error >= 0 ? "true" : "false");
+	if (error >= 0)
+		fprintf(file, "\"exit_status\": %d,\n", error);
+	fprintf(file, "\"jobs\": {\"started\": %zu, \"succeeded\": %zu, "
+		"\"failed\": %zu, \"running\": %zu},\n",
+		count_started, count_succeeded, count_failed, running.size());
+	fprintf(file, "\"running\": [");
+	bool first= true;
+	for (auto &i:  running) {
+		fprintf(file, "%s\n  {\"pid\": %ld, \"target\": %s, "
+			"\"start\": %.3f, \"elapsed\": %.3f}",
+			first ? "" : ",", (long) i.first,
+			name_format_json(i.second.name).c_str(),
+			i.second.begin_real, time_mono - i.second.begin);
+		first= false;
+	}
+	fprintf(file, "],\n\"queued\": %zu,\n\"queued_unknown\": %zu,\n",
+		names_queued.size(), count_queued_unknown);
+	if (filename_history && error < 0)
+		fprintf(file, "\"eta\": %.3f\n}\n", remaining / slots);
+	else
+		fprintf(file, "\"eta\": null\n}\n");
+
+	if (ferror(file) || fclose(file)) {
+		print_error_system(filename_tmp);
+		unlink(filename_tmp.c_str());
+		return;
+	}
+	if (rename(filename_tmp.c_str(), filename) < 0) {
+		print_error_system(filename);
+		unlink(filename_tmp.c_str());
+	}
+}
+
+void Progress::history_write()
+{
+	string filename_tmp= frmt("%s.%ld.tmp", filename_history, (long) getpid());
+	FILE *file= fopen(filename_tmp.c_str(), "w");
+	if (file == nullptr) {
+		print_error_system(filename_tmp);
+		return;
+	}
+	for (auto &i:  durations)
+		if (i.first.find('\n') == string::npos)
+			fprintf(file, "%.6f\t%s\n", i.second, i.first.c_str());
+	if (ferror(file) || fclose(file)) {
+		print_error_system(filename_tmp);
+		unlink(filename_tmp.c_str());
+		return;
+	}
+	if (rename(filename_tmp.c_str(), filename_history) < 0) {
+		print_error_system(filename_history);
+		unlink(filename_tmp.c_str());
+	}
+}
+
+#endif /* ! PROGRESS_HH */
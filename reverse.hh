@@ -0,0 +1,432 @@
+#ifndef REVERSE_HH
+#define REVERSE_HH
+
+/*
+ * The reverse-dependency index (the -R option).  Stu records in the
+ * given file the direct dependencies of each target that was expanded,
+ * as well as the names of the files from which rules and dynamic
+ * dependencies were read.  The file is read at startup if it exists,
+ * and written when Stu succeeds.  The dependencies of targets that were
+ * not expanded in the current run are kept from the previous content of
+ * the file.  When Stu fails, the file is removed, because the
+ * dependencies of targets whose expansion was interrupted are not
+ * known.
+ *
+ * With -u, the changed files are read from the given file (one name per
+ * line, or from standard input for '-'), and all targets that depend
+ * on them directly or indirectly are the affected targets.  Empty and
+ * '.' components are removed from the names, and absolute names of
+ * files below the current directory are made relative, such that they
+ * match the names used in rules.  A target
+ * that is contained in the index, that is not affected and whose file
+ * targets exist is then considered up to date without visiting its
+ * dependencies.  Targets that are not in the index are handled as
+ * usual.  When the index does not exist, or when a changed file is a
+ * file from which rules or dynamic dependencies were read, the whole
+ * graph is visited as without -u.
+ *
+ * The file consists of records, each being a list of \0-terminated
+ * strings, followed by an additional \0.  The first string is the type
+ * of the record:
+ *
+ *	T TARGET DEPENDENCY...	The direct dependencies of a target
+ *	R FILENAME		A file from which rules were read
+ *	Y FILENAME		A file from which dynamic dependencies
+ *				were read
+ *
+ * Targets are given by their name for files, and with a prefixed '@'
+ * for transients.
+ *
+ * In watch mode (-w), the index is also kept in memory, without -R: each
+ * build passes its records to the next one, which is given the files
+ * changed in between as with -u.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <unordered_map>
+#include <unordered_set>
+
+#include "error.hh"
+#include "format.hh"
+#include "target.hh"
+
+class Reverse_Index
+{
+public:
+
+	static void open(const char *filename_);
+	/* Read the index from the given file if it exists, and write it
+	 * back at the end (-R) */
+
+	static void changed(const char *filename_changed);
+	/* Read the changed files (-u); must be called after open() */
+
+	static void invalidate(const string &index,
+			       const unordered_set <string> *names_changed);
+	/* In watch mode, before each build:  replace the index by the
+	 * records of the previous build, and affect the targets that
+	 * depend on NAMES_CHANGED, or all targets when it is null */
+
+	static string records();
+	/* The index as records, without the files from which rules
+	 * were read */
+
+	static bool is_used() {  return filename != nullptr || watching;  }
+
+	static bool is_querying() {  return querying;  }
+
+	static bool is_pruned(const vector <Target> &targets);
+	/* Whether the given targets of an execution are all known and
+	 * not affected by the changed files */
+
+	static void expanded(const vector <Target> &targets);
+	/* The dependencies of the given targets are being expanded; they
+	 * replace those from the previous run */
+
+	static void edge(const Target &target, const vector <Target> &deps);
+	/* TARGET depends directly on DEPS */
+
+	static void dynamic(string filename_dynamic);
+	/* Dynamic dependencies were read from the given file */
+
+	static void finish(int error, const vector <string> &filenames_rules);
+	/* Write the index, or remove it on error */
+
+private:
+
+	static const char *filename;
+
+	static bool querying;
+	/* Whether the affected targets are known (-u) */
+
+	static bool watching;
+	/* The index is kept between the builds of watch mode (-w) */
+
+	static unordered_map <string, unordered_set <string> > deps;
+	/* Direct dependencies by target, from the previous run and
+	 * replaced by those expanded in this run */
+
+	static unordered_set <string> filenames_dynamic, filenames_rules;
+
+	static unordered_set <string> known, affected;
+
+	static string key(const Target &target);
+
+	static string name_normalized(const string &name);
+	/* Remove empty and '.' components, and the current directory
+	 * from an absolute name.  '..' is kept, as it may follow a
+	 * symlink.  */
+
+	static void read();
+
+	static bool parse(const string &content);
+	/* Add the records in CONTENT to the index.  Return false when
+	 * they are invalid.  */
+
+	static void affect(const vector <string> &names);
+	/* Set the affected targets, given the changed files */
+
+	static void reset();
+
+	static void write(const vector <string> &filenames_rules_new);
+};
+
+const char *Reverse_Index::filename= nullptr;
+bool Reverse_Index::querying= false;
+bool Reverse_Index::watching= false;
+unordered_map <string, unordered_set <string> > Reverse_Index::deps;
+unordered_set <string> Reverse_Index::filenames_dynamic;
+unordered_set <string> Reverse_Index::filenames_rules;
+unordered_set <string> Reverse_Index::known;
+unordered_set <string> Reverse_Index::affected;
+
+void Reverse_Index::open(const char *filename_)
+{
+	filename= filename_;
+	read();
+}
+
+void Reverse_Index::changed(const char *filename_changed)
+{
+	assert(filename != nullptr);
+
+	bool is_stdin= ! strcmp(filename_changed, "-");
+	FILE *file= is_stdin ? stdin : fopen(filename_changed, "r");
+	if (file == nullptr) {
+		print_error_system(filename_changed);
+		exit(ERROR_FATAL);
+	}
+	vector <string> names;
+	char *line= nullptr;
+	size_t n= 0;
+	ssize_t len;
+	while ((len= getline(&line, &n, file)) >= 0) {
+		if (len > 0 && line[len - 1] == '\n')
+			line[--len]= '\0';
+		if (len > 0)
+			names.push_back(name_normalized(string(line, len)));
+	}
+	free(line);
+	if (ferror(file)) {
+		print_error_system(filename_changed);
+		exit(ERROR_FATAL);
+	}
+	if (! is_stdin)
+		fclose(file);
+
+	affect(names);
+}
+
+string Reverse_Index::name_normalized(const string &name)
+{
+	string ret= name[0] == '/' ? "/" : "";
+	for (size_t i= 0;  i < name.size(); ) {
+		size_t j= name.find('/', i);
+		if (j == string::npos)
+			j= name.size();
+		string component= name.substr(i, j - i);
+		if (! component.empty() && component != ".") {
+			if (! ret.empty() && ret.back() != '/')
+				ret += '/';
+			ret += component;
+		}
+		i= j + 1;
+	}
+	if (ret.empty())
+		return ".";
+
+	if (ret[0] == '/') {
+		char *cwd= getcwd(nullptr, 0);
+		if (cwd) {
+			string prefix= cwd;
+			free(cwd);
+			if (prefix.back() != '/')
+				prefix += '/';
+			if (ret.size() > prefix.size()
+			    && ! ret.compare(0, prefix.size(), prefix))
+				ret= ret.substr(prefix.size());
+		}
+	}
+	return ret;
+}
+
+void Reverse_Index::invalidate(const string &index,
+			       const unordered_set <string> *names_changed)
+{
+	watching= true;
+	reset();
+	if (! parse(index)) {
+		reset();
+		return;
+	}
+	if (names_changed)
+		affect(vector <string> (names_changed->begin(), names_changed->end()));
+}
+
+string Reverse_Index::records()
+{
+	string ret;
+	for (auto &i:  deps) {
+		ret += "T";
+		ret += '\0';
+		ret += i.first;
+		ret += '\0';
+		for (const string &dep:  i.second) {
+			ret += dep;
+			ret += '\0';
+		}
+		ret += '\0';
+	}
+	for (const string &name:  filenames_dynamic) {
+		ret += "Y";
+		ret += '\0';
+		ret += name;
+		ret += '\0';
+		ret += '\0';
+	}
+	return ret;
+}
+
+void Reverse_Index::affect(const vector <string> &names)
+{
+	/* Without an index, or when rules or dynamic dependencies may
+	 * have changed, everything is visited */
+	if (known.empty())
+		return;
+	for (const string &name:  names)
+		if (filenames_rules.count(name) || filenames_dynamic.count(name))
+			return;
+
+	unordered_map <string, vector <const string *> > parents;
+	for (auto &i:  deps)
+		for (const string &dep:  i.second)
+			parents[dep].push_back(&i.first);
+
+	vector <string> todo(names);
+	while (! todo.empty()) {
+		string name= todo.back();
+		todo.pop_back();
+		if (! affected.insert(name).second)
+			continue;
+		auto i= parents.find(name);
+		if (i == parents.end())
+			continue;
+		for (const string *parent:  i->second)
+			if (! affected.count(*parent))
+				todo.push_back(*parent);
+	}
+	querying= true;
+}
+
+bool Reverse_Index::is_pruned(const vector <Target> &targets)
+{
+	if (! querying)
+		return false;
+	for (const Target &target:  targets) {
+		string k= key(target);
+		if (! known.count(k) || affected.count(k))
+			return false;
+	}
+	return true;
+}
+
+void Reverse_Index::expanded(const vector <Target> &targets)
+{
+	for (const Target &target:  targets) {
+		string k= key(target);
+		deps[k].clear();
+		known.insert(k);
+	}
+}
+
+void Reverse_Index::edge(const Target &target, const vector <Target> &deps_target)
+{
+	unordered_set <string> &d= deps[key(target)];
+	for (const Target &dep:  deps_target)
+		d.insert(key(dep));
+}
+
+void Reverse_Index::dynamic(string filename_dynamic)
+{
+	filenames_dynamic.insert(filename_dynamic);
+}
+
+void Reverse_Index::finish(int error, const vector <string> &filenames_rules_new)
+{
+	/* Watch mode without -R */
+	if (filename == nullptr)
+		return;
+	if (error) {
+		if (unlink(filename) < 0 && errno != ENOENT)
+			print_error_system(filename);
+		return;
+	}
+	write(filenames_rules_new);
+}
+
+string Reverse_Index::key(const Target &target)
+{
+	assert(target.is_file() || target.is_transient());
+	return target.is_transient()
+		? "@" + target.get_name_nondynamic()
+		: target.get_name_nondynamic();
+}
+
+void Reverse_Index::read()
+{
+	FILE *file= fopen(filename, "r");
+	if (file == nullptr) {
+		if (errno == ENOENT)
+			return;
+		print_error_system(filename);
+		exit(ERROR_FATAL);
+	}
+
+	string content;
+	char buf[0x1000];
+	size_t len;
+	while ((len= fread(buf, 1, sizeof(buf), file)) > 0)
+		content.append(buf, len);
+	if (ferror(file)) {
+		print_error_system(filename);
+		exit(ERROR_FATAL);
+	}
+	fclose(file);
+
+	if (! parse(content)) {
+		print_warning(Place(Place::Type::OPTION, 'R'),
+			      fmt("Ignoring invalid reverse dependency index %s",
+				  name_format_word(filename)));
+		reset();
+	}
+}
+
+bool Reverse_Index::parse(const string &content)
+{
+	/* The strings of the current record */
+	vector <string> record;
+	for (size_t i= 0;  i < content.size(); ) {
+		size_t j= content.find('\0', i);
+		if (j == string::npos)
+			return false;
+		if (j > i) {
+			record.push_back(content.substr(i, j - i));
+			i= j + 1;
+			continue;
+		}
+		i= j + 1;
+		if (record.size() >= 2 && record[0] == "T") {
+			unordered_set <string> &d= deps[record[1]];
+			known.insert(record[1]);
+			for (size_t k= 2;  k < record.size();  ++k) {
+				d.insert(record[k]);
+				known.insert(record[k]);
+			}
+		} else if (record.size() == 2 && record[0] == "R") {
+			filenames_rules.insert(record[1]);
+		} else if (record.size() == 2 && record[0] == "Y") {
+			filenames_dynamic.insert(record[1]);
+		} else {
+			return false;
+		}
+		record.clear();
+	}
+	return record.empty();
+}
+
+void Reverse_Index::reset()
+{
+	deps.clear();
+	known.clear();
+	affected.clear();
+	filenames_rules.clear();
+	filenames_dynamic.clear();
+	querying= false;
+}
+
+void Reverse_Index::write(const vector <string> &filenames_rules_new)
+{
+	string filename_tmp= frmt("%s.%ld.tmp", filename, (long) getpid());
+	FILE *file= fopen(filename_tmp.c_str(), "w");
+	if (file == nullptr) {
+		print_error_system(filename_tmp);
+		return;
+	}
+	string content= records();
+	fwrite(content.data(), 1, content.size(), file);
+	for (const string &name:  filenames_rules_new)
+		fprintf(file, "R%c%s%c%c", '\0', name.c_str(), '\0', '\0');
+	if (ferror(file) || fclose(file)) {
+		print_error_system(filename_tmp);
+		unlink(filename_tmp.c_str());
+		return;
+	}
+	if (rename(filename_tmp.c_str(), filename) < 0) {
+		print_error_system(filename);
+		unlink(filename_tmp.c_str());
+	}
+}
+
+#endif /* ! REVERSE_HH */
@@ -9,10 +9,13 @@
 
 #include "token.hh"
 #include "explain.hh"
+#include "probe.hh"
+#include "statistics.hh"
 
 class Rule
 /* A rule.  The class Rule allows parameters; there is no
  * "unparametrized rule" class.  */ 
+	:  private Counted <Rule>
 {
 public:
 	const vector <shared_ptr <const Place_Param_Target> > place_param_targets; 
@@ -129,6 +132,11 @@ public:
 	 * If the given rule has duplicate targets, print and throw a
 	 * logical error.  */ 
 
+	void add_memory(vector <Memory::Entry> &entries) const {
+		Memory::add_map(entries, "rules_unparametrized", rules_unparametrized); 
+	}
+	/* Add the memory statistics of the rule set */
+
 	shared_ptr <const Rule> get(Target target, 
 				    shared_ptr <const Rule> &param_rule,
 				    map <string, string> &mapping_parameter,
@@ -143,6 +151,23 @@ public:
 	 * case PARAM_RULE is never set.  PLACE is the place of the
 	 * dependency; used in error messages.  */ 
 
+	void match(const string &name, bool transient, Prefetch::Match &match) const;
+	/* Find the minimal matching parametrized rules for the name,
+	 * which is that of a transient target when TRANSIENT is true.
+	 * Does not print or throw errors, and does not change global
+	 * state, such that it can be called by the threads of -X.  */
+
+	bool has_unparametrized(Target target) const {
+		return rules_unparametrized.count(target); 
+	}
+	/* Whether there is an unparametrized rule for TARGET, with the
+	 * same requirements as for get() */
+
+	bool has_rule(Target target) const;
+	/* Whether at least one rule matches TARGET, with the same
+	 * requirements as for get().  Does not check whether the match
+	 * is unique, and never prints or throws errors.  */
+
 	void print() const;
 	/* Print the rule set to standard output, as used by the -P and
 	 * -d options */   
@@ -373,6 +398,29 @@ void Rule_Set::add(vector <shared_ptr <const Rule> > &rules_)
 	}
 }
 
+bool Rule_Set::has_rule(Target target) const
+{
+	assert(target.is_file() || target.is_transient()); 
+	assert((target.get_front_word() & ~F_TARGET_TRANSIENT) == 0); 
+
+	if (rules_unparametrized.count(target))
+		return true;
+
+	for (auto &rule:  rules_parametrized) {
+		for (auto &place_param_target:  rule->place_param_targets) {
+			if (target.get_front_word() != (place_param_target->flags & F_TARGET_TRANSIENT))
+				continue;
+			map <string, string> mapping;
+			vector <size_t> anchoring;
+			++ Statistics::count_match; 
+			if (place_param_target->place_name.match(target.get_name_nondynamic(), mapping, anchoring))
+				return true;
+		}
+	}
+
+	return false; 
+}
+
 shared_ptr <const Rule> Rule_Set::get(Target target, 
 				      shared_ptr <const Rule> &param_rule,
 				      map <string, string> &mapping_parameter,
@@ -382,6 +430,9 @@ shared_ptr <const Rule> Rule_Set::get(Target target,
 	assert((target.get_front_word() & ~F_TARGET_TRANSIENT) == 0); 
 	assert(mapping_parameter.size() == 0); 
 
+	Statistics::Timer timer(Statistics::PHASE_MATCH); 
+	++ Statistics::count_rule_get; 
+
 	/* Check for an unparametrized rule.  Since we keep them in a
 	 * map by target filename(s), there can only be a single matching rule to
 	 * begin with.  (I.e., if multiple unparametrized rules for the same
@@ -404,19 +455,66 @@ shared_ptr <const Rule> Rule_Set::get(Target target,
 #endif 
 
 		param_rule= rule; 
+		STU_PROBE2(rule_match, target.get_name_c_str_nondynamic(), 1);
 		return rule;
 	}
 
-	/* Search the best parametrized rule.  Since this implementation
-	 * does not have an index for parametrized rules, we simply
-	 * check all rules, and choose the best-fitting one.  This can
-	 * be optimized, but the optimization is not trivial.  */ 
+	/* Search the best parametrized rule, unless it was already
+	 * found by a thread of -X */ 
+	Prefetch::Match match_best; 
+	if (! Prefetch::is_used() || 
+	    ! Prefetch::get_match(target.get_name_nondynamic(), target.is_transient(), match_best))
+		match(target.get_name_nondynamic(), target.is_transient(), match_best); 
+	Statistics::count_match += match_best.count; 
+	vector <shared_ptr <const Rule> > &rules_best= match_best.rules;
+	vector <map <string, string> > &mappings_best= match_best.mappings; 
+	vector <shared_ptr <const Place_Param_Target> > &place_param_targets_best= 
+		match_best.place_param_targets; 
+
+	/* No rule matches */ 
+	if (rules_best.size() == 0) {
+		assert(rules_best.size() == 0); 
+		STU_PROBE2(rule_match, target.get_name_c_str_nondynamic(), 0);
+		return nullptr; 
+	}
+	assert(rules_best.size() >= 1);
+
+	/* More than one rule matches:  error */ 
+	if (rules_best.size() > 1) {
+		place << fmt("multiple minimal matching rules for target %s", target.format_word());
+		for (auto &place_param_target:  place_param_targets_best) {
+			place_param_target->place <<
+				fmt("rule with target %s", 
+				    place_param_target->format_word()); 
+		}
+		explain_minimal_matching_rule(); 
+		throw ERROR_LOGICAL; 
+	}
+	assert(rules_best.size() == 1); 
+
+	/* Instantiate the rule */ 
+	shared_ptr <const Rule> rule_best= rules_best[0];
+	swap(mapping_parameter, mappings_best[0]); 
+	shared_ptr <const Rule> ret(Rule::instantiate(rule_best, mapping_parameter));
+	param_rule= rule_best; 
+	STU_PROBE2(rule_match, target.get_name_c_str_nondynamic(), 2);
+	return ret;
+}
 
-	/* Element [0] corresponds to the best rule. */ 
-	vector <shared_ptr <const Rule> > rules_best;
-	vector <map <string, string> > mappings_best; 
-	vector <vector <size_t> > anchorings_best; 
-	vector <shared_ptr <const Place_Param_Target> > place_param_targets_best; 
+void Rule_Set::match(const string &name, bool transient, 
+		     Prefetch::Match &match) const
+{
+	/* Since this implementation does not have an index for
+	 * parametrized rules, we simply check all rules, and choose the
+	 * best-fitting one.  This can be optimized, but the
+	 * optimization is not trivial.  */ 
+
+	vector <shared_ptr <const Rule> > &rules_best= match.rules;
+	vector <map <string, string> > &mappings_best= match.mappings; 
+	vector <vector <size_t> > &anchorings_best= match.anchorings; 
+	vector <shared_ptr <const Place_Param_Target> > &place_param_targets_best= 
+		match.place_param_targets; 
+	const Flags flags= transient ? F_TARGET_TRANSIENT : 0; 
 
 	for (auto &rule:  rules_parametrized) {
 
@@ -428,11 +526,12 @@ shared_ptr <const Rule> Rule_Set::get(Target target,
 			vector <size_t> anchoring;
 
 			/* The parametrized rule is of another type */ 
-			if (target.get_front_word() != (place_param_target->flags & F_TARGET_TRANSIENT))
+			if (flags != (place_param_target->flags & F_TARGET_TRANSIENT))
 				continue;
 
 			/* The parametrized rule does not match */ 
-			if (! place_param_target->place_name.match(target.get_name_nondynamic(), mapping, anchoring))
+			++ match.count; 
+			if (! place_param_target->place_name.match(name, mapping, anchoring))
 				continue; 
 
 			assert(anchoring.size() == 
@@ -472,33 +571,6 @@ shared_ptr <const Rule> Rule_Set::get(Target target,
 		dont_add:;
 		}
 	}
-
-	/* No rule matches */ 
-	if (rules_best.size() == 0) {
-		assert(rules_best.size() == 0); 
-		return nullptr; 
-	}
-	assert(rules_best.size() >= 1);
-
-	/* More than one rule matches:  error */ 
-	if (rules_best.size() > 1) {
-		place << fmt("multiple minimal matching rules for target %s", target.format_word());
-		for (auto &place_param_target:  place_param_targets_best) {
-			place_param_target->place <<
-				fmt("rule with target %s", 
-				    place_param_target->format_word()); 
-		}
-		explain_minimal_matching_rule(); 
-		throw ERROR_LOGICAL; 
-	}
-	assert(rules_best.size() == 1); 
-
-	/* Instantiate the rule */ 
-	shared_ptr <const Rule> rule_best= rules_best[0];
-	swap(mapping_parameter, mappings_best[0]); 
-	shared_ptr <const Rule> ret(Rule::instantiate(rule_best, mapping_parameter));
-	param_rule= rule_best; 
-	return ret;
 }
 
 void Rule_Set::print() const
@@ -0,0 +1,319 @@
+#ifndef STATISTICS_HH
+#define STATISTICS_HH
+
+/*
+ * Run-time statistics about Stu itself, as output by the -z option and
+ * written as JSON by the -Z option.  The statistics about the jobs
+ * themselves are kept in the class Job.
+ *
+ * Stu's own run time is split into phases.  The phases are exclusive:
+ * when a phase is entered while another one is active, the time spent
+ * in the inner phase is not counted for the outer phase.  The wall
+ * time of a phase is measured with CLOCK_MONOTONIC, and the CPU time
+ * with CLOCK_PROCESS_CPUTIME_ID.  Time is only measured when
+ * statistics are enabled, as measuring the CPU time needs a system
+ * call each time a phase is entered or left.  The counters are always
+ * maintained, as they are cheap.
+ */
+
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include "daemon.hh"
+#include "error.hh"
+#include "prefetch.hh"
+#include "probe.hh"
+#include "timeline.hh"
+
+class Statistics
+{
+public:
+
+	enum Phase {
+		PHASE_OTHER= 0,	/* Everything not covered by another phase */
+		PHASE_PARSE,	/* Parsing of options, arguments and input files */
+		PHASE_MATCH,	/* Rule_Set::get() */
+		PHASE_EXPAND,	/* Building and traversing the dependency graph */
+		PHASE_STAT,	/* stat() calls on targets */
+		PHASE_DYNAMIC,	/* Reading dynamic dependencies */
+		PHASE_WAIT,	/* Waiting for jobs to terminate */
+		C_PHASE
+	};
+
+	enum {
+		E_ROOT= 0,
+		E_FILE,
+		E_TRANSIENT,
+		E_CONCAT,
+		E_DYNAMIC,
+		C_EXECUTION
+	};
+	/* Subclasses of Execution, for counting */
+
+	class Timer
+	/* Attribute the time during the lifetime of an object of this
+	 * type to the given phase. */
+	{
+	public:
+		Timer(Phase phase)
+			:  phase_outer(phase_current) {
+			if (enabled)
+				enter(phase);
+		}
+		~Timer() {
+			if (enabled)
+				enter(phase_outer);
+		}
+	private:
+		const Phase phase_outer;
+	};
+
+	static bool enabled;
+	/* Whether times are measured.  Set at startup, and by the -z
+	 * and -Z options. */
+
+	static size_t count_executions[C_EXECUTION];
+	/* Number of Execution objects created, by type */
+
+	static size_t count_executions_deleted;
+
+	static size_t count_rule_get, count_match;
+	/* Number of calls to Rule_Set::get(), and of attempts to match
+	 * a target against a parametrized rule */
+
+	static size_t count_stat;
+	/* Number of stat() calls on targets */
+
+	static size_t executions_live();
+	/* Number of Execution objects that currently exist */
+
+	static void enter(Phase phase);
+	/* Switch to the given phase, adding the elapsed time since the
+	 * last switch to the current phase */
+
+	static void disable();
+	/* Stop measuring times; the current phase remains accounted for */
+
+	static void print();
+	/* Print the statistics on standard output in the -z format */
+
+	static void print_json(FILE *file);
+	/* Print the members of a JSON object (without the enclosing
+	 * braces), followed by a comma */
+
+	static void log_at_exit(const char *filename);
+	/* When Stu exits, append one line to the given file, containing
+	 * the CPU time of Stu itself and the number of stat() calls,
+	 * rule lookups and match attempts, separated by tabs.  Used by
+	 * the performance mode of sh/mktest via $STU_STATISTICS_LOG.
+	 * Does not depend on whether statistics are enabled.  */
+
+private:
+
+	static Phase phase_current;
+	static struct timespec wall_last, cpu_last;
+	static struct timespec wall[C_PHASE], cpu[C_PHASE];
+
+	static const char *const phase_names[C_PHASE];
+	static const char *const execution_names[C_EXECUTION];
+
+	static const char *filename_log;
+
+	static void log();
+	/* Registered with atexit() */
+
+	static long peak_rss();
+	/* In kilobytes.  (On some systems, getrusage() returns the value in
+	 * bytes, in which case this is wrong.)  */
+
+	static void add(struct timespec &sum,
+			const struct timespec &now,
+			const struct timespec &last);
+
+	static double seconds(const struct timespec &t) {
+		return t.tv_sec + t.tv_nsec * 1e-9;
+	}
+};
+
+bool Statistics::enabled= true;
+size_t Statistics::count_executions[C_EXECUTION];
+size_t Statistics::count_executions_deleted= 0;
+size_t Statistics::count_rule_get= 0;
+size_t Statistics::count_match= 0;
+size_t Statistics::count_stat= 0;
+const char *Statistics::filename_log= nullptr;
+Statistics::Phase Statistics::phase_current= PHASE_OTHER;
+struct timespec Statistics::wall_last, Statistics::cpu_last;
+struct timespec Statistics::wall[C_PHASE], Statistics::cpu[C_PHASE];
+
+const char *const Statistics::phase_names[C_PHASE]= {
+	"other", "parse", "match", "expand", "stat", "dynamic", "wait"
+};
+
+const char *const Statistics::execution_names[C_EXECUTION]= {
+	"root", "file", "transient", "concatenation", "dynamic"
+};
+
+int stu_stat(const char *filename, struct stat *buf)
+/* Wrapper around stat(2) for targets, for statistics, for the stat
+ * cache of the daemon, and for prefetched results (-X).  Not
+ * async-signal-safe.  */
+{
+	int ret;
+	if (Daemon::stat_cached(filename, buf, ret))
+		return ret;
+	if (Prefetch::is_used() && Prefetch::get(filename, buf, ret))
+		return ret;
+	Statistics::Timer timer(Statistics::PHASE_STAT);
+	++ Statistics::count_stat;
+	ret= stat(filename, buf);
+	STU_PROBE2(stat, filename, ret == 0 ? 0 : errno);
+	return ret;
+}
+
+void Statistics::enter(Phase phase)
+{
+	assert(enabled);
+	struct timespec wall_now, cpu_now;
+	if (clock_gettime(CLOCK_MONOTONIC, &wall_now) < 0 ||
+	    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_now) < 0) {
+		print_error_system("clock_gettime");
+		enabled= false;
+		return;
+	}
+	if (wall_last.tv_sec != 0 || wall_last.tv_nsec != 0) {
+		add(wall[phase_current], wall_now, wall_last);
+		add(cpu [phase_current], cpu_now,  cpu_last);
+		if (Timeline::is_open()) {
+			Phase phase_shown= phase_current;
+			if (phase_shown == PHASE_MATCH || phase_shown == PHASE_STAT)
+				phase_shown= PHASE_EXPAND;
+			Timeline::phase(phase_shown == PHASE_OTHER ? nullptr 
+					: phase_names[phase_shown],
+					wall_last, wall_now);
+		}
+	}
+	wall_last= wall_now;
+	cpu_last= cpu_now;
+	phase_current= phase;
+}
+
+size_t Statistics::executions_live()
+{
+	size_t ret= 0;
+	for (int i= 0;  i < C_EXECUTION;  ++i)
+		ret += count_executions[i];
+	assert(ret >= count_executions_deleted);
+	return ret - count_executions_deleted;
+}
+
+void Statistics::disable()
+{
+	if (! enabled)
+		return;
+	enter(PHASE_OTHER);
+	enabled= false;
+}
+
+void Statistics::add(struct timespec &sum,
+		     const struct timespec &now,
+		     const struct timespec &last)
+{
+	sum.tv_sec += now.tv_sec - last.tv_sec;
+	sum.tv_nsec += now.tv_nsec - last.tv_nsec;
+	if (sum.tv_nsec < 0) {
+		sum.tv_nsec += 1000000000;
+		-- sum.tv_sec;
+	} else if (sum.tv_nsec >= 1000000000) {
+		sum.tv_nsec -= 1000000000;
+		++ sum.tv_sec;
+	}
+}
+
+long Statistics::peak_rss()
+{
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) < 0) {
+		print_error_system("getrusage");
+		return -1;
+	}
+	return usage.ru_maxrss;
+}
+
+void Statistics::print()
+{
+	if (enabled)
+		enter(phase_current);
+
+	for (int i= 0;  i < C_PHASE;  ++i) {
+		printf("STATISTICS  phase %-8s wall time = %.6f s, CPU time = %.6f s\n",
+		       phase_names[i], seconds(wall[i]), seconds(cpu[i]));
+	}
+	printf("STATISTICS  executions created = ");
+	for (int i= 0;  i < C_EXECUTION;  ++i) {
+		printf("%s%zu %s", i ? ", " : "",
+		       count_executions[i], execution_names[i]);
+	}
+	printf("\n");
+	printf("STATISTICS  rule lookups = %zu (%zu match attempts)\n",
+	       count_rule_get, count_match);
+	printf("STATISTICS  stat calls = %zu\n", count_stat);
+	printf("STATISTICS  peak resident set size = %ld kB\n", peak_rss());
+}
+
+void Statistics::print_json(FILE *file)
+{
+	if (enabled)
+		enter(phase_current);
+
+	fprintf(file, "\"phases\": {");
+	for (int i= 0;  i < C_PHASE;  ++i) {
+		fprintf(file, "%s\"%s\": {\"wall\": %.6f, \"cpu\": %.6f}",
+			i ? ", " : "",
+			phase_names[i], seconds(wall[i]), seconds(cpu[i]));
+	}
+	fprintf(file, "},\n\"executions\": {");
+	for (int i= 0;  i < C_EXECUTION;  ++i) {
+		fprintf(file, "%s\"%s\": %zu", i ? ", " : "",
+			execution_names[i], count_executions[i]);
+	}
+	fprintf(file, "},\n"
+		"\"rule_lookups\": %zu,\n"
+		"\"match_attempts\": %zu,\n"
+		"\"stat_calls\": %zu,\n"
+		"\"peak_rss_kb\": %ld,\n",
+		count_rule_get, count_match, count_stat, peak_rss());
+}
+
+void Statistics::log_at_exit(const char *filename)
+{
+	filename_log= filename;
+	if (atexit(log) != 0) {
+		print_error_system("atexit");
+		exit(ERROR_FATAL);
+	}
+}
+
+void Statistics::log()
+{
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) < 0) {
+		print_error_system("getrusage");
+		return;
+	}
+	double cpu= usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6
+		+ usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+
+	FILE *file= fopen(filename_log, "a");
+	if (file == nullptr) {
+		print_error_system(filename_log);
+		return;
+	}
+	fprintf(file, "%.6f\t%zu\t%zu\t%zu\n",
+		cpu, count_stat, count_rule_get, count_match);
+	if (ferror(file) || fclose(file))
+		print_error_system(filename_log);
+}
+
+#endif /* ! STATISTICS_HH */
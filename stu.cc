@@ -22,6 +22,7 @@ using namespace std;
 
 #include "dep.hh"
 #include "execution.hh" 
+#include "libstu.hh"
 #include "rule.hh"
 #include "timestamp.hh"
 #include "color.hh"
@@ -41,7 +42,7 @@ using namespace std;
  * the platform:  GNU getopt() will all options to follow arguments,
  * while BSD getopt() does not. 
  */
-const char OPTIONS[]= "0:ac:C:dEf:F:ghij:JkKm:M:n:o:p:PqsVxyYz"; 
+const char OPTIONS[]= "0:aAb:B:c:C:dD:e:Ef:F:gG:hH:iIj:JkKl:L:m:M:n:N:o:O:p:PqQr:R:sS:T:u:U:VwW:xX:yYzZ:"; 
 
 /* The output of the help (-h) option.  The following strings do not
  * contain tabs, but only space characters.  */   
@@ -52,35 +53,65 @@ const char HELP[]=
 	"Options:\n"						       
 	"  -0 FILENAME      Read \\0-separated file targets from the given file\n"
 	"  -a               Treat all trivial dependencies as non-trivial\n"          
+	"  -A               Start trivial dependencies early in free job slots\n"
+	"  -b SOCKET        Run as a cache server for the directory given by -O\n"
+	"  -B CPUS          Bind the job slots to the given CPU lists separated by ':',\n"
+	"                   or to the NUMA nodes with 'numa'\n"
 	"  -c FILENAME      Pass a target filename without Stu syntax parsing\n"      
 	"  -C EXPRESSIONS   Pass a target in full Stu syntax\n"		              
 	"  -d               Debug mode: show execution information on stderr\n"     
+	"  -D SOCKET        Run as a daemon that performs builds for clients (-U)\n"
+	"  -e K             Start a backup job for idempotent jobs taking K times longer\n"
+	"                   than recorded by -H\n"
 	"  -E               Explain error messages\n"                                 
 	"  -f FILENAME      The input file to use instead of 'main.stu'\n"            
 	"  -F RULES         Pass rules in Stu syntax\n"                               
 	"  -g               Treat all optional dependencies as non-optional\n"        
+	"  -G DIRECTORY     Run each job in its own cgroup within the given cgroup directory\n"
 	"  -h               Output help and exit\n"		                      
+	"  -H FILENAME      Read and write durations of jobs from/to the given file\n"
 	"  -i               Interactive mode (run jobs in foreground)\n"
+	"  -I               Stop jobs to run jobs with a higher priority ($STU_PRIORITY)\n"
 	"  -j K             Run K jobs in parallel\n"			              
 	"  -J               Disable Stu syntax in arguments\n"                        
 	"  -k               Keep on running after errors\n"		              
 	"  -K               Don't delete target files on error or interruption\n"     
+	"  -l DIRECTORY     Claim targets using lock files in the given directory, to build\n"
+	"                   cooperatively with other Stu processes\n"
+	"  -L K             Expand the dependencies K levels ahead when all job slots are busy\n"
 	"  -m ORDER         Order to run the targets:\n"			      
 	"     dfs           (default) Depth-first order, like in Make\n"	      
+	"     bfs           Breadth-first order\n"
 	"     random        Random order\n"				              
+	"     target        Pseudorandom order, by hash of the target names\n"
 	"  -M STRING        Pseudorandom run order, seeded by given string\n"         
 	"  -n FILENAME      Read \\n-separated file targets from the given file\n"
+	"  -N K             Read the files given by -n and -0 incrementally, building at\n"
+	"                   most K of their targets at once\n"
 	"  -o FILENAME      Build an optional dependency, i.e., build it only if it\n"
 	"                   exists and is out of date\n"
+	"  -O STORE         Use the output cache in the given directory or cache server (-b)\n"
 	"  -p FILENAME      Build a persistent dependency, i.e., ignore its timestamp\n"
 	"  -P               Print the rules and exit\n"                               
 	"  -q               Question mode: check whether targets are up to date\n"    
+	"  -Q               Plan mode: output the jobs that would be run and simulate them\n"
+	"  -r SOCKET        Run as a worker that executes jobs for Stu processes (-W)\n"
+	"  -R FILENAME      Read and write the reverse dependency index from/to the given file\n"
 	"  -s               Silent mode: don't use stdout\n"
+	"  -S FILENAME      Write the progress of the build in JSON to the given file\n"
+	"  -T FILENAME      Write a timeline of jobs in trace event format to the given file\n"
+	"  -u FILENAME      Only check targets affected by the changed files listed in\n"
+	"                   the given file ('-' for stdin), using the index given by -R\n"
+	"  -U SOCKET        Build using the daemon (-D) listening on the given socket\n"
 	"  -V               Output version and exit\n"				      
+	"  -w               Watch mode: build again each time files change\n"
+	"  -W SOCKET        Execute jobs on the worker (-r) listening on the given socket\n"
 	"  -x               Output each line in a command individually\n"              
+	"  -X K             Prefetch the metadata of files using K threads\n"
 	"  -y               Disable color in output\n"                                
 	"  -Y               Enable color in output\n"
 	"  -z               Output run-time statistics on stdout\n"                   
+	"  -Z FILENAME      Write run-time statistics as JSON to the given file\n"
 	"Report bugs to: " PACKAGE_BUGREPORT "\n" 
 	"Stu home page: <" PACKAGE_URL ">\n";
 
@@ -99,6 +130,20 @@ void add_deps_option_C(vector <shared_ptr <const Dep> > &deps,
 /* Parse a string of dependencies and add them to the vector. Used for
  * the -C option.  Support the full Stu syntax.  */
 
+void write_statistics_json(int error); 
+/* Write the statistics into the file given by the -Z option */ 
+
+void load_rules(const vector <pair <char, string> > &options);
+/* Read the rules of the daemon (-D) */ 
+
+void match_rule(const string &name, bool transient, Prefetch::Match &match); 
+/* Match a name against the rules; called by the threads of -X */ 
+
+/* The first rule and the place of the first file, as read by the
+ * daemon */ 
+shared_ptr <const Rule> rule_first_daemon;
+Place place_first_daemon;
+
 /* Set one of the "setting options", i.e., of of those that can appear
  * in $STU_OPTIONS.  Return whether this was a valid settings option.  */ 
 bool stu_setting(char c)
@@ -122,9 +167,22 @@ int main(int argc, char **argv, char **envp)
 	/* Initialization */
 	dollar_zero= argv[0]; 
 	envp_global= (const char **) envp; 
+	Color::set(); 
+	if (argc >= 2 && ! strncmp(argv[1], "-U", 2))
+		Daemon::client(argc, argv); 
+	if (argc >= 2 && ! strncmp(argv[1], "-D", 2)) {
+		/* Only returns in the child process performing a build for
+		 * a client, with the arguments and the environment of the
+		 * client */ 
+		Daemon::serve(argc, argv, load_rules); 
+		dollar_zero= argv[0]; 
+		envp_global= (const char **) environ; 
+		Timestamp::startup= Timestamp::now(); 
+	}
 	init_buf();
 	Job::init_tty();
 	Color::set();
+	Statistics::enter(Statistics::PHASE_PARSE); 
 	int error= 0;
 
 	/* Refuse to run when $STU_STATUS is set */ 
@@ -136,6 +194,11 @@ int main(int argc, char **argv, char **envp)
 		exit(ERROR_FATAL); 
 	}
 
+	/* Used by the performance mode of sh/mktest */
+	const char *const stu_statistics_log= getenv("STU_STATISTICS_LOG");
+	if (stu_statistics_log != nullptr && *stu_statistics_log != '\0')
+		Statistics::log_at_exit(stu_statistics_log); 
+
 	try {
 		vector <string> filenames;
 		/* Filenames passed using the -f option.  Entries are
@@ -145,10 +208,10 @@ int main(int argc, char **argv, char **envp)
 		vector <shared_ptr <const Dep> > deps; 
 		/* Assemble targets here */ 
 
-		shared_ptr <const Rule> rule_first;
+		shared_ptr <const Rule> rule_first= rule_first_daemon;
 		/* Set to the first rule when there is one */ 
 
-		Place place_first;
+		Place place_first= place_first_daemon;
 		/* Place of first file when no rule is contained */ 
 
 		bool had_option_target= false;   
@@ -183,14 +246,36 @@ int main(int argc, char **argv, char **envp)
 			switch (c) {
 
 			case 'a': option_nontrivial= true;     break;
+			case 'A': option_speculative= true;    break;
 			case 'd': option_debug= true;          break;
 			case 'g': option_nonoptional= true;    break;
 			case 'h': fputs(HELP, stdout);         exit(0);
+			case 'I': option_preempt= true;        break;
 			case 'J': option_literal= true;        break;
 			case 'k': option_keep_going= true;     break;
 			case 'K': option_no_delete= true;      break;
 			case 'P': option_print= true;          break;  
 			case 'q': option_question= true;       break;
+			case 'Q': option_plan= true;           break;
+			case 'w': option_watch= true;          break;
+
+			case 'b':
+				if (*optarg == '\0') {
+					Place(Place::Type::OPTION, 'b') <<
+						"expected a non-empty argument"; 
+					exit(ERROR_FATAL);
+				}
+				option_cache_server= optarg; 
+				break;
+
+			case 'B':
+				if (*optarg == '\0') {
+					Place(Place::Type::OPTION, 'B') <<
+						"expected a non-empty argument"; 
+					exit(ERROR_FATAL);
+				}
+				option_cpus= optarg; 
+				break;
 
 			case 'c':  {
 				had_option_target= true; 
@@ -212,7 +297,32 @@ int main(int argc, char **argv, char **envp)
 				break;
 			}
 
+			case 'D':
+			case 'U':
+				Place(Place::Type::OPTION, c) 
+					<< "must be the first option"; 
+				exit(ERROR_FATAL); 
+
+			case 'e':  {
+				errno= 0;
+				char *endptr;
+				option_backup= strtod(optarg, &endptr);
+				if (errno != 0 || *endptr != '\0' || ! (option_backup > 0)) {
+					Place(Place::Type::OPTION, c)
+						<< fmt("expected a positive factor, not %s",
+						       name_format_word(optarg)); 
+					exit(ERROR_FATAL); 
+				}
+				break;
+			}
+
 			case 'f':
+				if (Daemon::is_child()) {
+					Place(Place::Type::OPTION, c)
+						<< fmt("cannot be used with %s; rules are read by the daemon", 
+						       multichar_format_word("-U")); 
+					exit(ERROR_FATAL); 
+				}
 				if (*optarg == '\0') {
 					Place(Place::Type::OPTION, 'f') <<
 						"expected non-empty argument"; 
@@ -230,11 +340,41 @@ int main(int argc, char **argv, char **envp)
 				break;
 
 			case 'F':
+				if (Daemon::is_child()) {
+					Place(Place::Type::OPTION, c)
+						<< fmt("cannot be used with %s; rules are read by the daemon", 
+						       multichar_format_word("-U")); 
+					exit(ERROR_FATAL); 
+				}
 				had_option_f= true;
 				Parser::get_string(optarg, Execution::rule_set, rule_first);
 				break;
 
+			case 'G':
+				if (*optarg == '\0') {
+					Place(Place::Type::OPTION, 'G') <<
+						"expected a non-empty argument"; 
+					exit(ERROR_FATAL);
+				}
+				option_cgroup_directory= optarg; 
+				break;
+
+			case 'H':
+				if (*optarg == '\0') {
+					Place(Place::Type::OPTION, 'H') <<
+						"expected a non-empty argument"; 
+					exit(ERROR_FATAL);
+				}
+				option_history_file= optarg; 
+				break;
+
 			case 'i':
+				if (Daemon::is_child()) {
+					Place(Place::Type::OPTION, c)
+						<< fmt("cannot be used with %s", 
+						       multichar_format_word("-U")); 
+					exit(ERROR_FATAL); 
+				}
 				option_interactive= true;
 				if (Job::get_tty() < 0) {
 					Place place(Place::Type::OPTION, 'i');
@@ -261,6 +401,28 @@ int main(int argc, char **argv, char **envp)
 				break;
 			}
 
+			case 'l':
+				if (*optarg == '\0') {
+					Place(Place::Type::OPTION, 'l') <<
+						"expected a non-empty argument"; 
+					exit(ERROR_FATAL);
+				}
+				option_claim_directory= optarg; 
+				break;
+
+			case 'L':  {
+				errno= 0;
+				char *endptr;
+				option_lookahead= strtol(optarg, &endptr, 10);
+				if (errno != 0 || *endptr != '\0' || option_lookahead < 0) {
+					Place(Place::Type::OPTION, c)
+						<< fmt("expected a non-negative number of levels, not %s",
+						       name_format_word(optarg)); 
+					exit(ERROR_FATAL); 
+				}
+				break;
+			}
+
 			case 'm':
 				if (!strcmp(optarg, "random"))  {
 					order= Order::RANDOM;
@@ -274,13 +436,17 @@ int main(int argc, char **argv, char **envp)
 					}
 					buffer_generator.seed(tv.tv_sec + tv.tv_usec); 
 				}
-				else if (!strcmp(optarg, "dfs"))     /* Default */ ;
+				else if (!strcmp(optarg, "dfs"))     order= Order::DFS;
+				else if (!strcmp(optarg, "bfs"))     order= Order::BFS;
+				else if (!strcmp(optarg, "target"))  order= Order::TARGET;
 				else {
-					print_error(fmt("Invalid argument %s for option %s-m%s; valid values are %s and %s", 
+					print_error(fmt("Invalid argument %s for option %s-m%s; valid values are %s, %s, %s and %s", 
 							name_format_word(optarg),
 							Color::word, Color::end,
 							name_format_word("random"),
-							name_format_word("dfs"))); 
+							name_format_word("dfs"),
+							name_format_word("bfs"),
+							name_format_word("target"))); 
 					exit(ERROR_FATAL); 
 				}
 				break;
@@ -308,6 +474,19 @@ int main(int argc, char **argv, char **envp)
 				break;
 			}
 
+			case 'N':  {
+				errno= 0;
+				char *endptr;
+				option_admission= strtol(optarg, &endptr, 10);
+				if (errno != 0 || *endptr != '\0' || option_admission < 1) {
+					Place(Place::Type::OPTION, c)
+						<< fmt("expected a positive number of targets, not %s",
+						       name_format_word(optarg)); 
+					exit(ERROR_FATAL); 
+				}
+				break;
+			}
+
 			case 'o':
 			case 'p':  {
 				had_option_target= true; 
@@ -325,11 +504,89 @@ int main(int argc, char **argv, char **envp)
 				break; 
 			}
 
+			case 'O':
+				if (*optarg == '\0') {
+					Place(Place::Type::OPTION, 'O') <<
+						"expected a non-empty argument"; 
+					exit(ERROR_FATAL);
+				}
+				option_cache_store= optarg; 
+				break;
+
+			case 'r':
+				Worker::serve(optarg); 
+				break;
+
+			case 'R':
+				if (*optarg == '\0') {
+					Place(Place::Type::OPTION, 'R') <<
+						"expected a non-empty argument"; 
+					exit(ERROR_FATAL);
+				}
+				option_index_file= optarg; 
+				break;
+
+			case 'S':
+				if (*optarg == '\0') {
+					Place(Place::Type::OPTION, 'S') <<
+						"expected a non-empty argument"; 
+					exit(ERROR_FATAL);
+				}
+				option_progress_file= optarg; 
+				break;
+
+			case 'T':
+				if (*optarg == '\0') {
+					Place(Place::Type::OPTION, 'T') <<
+						"expected a non-empty argument"; 
+					exit(ERROR_FATAL);
+				}
+				option_timeline_file= optarg; 
+				break;
+
+			case 'u':
+				if (*optarg == '\0') {
+					Place(Place::Type::OPTION, 'u') <<
+						"expected a non-empty argument"; 
+					exit(ERROR_FATAL);
+				}
+				option_changed_file= optarg; 
+				break;
+
 			case 'V': 
 				fputs(VERSION_INFO, stdout); 
 				printf("USE_MTIM = %u\n", USE_MTIM); 
+				printf("USE_SDT = %u\n", USE_SDT); 
+				printf("USE_AFFINITY = %u\n", USE_AFFINITY); 
+				printf("USE_DAEMON = %u\n", USE_DAEMON); 
 				exit(0);
 
+			case 'W':
+				Worker::add(optarg); 
+				break;
+
+			case 'X':  {
+				errno= 0;
+				char *endptr;
+				option_prefetch= strtol(optarg, &endptr, 10);
+				if (errno != 0 || *endptr != '\0' || option_prefetch < 1) {
+					Place(Place::Type::OPTION, c)
+						<< fmt("expected a positive number of threads, not %s",
+						       name_format_word(optarg)); 
+					exit(ERROR_FATAL); 
+				}
+				break;
+			}
+
+			case 'Z':
+				if (*optarg == '\0') {
+					Place(Place::Type::OPTION, 'Z') <<
+						"expected a non-empty argument"; 
+					exit(ERROR_FATAL);
+				}
+				option_statistics_file= optarg; 
+				break;
+
 			default:  
 				/* Invalid option -- an error message was
 				 * already printed by getopt() */   
@@ -341,7 +598,7 @@ int main(int argc, char **argv, char **envp)
 			}
 		}
 
-		order_vec= (order == Order::RANDOM);
+		order_vec= (order == Order::RANDOM || order == Order::TARGET);
 
 		if (option_interactive && option_parallel) {
 			Place(Place::Type::OPTION, 'i')
@@ -350,6 +607,102 @@ int main(int argc, char **argv, char **envp)
 			exit(ERROR_FATAL); 
 		}
 
+		if (option_interactive && option_preempt) {
+			Place(Place::Type::OPTION, 'i')
+				<< fmt("stopping jobs using %s cannot be used in interactive mode",
+				       multichar_format_word("-I")); 
+			exit(ERROR_FATAL); 
+		}
+
+		/* Stopping the local process of a job run by a worker
+		 * would not stop the command on the worker */ 
+		if (option_preempt && Worker::is_used()) {
+			Place(Place::Type::OPTION, 'I')
+				<< fmt("stopping jobs cannot be used with workers using %s",
+				       multichar_format_word("-W")); 
+			exit(ERROR_FATAL); 
+		}
+
+		if (option_backup) {
+			if (! option_history_file) {
+				Place(Place::Type::OPTION, 'e')
+					<< fmt("backup jobs need the durations given by %s",
+					       multichar_format_word("-H")); 
+				exit(ERROR_FATAL); 
+			}
+			if (option_interactive) {
+				Place(Place::Type::OPTION, 'i')
+					<< fmt("backup jobs using %s cannot be used in interactive mode",
+					       multichar_format_word("-e")); 
+				exit(ERROR_FATAL); 
+			}
+			if (option_preempt || option_claim_directory
+			    || Worker::is_used() || option_cache_store) {
+				Place(Place::Type::OPTION, 'e')
+					<< fmt("backup jobs cannot be used with %s, %s, %s or %s",
+					       multichar_format_word("-I"), 
+					       multichar_format_word("-l"), 
+					       multichar_format_word("-O"), 
+					       multichar_format_word("-W")); 
+				exit(ERROR_FATAL); 
+			}
+		}
+
+		if (option_interactive && Worker::is_used()) {
+			Place(Place::Type::OPTION, 'i')
+				<< fmt("workers using %s cannot be used in interactive mode",
+				       multichar_format_word("-W")); 
+			exit(ERROR_FATAL); 
+		}
+
+		if (option_cache_server) {
+			if (! option_cache_store) {
+				Place(Place::Type::OPTION, 'b')
+					<< fmt("the cache server must use a directory given by %s",
+					       multichar_format_word("-O")); 
+				exit(ERROR_FATAL); 
+			}
+			Cache::open(option_cache_store); 
+			Cache::serve(option_cache_server); 
+		}
+
+		/* In question and plan mode, no jobs are started, and
+		 * speculatively started dependencies would be wrongly
+		 * reported as out of date */
+		if (option_question || option_plan)
+			option_speculative= false; 
+
+		if (option_watch && (option_question || option_plan 
+				     || Daemon::is_child())) {
+			Place(Place::Type::OPTION, 'w')
+				<< fmt("watch mode cannot be used with %s, %s or %s",
+				       multichar_format_word("-q"), 
+				       multichar_format_word("-Q"), 
+				       multichar_format_word("-U")); 
+			exit(ERROR_FATAL); 
+		}
+
+		if (option_changed_file && ! option_index_file) {
+			Place(Place::Type::OPTION, 'u')
+				<< fmt("changed files cannot be used without an index given by %s",
+				       multichar_format_word("-R")); 
+			exit(ERROR_FATAL); 
+		}
+
+		if (option_changed_file && option_watch) {
+			Place(Place::Type::OPTION, 'u')
+				<< fmt("changed files cannot be used in watch mode using %s",
+				       multichar_format_word("-w")); 
+			exit(ERROR_FATAL); 
+		}
+
+		if (option_question && option_plan) {
+			Place(Place::Type::OPTION, 'Q')
+				<< fmt("plan mode cannot be used in question mode using %s",
+				       multichar_format_word("-q")); 
+			exit(ERROR_FATAL); 
+		}
+
 		/* Targets passed on the command line, outside of options */ 
 		for (int i= optind;  i < argc;  ++i) {
 			/* The number I may not be the index that the
@@ -375,8 +728,9 @@ int main(int argc, char **argv, char **envp)
 			Parser::get_target_arg(deps, argc - optind, argv + optind); 
 		} 
 
-		/* Use the default Stu script if -f/-F are not used */ 
-		if (! had_option_f) {
+		/* Use the default Stu script if -f/-F are not used, unless
+		 * the rules were read by the daemon */ 
+		if (! had_option_f && ! Daemon::is_child()) {
 			filenames.push_back(FILENAME_INPUT_DEFAULT); 
 			int file_fd= open(FILENAME_INPUT_DEFAULT, O_RDONLY); 
 			if (file_fd >= 0) {
@@ -432,8 +786,48 @@ int main(int argc, char **argv, char **envp)
 				(make_shared <Plain_Dep> (*(rule_first->place_param_targets[0])));  
 		}
 
+		/* In watch mode, each build is performed by a child
+		 * process; only returns in the child processes */ 
+		if (option_watch) {
+			Daemon::rules_read(Tokenizer::filenames_read); 
+			Daemon::watch_builds(argv, Reverse_Index::invalidate); 
+			Timestamp::startup= Timestamp::now(); 
+		}
+
+		/* End of the parse phase; time is only measured further
+		 * when statistics or a timeline are output */
+		if (option_timeline_file)
+			Timeline::open(option_timeline_file); 
+		if (option_statistics || option_statistics_file || option_timeline_file)
+			Statistics::enter(Statistics::PHASE_OTHER); 
+		else
+			Statistics::disable(); 
+
+		if (option_history_file)
+			Progress::history_read(option_history_file); 
+		if (option_progress_file)
+			Progress::open(option_progress_file); 
+		if (Progress::is_used())
+			Progress::start(Execution::jobs); 
+		if (option_claim_directory)
+			Claim::open(option_claim_directory); 
+		if (option_cache_store)
+			Cache::open(option_cache_store); 
+		if (option_cgroup_directory)
+			Cgroup::open(option_cgroup_directory); 
+		if (option_cpus)
+			Affinity::open(option_cpus); 
+		if (option_prefetch)
+			Prefetch::start(option_prefetch, match_rule); 
+		if (option_index_file)
+			Reverse_Index::open(option_index_file); 
+		if (option_changed_file)
+			Reverse_Index::changed(option_changed_file); 
+
 		/* Execute */
-		Execution::main(deps);
+		int error_run= Libstu::run(deps);
+		if (error_run)
+			error= error_run;
 
 	} catch (int e) {
 		assert(e >= 1 && e <= 3); 
@@ -447,8 +841,29 @@ int main(int argc, char **argv, char **envp)
 	
 	if (option_statistics) {
 		Job::print_statistics();
+		job_print_memory(); 
 	}
 
+	if (option_statistics_file) {
+		write_statistics_json(error); 
+	}
+
+	Timeline::close(); 
+
+	if (Progress::is_used())
+		Progress::finish(error); 
+
+	Cgroup::close(); 
+
+	/* In question and plan mode, not all dependencies are known */ 
+	if (Reverse_Index::is_used() && ! option_question && ! option_plan)
+		Reverse_Index::finish(error, Tokenizer::filenames_read); 
+
+	/* In watch mode, the next build visits only the targets
+	 * affected by the changed files */ 
+	if (option_watch && ! error)
+		Daemon::report_index(Reverse_Index::records()); 
+
 	if (fclose(stdout)) {
 		perror("fclose(stdout)");
 		exit(ERROR_FATAL);
@@ -510,3 +925,58 @@ void add_deps_option_C(vector <shared_ptr <const Dep> > &deps,
 		deps.push_back(j); 
 	}
 }
+
+void write_statistics_json(int error)
+{
+	FILE *file= fopen(option_statistics_file, "w");
+	if (file == nullptr) {
+		print_error_system(option_statistics_file); 
+		exit(ERROR_FATAL); 
+	}
+
+	fprintf(file, "{\n\"version\": \"%s\",\n", STU_VERSION); 
+	Job::print_statistics_json(file); 
+	Statistics::print_json(file); 
+	Profile::print_json(file); 
+	memory_print_json(file); 
+	fprintf(file, "\"exit_status\": %d\n}\n", error); 
+
+	if (ferror(file) || fclose(file)) {
+		print_error_system(option_statistics_file); 
+		exit(ERROR_FATAL); 
+	}
+}
+
+void load_rules(const vector <pair <char, string> > &options)
+{
+	Execution::rule_set= Rule_Set(); 
+	rule_first_daemon= nullptr;
+	place_first_daemon= Place(); 
+	Tokenizer::filenames_read.clear(); 
+
+	vector <string> filenames; 
+	for (auto &option:  options) {
+		if (option.first == 'F') {
+			Parser::get_string(option.second.c_str(), 
+					   Execution::rule_set, rule_first_daemon); 
+			continue;
+		}
+		/* Silently ignore duplicate input files */ 
+		if (find(filenames.begin(), filenames.end(), option.second) 
+		    != filenames.end())
+			continue;
+		filenames.push_back(option.second); 
+		Parser::get_file(option.second, -1, Execution::rule_set, 
+				 rule_first_daemon, place_first_daemon); 
+	}
+	if (options.empty()) 
+		Parser::get_file("", -1, Execution::rule_set, 
+				 rule_first_daemon, place_first_daemon); 
+
+	Daemon::rules_read(Tokenizer::filenames_read); 
+}
+
+void match_rule(const string &name, bool transient, Prefetch::Match &match)
+{
+	Execution::rule_set.match(name, transient, match); 
+}
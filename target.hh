@@ -2,6 +2,7 @@
 #define TARGET_HH
 
 #include "flags.hh"
+#include "memory.hh"
 
 /* 
  * Targets are the individual "objects" of Stu.  They can be thought of
@@ -44,6 +45,7 @@ class Target
  * class is that Target objects don't store the Place objects, and don't
  * support parametrization.  Thus, Target objects are used as keys in
  * maps, etc.  Flags are included.  */
+	:  private Counted <Target>
 {
 public:
 	
@@ -0,0 +1,17 @@
+/*
+ * A program using Stu as a library, as in the example in libstu.hh:
+ * build the file A from the file B.
+ */
+
+#include "../../libstu.hh"
+
+int main(int, char **argv, char **envp)
+{
+	Libstu::init(argv[0], envp);
+	Libstu::add_rule({Libstu::file(Libstu::name("A"))},
+			 {Libstu::file(Libstu::name("B"))},
+			 "cp B A");
+	Libstu::target(Libstu::file(Libstu::name("A")));
+	int error= Libstu::run();
+	return error;
+}
@@ -6,6 +6,7 @@
  */
 
 #include <stdarg.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -54,6 +55,18 @@ string frmt(const char *format, ...)
 	return ret; 
 }
 
+uint64_t hash_fnv(const string &text)
+/* The 64-bit FNV-1a hash of TEXT.  Unlike hash <string>, the result
+ * does not depend on the C++ implementation.  */ 
+{
+	uint64_t h= 0xcbf29ce484222325;
+	for (unsigned char c:  text) {
+		h ^= c;
+		h *= 0x100000001b3;
+	}
+	return h; 
+}
+
 /* fmt() allows *only* the unqualified '%s' format specifier with string
  * and const char * arguments, and '%%'.  Precisely, this allows any
  * argument that can be concatenated to a string with the '+' operator.  */
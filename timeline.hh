@@ -0,0 +1,240 @@
+#ifndef TIMELINE_HH
+#define TIMELINE_HH
+
+/*
+ * Output of a timeline of the build in the trace event format, as used
+ * by chrome://tracing and Perfetto (the -T option).  The file contains
+ * a JSON array of events, written while Stu runs:
+ *
+ *   - One slice per job, from its start to the moment it was waited
+ *     for.  Jobs are placed on one track per job slot (-j), such that
+ *     idle slots are visible as gaps.
+ *   - Slices for the phases of Stu itself (as defined in the class
+ *     Statistics) on their own track.  Rule matching and stat calls
+ *     are shown as part of the graph expansion, as they are too fine
+ *     grained to be shown individually.
+ *   - Counters for the number of free job slots and the number of
+ *     live Execution objects.
+ *
+ * Timestamps are in microseconds of CLOCK_MONOTONIC.  Each event is
+ * flushed as soon as it is written, and the closing bracket of the
+ * array is optional in the format, so a file from an interrupted run
+ * can still be loaded.
+ */
+
+#include <time.h>
+#include <unistd.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "format.hh"
+
+class Timeline
+{
+public:
+
+	static void open(const char *filename);
+	/* Start writing the timeline into the given file */
+
+	static void close();
+	/* Finish the file.  Does nothing when no file is open.  */
+
+	static bool is_open() {  return file != nullptr;  }
+
+	static void phase(const char *name,
+			  const struct timespec &begin,
+			  const struct timespec &end);
+	/* The Stu process was in the phase NAME during the given
+	 * interval.  Consecutive intervals of the same phase are merged
+	 * into a single slice.  NAME is a static string, or null for
+	 * time that is not shown.  */
+
+	static void job_started(pid_t pid, string name, long jobs_free,
+				size_t executions_live);
+	static void job_waited(pid_t pid, int status, long jobs_free,
+			       size_t executions_live);
+
+private:
+
+	struct Slice
+	{
+		size_t slot;
+		double begin;
+		string name;
+	};
+
+	static FILE *file;
+	static const char *filename;
+	static pid_t pid_stu;
+
+	static unordered_map <pid_t, Slice> slices;
+	/* The running jobs */
+
+	static vector <bool> slots;
+	/* Which job slots are in use.  Slot I is shown with thread ID I+1;
+	 * thread ID 0 is used for the phases of Stu. */
+
+	static const char *phase_name;
+	static double phase_begin, phase_end;
+	/* The phase slice that is currently being merged, if PHASE_NAME
+	 * is not null */
+
+	static double now();
+	static double microseconds(const struct timespec &t) {
+		return t.tv_sec * 1e6 + t.tv_nsec * 1e-3;
+	}
+
+	static void flush_phase();
+	static void counters(double ts, long jobs_free, size_t executions_live);
+	static void thread_name(size_t tid, string name);
+	static void event(string text);
+};
+
+FILE *Timeline::file= nullptr;
+const char *Timeline::filename;
+pid_t Timeline::pid_stu;
+unordered_map <pid_t, Timeline::Slice> Timeline::slices;
+vector <bool> Timeline::slots;
+const char *Timeline::phase_name= nullptr;
+double Timeline::phase_begin, Timeline::phase_end;
+
+void Timeline::open(const char *filename_)
+{
+	assert(file == nullptr);
+	filename= filename_;
+	file= fopen(filename, "w");
+	if (file == nullptr) {
+		print_error_system(filename);
+		exit(ERROR_FATAL);
+	}
+	pid_stu= getpid();
+	fputs("[\n", file);
+	event(frmt("{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %ld, "
+		   "\"args\": {\"name\": \"" PACKAGE "\"}}",
+		   (long) pid_stu));
+	thread_name(0, PACKAGE);
+}
+
+void Timeline::close()
+{
+	if (file == nullptr)
+		return;
+	flush_phase();
+	fputs("\n]\n", file);
+	if (ferror(file) || fclose(file)) {
+		print_error_system(filename);
+		file= nullptr;
+		exit(ERROR_FATAL);
+	}
+	file= nullptr;
+}
+
+void Timeline::phase(const char *name,
+		     const struct timespec &begin,
+		     const struct timespec &end)
+{
+	if (file == nullptr)
+		return;
+	if (name == phase_name) {
+		phase_end= microseconds(end);
+		return;
+	}
+	flush_phase();
+	phase_name= name;
+	phase_begin= microseconds(begin);
+	phase_end= microseconds(end);
+}
+
+void Timeline::job_started(pid_t pid, string name, long jobs_free,
+			   size_t executions_live)
+{
+	if (file == nullptr)
+		return;
+
+	size_t slot= 0;
+	while (slot < slots.size() && slots[slot])
+		++slot;
+	if (slot == slots.size()) {
+		slots.push_back(true);
+		thread_name(slot + 1, frmt("slot %zu", slot + 1));
+	} else {
+		slots[slot]= true;
+	}
+
+	double ts= now();
+	slices[pid]= Slice{slot, ts, name};
+	counters(ts, jobs_free, executions_live);
+}
+
+void Timeline::job_waited(pid_t pid, int status, long jobs_free,
+			  size_t executions_live)
+{
+	if (file == nullptr)
+		return;
+
+	auto i= slices.find(pid);
+	if (i == slices.end())
+		return;
+	const Slice &slice= i->second;
+	double ts= now();
+	event(frmt("{\"name\": %s, \"cat\": \"job\", \"ph\": \"X\", "
+		   "\"ts\": %.3f, \"dur\": %.3f, \"pid\": %ld, \"tid\": %zu, "
+		   "\"args\": {\"pid\": %ld, \"status\": %d}}",
+		   name_format_json(slice.name).c_str(),
+		   slice.begin, ts - slice.begin, (long) pid_stu,
+		   slice.slot + 1, (long) pid, status));
+	slots[slice.slot]= false;
+	slices.erase(i);
+	counters(ts, jobs_free, executions_live);
+}
+
+double Timeline::now()
+{
+	struct timespec t;
+	if (clock_gettime(CLOCK_MONOTONIC, &t) < 0) {
+		print_error_system("clock_gettime");
+		return 0;
+	}
+	return microseconds(t);
+}
+
+void Timeline::flush_phase()
+{
+	if (phase_name == nullptr)
+		return;
+	event(frmt("{\"name\": \"%s\", \"cat\": \"phase\", \"ph\": \"X\", "
+		   "\"ts\": %.3f, \"dur\": %.3f, \"pid\": %ld, \"tid\": 0}",
+		   phase_name, phase_begin, phase_end - phase_begin,
+		   (long) pid_stu));
+	phase_name= nullptr;
+}
+
+void Timeline::counters(double ts, long jobs_free, size_t executions_live)
+{
+	event(frmt("{\"name\": \"free slots\", \"ph\": \"C\", \"ts\": %.3f, "
+		   "\"pid\": %ld, \"args\": {\"free\": %ld}}",
+		   ts, (long) pid_stu, jobs_free));
+	event(frmt("{\"name\": \"executions\", \"ph\": \"C\", \"ts\": %.3f, "
+		   "\"pid\": %ld, \"args\": {\"live\": %zu}}",
+		   ts, (long) pid_stu, executions_live));
+}
+
+void Timeline::thread_name(size_t tid, string name)
+{
+	event(frmt("{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %ld, "
+		   "\"tid\": %zu, \"args\": {\"name\": %s}}",
+		   (long) pid_stu, tid, name_format_json(name).c_str()));
+}
+
+void Timeline::event(string text)
+{
+	static bool first= true;
+	if (! first)
+		fputs(",\n", file);
+	first= false;
+	fputs(text.c_str(), file);
+	fflush(file);
+}
+
+#endif /* ! TIMELINE_HH */
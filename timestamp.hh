@@ -50,7 +50,7 @@ public:
 	/* Uninitialized */ 
 	Timestamp() { }
 
-	Timestamp(struct stat *buf) 
+	Timestamp(const struct stat *buf) 
 	{  
 		t.tv_sec= buf->st_mtim.tv_sec;
 		t.tv_nsec= buf->st_mtim.tv_nsec;
@@ -41,7 +41,8 @@ public:
 class Operator
 /* An operator, e.g. ':', '[', etc.  Operators are all single
  * characters.  */  
-	:  public Token
+	:  public Token,
+	   private Counted <Operator>
 {
 public: 
 	const Place place; 
@@ -73,7 +74,8 @@ public:
 };
 
 class Flag_Token
-	:  public Token
+	:  public Token,
+	   private Counted <Flag_Token>
 {
 public:
 
@@ -122,7 +124,8 @@ class Name_Token
 /* This contains two types of places:  the places for the individual
  * parameters in Place_Param_Name, and the place of the complete token
  * from Token.  */
-	:  public Token, public Place_Name
+	:  public Token, public Place_Name,
+	   private Counted <Name_Token>
 {
 public:
 	Name_Token(const Place_Name &place_name_, 
@@ -147,7 +150,8 @@ public:
 class Command
 /* A command delimited by braces, or the content of a file, also
  * delimited by braces.  */
-	:  public Token
+	:  public Token,
+	   private Counted <Command>
 {
 private:
 
@@ -70,6 +70,10 @@ public:
 	/* Parse tokens from the given TEXT.  Other arguments are
 	 * identical to parse_tokens_file().  */
 
+	static vector <string> filenames_read;
+	/* The names of all source files that were read or tried to be
+	 * read, including included files.  Used by the daemon (-D).  */
+
 private:
 
 	/* Stacks of included files */ 
@@ -192,6 +196,8 @@ private:
 	 * given after "%version", and PLACE its place.  */
 };
 
+vector <string> Tokenizer::filenames_read;
+
 void Tokenizer::parse_tokens_file(vector <shared_ptr <Token> > &tokens, 
 				  Context context,
 				  Place &place_end,
@@ -218,6 +224,8 @@ void Tokenizer::parse_tokens_file(vector <shared_ptr <Token> > &tokens,
 			       filenames[filenames.size() - 1] != filename); 
 			assert(includes.count(filename) == 0); 
 			includes.insert(filename); 
+			if (filename != "")
+				filenames_read.push_back(filename); 
 		} else {
 			assert(filenames.size() == 0);
 			assert(traces.size() == 0);
@@ -251,6 +259,8 @@ void Tokenizer::parse_tokens_file(vector <shared_ptr <Token> > &tokens,
 			if (filename[filename.size() - 1] != '/')
 				filename += '/';
 			filename += FILENAME_INPUT_DEFAULT;
+			if (context == SOURCE)
+				filenames_read.push_back(filename); 
 			int fd2= openat(fd, FILENAME_INPUT_DEFAULT, O_RDONLY);
 			if (fd2 < 0) 
 				goto error_close;
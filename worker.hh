@@ -0,0 +1,637 @@
+#ifndef WORKER_HH
+#define WORKER_HH
+
+/*
+ * Execution of jobs by workers (the -W and -r options).  With
+ *
+ *	stu -W SOCKET [-W SOCKET]... [OPTION]... [TARGET]...
+ *
+ * jobs are not executed by Stu itself, but sent to workers listening
+ * on the given Unix sockets, in turn.  All other aspects of the build,
+ * i.e., the dependency graph, up-to-date checks and the number of
+ * parallel jobs (-j), are handled by Stu as usual.  The reference
+ * worker is started with
+ *
+ *	stu -r SOCKET
+ *
+ * and runs jobs on the local machine.  Workers on other machines can
+ * be reached by forwarding a Unix socket, e.g., with 'ssh -L'.
+ *
+ * Each job is still a child process of Stu:  the child process sends
+ * the job to a worker, waits for the result, writes the output of the
+ * command to its standard output and error output, writes the produced
+ * file targets, and then exits with the wait status of the command.
+ * Killing the child process closes the connection, upon which the
+ * worker kills the command.  Copy rules and rules with content are
+ * executed by Stu itself.
+ *
+ * The worker runs each command in a new empty directory into which
+ * the input files have been written.  The input files are the direct
+ * file dependencies of the target and the input redirection, when
+ * these exist and are given by relative names.  Files that are read by
+ * the command but are not dependencies (and files given by absolute
+ * names) must exist on the worker.  After the command has succeeded,
+ * the file targets that were produced are sent back.
+ *
+ * Messages consist of strings each terminated by '\0'; numbers are
+ * decimal.  A file is given as its name, its mode (octal), its size
+ * and that number of bytes.  The request contains:  $0, the options to
+ * the shell, the command, the number of environment variables, the
+ * variables (as KEY=VALUE), the name of the output redirection and of
+ * the input redirection (both may be empty), the number of input
+ * files, the input files, the number of file targets, and their names.
+ * The response contains:  the wait status, the size and content of the
+ * standard output and of the error output of the command, the number
+ * of produced files and the produced files.
+ */
+
+#include <ftw.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "daemon.hh"
+#include "error.hh"
+#include "format.hh"
+
+class Worker
+{
+public:
+
+	static void add(const char *socket_name);
+	/* Send jobs to the worker listening on the given socket (-W) */
+
+	static bool is_used()  {  return ! sockets.empty();  }
+
+	static void prepare(const vector <string> &filenames_input_,
+			    const vector <string> &filenames_output_);
+	/* Set the input files and the file targets of the next job.
+	 * Called before the job is started.  */
+
+	static void run(const char *argv0,
+			const char *shell_options,
+			const char *command,
+			const map <string, string> &mapping,
+			const string &filename_output,
+			const string &filename_input)
+		__attribute__((noreturn));
+	/* Called in the child process of a job instead of executing
+	 * the shell.  Execute the job on a worker, and exit with the
+	 * wait status of the command.  */
+
+	static void serve(const char *socket_name) __attribute__((noreturn));
+	/* Run as a worker (-r) */
+
+	/* Also used by the output cache (-O) */
+
+	static int connect_socket(const char *socket_name);
+	/* Return a socket connected to the given Unix socket, or -1 on
+	 * errors */
+
+	static bool append_file(string &message, const string &name,
+				const string &filename);
+	/* Append the content of FILENAME as the file NAME to the
+	 * message.  Return false when the file does not exist or is not
+	 * a regular file.  */
+
+	static bool next(const string &message, size_t &i, string &s);
+	static bool next_number(const string &message, size_t &i, size_t &n);
+	static bool next_file(const string &message, size_t &i,
+			      string &name, mode_t &mode, string &content);
+	/* Parse the next element of a message, starting at position I.
+	 * Return false on invalid messages.  */
+
+	static bool write_file(const string &filename, mode_t mode,
+			       const string &content);
+	/* Create the file with the given content, and the directories
+	 * containing it.  Return false on errors, with ERRNO set.  */
+
+	static bool is_relative(const string &name);
+	/* Whether NAME is relative and does not contain '..' */
+
+private:
+
+	static vector <const char *> sockets;
+
+	static size_t index_socket;
+	/* The worker to which the next job is sent first */
+
+	static vector <string> filenames_input, filenames_output;
+
+	static char socket_served[sizeof(((struct sockaddr_un *) nullptr)->sun_path)];
+
+	static const int INTERVAL_POLL_MS= 100;
+	/* In the worker, the interval in which the connection is checked
+	 * while a command is running */
+
+	static void handle(int fd) __attribute__((noreturn));
+	/* In a child process of the worker:  execute one job */
+
+	static int execute(int fd, const string &request, const string &dir,
+			   string &response);
+	/* Execute the job in the given directory, and write the
+	 * response.  Return 1 on success, 0 on system errors with ERRNO
+	 * set, and -1 on invalid requests or when the connection was
+	 * closed.  */
+
+	static void terminate(int sig);
+	/* Signal handler in the worker */
+};
+
+vector <const char *> Worker::sockets;
+size_t Worker::index_socket= 0;
+vector <string> Worker::filenames_input;
+vector <string> Worker::filenames_output;
+char Worker::socket_served[sizeof(((struct sockaddr_un *) nullptr)->sun_path)];
+
+void Worker::add(const char *socket_name)
+{
+	if (*socket_name == '\0' ||
+	    strlen(socket_name) >= sizeof(((struct sockaddr_un *) nullptr)->sun_path)) {
+		Place(Place::Type::OPTION, 'W')
+			<< fmt("invalid socket name %s", name_format_word(socket_name));
+		exit(ERROR_FATAL);
+	}
+	sockets.push_back(socket_name);
+}
+
+void Worker::prepare(const vector <string> &filenames_input_,
+		     const vector <string> &filenames_output_)
+{
+	filenames_input= filenames_input_;
+	sort(filenames_input.begin(), filenames_input.end());
+	filenames_input.erase(unique(filenames_input.begin(), filenames_input.end()),
+			      filenames_input.end());
+	filenames_output= filenames_output_;
+	index_socket= (index_socket + 1) % sockets.size();
+}
+
+void Worker::run(const char *argv0,
+		 const char *shell_options,
+		 const char *command,
+		 const map <string, string> &mapping,
+		 const string &filename_output,
+		 const string &filename_input)
+{
+	assert(is_used());
+
+	string request;
+	for (const char *s:  {argv0, shell_options, command}) {
+		request += s;
+		request += '\0';
+	}
+	request += frmt("%zu", mapping.size() + 1);
+	request += '\0';
+	for (auto &i:  mapping) {
+		request += i.first + '=' + i.second;
+		request += '\0';
+	}
+	request += "STU_STATUS=1";
+	request += '\0';
+	request += filename_output;
+	request += '\0';
+	request += filename_input;
+	request += '\0';
+	vector <string> names_input= filenames_input;
+	if (filename_input != "" &&
+	    find(names_input.begin(), names_input.end(), filename_input) == names_input.end())
+		names_input.push_back(filename_input);
+	string files;
+	size_t count= 0;
+	for (const string &name:  names_input)
+		if (is_relative(name) && append_file(files, name, name))
+			++ count;
+	request += frmt("%zu", count);
+	request += '\0';
+	request += files;
+	request += frmt("%zu", filenames_output.size());
+	request += '\0';
+	for (const string &name:  filenames_output) {
+		request += name;
+		request += '\0';
+	}
+
+	/* Try the workers in turn */
+	int fd= -1;
+	const char *name= nullptr;
+	for (size_t k= 0;  k < sockets.size() && fd < 0;  ++k) {
+		name= sockets[(index_socket + k) % sockets.size()];
+		fd= connect_socket(name);
+	}
+	if (fd < 0) {
+		perror(name);
+		_Exit(127);
+	}
+
+	string response;
+	if (! Daemon::write_all(fd, request) ||
+	    shutdown(fd, SHUT_WR) < 0 ||
+	    ! Daemon::read_all(fd, response)) {
+		perror(name);
+		_Exit(127);
+	}
+
+	size_t i= 0, status, size_out, size_err, count_files;
+	string out, err;
+	if (! next_number(response, i, status) ||
+	    ! next_number(response, i, size_out) ||
+	    size_out > response.size() - i) {
+		goto invalid;
+	}
+	out= response.substr(i, size_out);
+	i += size_out;
+	if (! next_number(response, i, size_err) ||
+	    size_err > response.size() - i) {
+		goto invalid;
+	}
+	err= response.substr(i, size_err);
+	i += size_err;
+	Daemon::write_all(1, out);
+	Daemon::write_all(2, err);
+
+	if (! next_number(response, i, count_files))
+		goto invalid;
+	for (size_t k= 0;  k < count_files;  ++k) {
+		string name_file, content;
+		mode_t mode;
+		if (! next_file(response, i, name_file, mode, content) ||
+		    find(filenames_output.begin(), filenames_output.end(), name_file)
+		    == filenames_output.end()) {
+			goto invalid;
+		}
+		if (! write_file(name_file, mode, content)) {
+			perror(name_file.c_str());
+			_Exit(127);
+		}
+	}
+	if (i != response.size())
+		goto invalid;
+
+	if (WIFSIGNALED((int) status)) {
+		signal(WTERMSIG((int) status), SIG_DFL);
+		raise(WTERMSIG((int) status));
+	}
+	_Exit(WIFEXITED((int) status) ? WEXITSTATUS((int) status) : 127);
+
+ invalid:
+	fprintf(stderr, "%s: invalid response from worker on socket %s\n",
+		PACKAGE, name);
+	_Exit(127);
+}
+
+void Worker::serve(const char *socket_name)
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family= AF_UNIX;
+	if (*socket_name == '\0' || strlen(socket_name) >= sizeof(addr.sun_path)) {
+		Place(Place::Type::OPTION, 'r')
+			<< fmt("invalid socket name %s", name_format_word(socket_name));
+		exit(ERROR_FATAL);
+	}
+	strcpy(addr.sun_path, socket_name);
+	strcpy(socket_served, socket_name);
+
+	int fd_listen= Daemon::socket_unix();
+	if (fd_listen < 0) {
+		print_error_system("socket");
+		exit(ERROR_FATAL);
+	}
+	if (connect(fd_listen, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+		print_error(fmt("Worker is already running on socket %s",
+				name_format_word(socket_name)));
+		exit(ERROR_FATAL);
+	}
+	struct stat buf;
+	if (lstat(socket_name, &buf) == 0 && S_ISSOCK(buf.st_mode))
+		unlink(socket_name);
+	if (bind(fd_listen, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+	    listen(fd_listen, 64) < 0) {
+		print_error_system(socket_name);
+		exit(ERROR_FATAL);
+	}
+	signal(SIGINT,  terminate);
+	signal(SIGTERM, terminate);
+	signal(SIGHUP,  terminate);
+	/* Child processes are reaped automatically */
+	signal(SIGCHLD, SIG_IGN);
+
+	while (true) {
+		int fd_conn= Daemon::accept_cloexec(fd_listen);
+		if (fd_conn < 0) {
+			if (errno != EINTR && errno != ECONNABORTED)
+				print_error_system("accept");
+			continue;
+		}
+		pid_t pid= fork();
+		if (pid < 0)
+			print_error_system("fork");
+		if (pid == 0) {
+			close(fd_listen);
+			signal(SIGINT,  SIG_DFL);
+			signal(SIGTERM, SIG_DFL);
+			signal(SIGHUP,  SIG_DFL);
+			signal(SIGCHLD, SIG_DFL);
+			handle(fd_conn);
+		}
+		close(fd_conn);
+	}
+}
+
+int Worker::connect_socket(const char *socket_name)
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family= AF_UNIX;
+	strcpy(addr.sun_path, socket_name);
+	int fd= Daemon::socket_unix();
+	if (fd < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		int errno_save= errno;
+		close(fd);
+		errno= errno_save;
+		return -1;
+	}
+	return fd;
+}
+
+void Worker::handle(int fd)
+{
+	string request, response;
+	if (! Daemon::read_all(fd, request))
+		_Exit(1);
+
+	/* The directory of the job contains the files of the output
+	 * and error output, and the directory in which the command is
+	 * executed */
+	const char *tmpdir= getenv("TMPDIR");
+	string dir= frmt("%s/stu-worker.XXXXXX",
+			 tmpdir && *tmpdir ? tmpdir : "/tmp");
+	if (mkdtemp(&dir[0]) == nullptr) {
+		perror(dir.c_str());
+		_Exit(1);
+	}
+
+	int ret= execute(fd, request, dir, response);
+	if (ret == 0) {
+		/* A system error, reported as the error output of a
+		 * failed command */
+		string message= frmt("%s: %s\n", PACKAGE, strerror(errno));
+		response= frmt("%d", W_EXITCODE(127, 0));
+		response += '\0';
+		response += "0";
+		response += '\0';
+		response += frmt("%zu", message.size());
+		response += '\0';
+		response += message;
+		response += "0";
+		response += '\0';
+	}
+
+	nftw(dir.c_str(),
+	     [](const char *name, const struct stat *, int, struct FTW *) {
+		     return remove(name);
+	     },
+	     16, FTW_DEPTH | FTW_PHYS);
+
+	if (ret >= 0)
+		Daemon::write_all(fd, response);
+	_Exit(0);
+}
+
+int Worker::execute(int fd, const string &request, const string &dir,
+		    string &response)
+{
+	size_t i= 0, count_vars, count_input, count_output;
+	string argv0, shell_options, command, filename_output, filename_input;
+	vector <string> vars, names_output;
+	if (! next(request, i, argv0) ||
+	    ! next(request, i, shell_options) ||
+	    ! next(request, i, command) ||
+	    ! next_number(request, i, count_vars))
+		return -1;
+	for (size_t k= 0;  k < count_vars;  ++k) {
+		string var;
+		if (! next(request, i, var) || var.find('=') == string::npos)
+			return -1;
+		vars.push_back(var);
+	}
+	if (! next(request, i, filename_output) ||
+	    ! next(request, i, filename_input) ||
+	    ! next_number(request, i, count_input))
+		return -1;
+
+	const string dir_root= dir + "/root";
+	const string filename_out= dir + "/out", filename_err= dir + "/err";
+	if (mkdir(dir_root.c_str(), 0777) < 0)
+		return 0;
+	for (size_t k= 0;  k < count_input;  ++k) {
+		string name, content;
+		mode_t mode;
+		if (! next_file(request, i, name, mode, content))
+			return -1;
+		if (is_relative(name) &&
+		    ! write_file(dir_root + '/' + name, mode, content))
+			return 0;
+	}
+	if (! next_number(request, i, count_output))
+		return -1;
+	for (size_t k= 0;  k < count_output;  ++k) {
+		string name;
+		if (! next(request, i, name))
+			return -1;
+		names_output.push_back(name);
+	}
+	if (i != request.size())
+		return -1;
+
+	pid_t pid= fork();
+	if (pid < 0)
+		return 0;
+	if (pid == 0) {
+		setpgid(0, 0);
+		if (chdir(dir_root.c_str()) < 0) {
+			perror(dir_root.c_str());
+			_Exit(127);
+		}
+		const bool redirect= filename_output != "" && is_relative(filename_output);
+		const char *name_out= redirect ? filename_output.c_str() : filename_out.c_str();
+		const char *name_in= filename_input != "" ? filename_input.c_str() : "/dev/null";
+		int fd_err= creat(filename_err.c_str(), 0666);
+		if (fd_err < 0 || dup2(fd_err, 2) < 0)
+			_Exit(127);
+		int fd_out= creat(name_out, 0666);
+		if (fd_out < 0 || dup2(fd_out, 1) < 0) {
+			perror(name_out);
+			_Exit(127);
+		}
+		int fd_in= open(name_in, O_RDONLY);
+		if (fd_in < 0 || dup2(fd_in, 0) < 0) {
+			perror(name_in);
+			_Exit(127);
+		}
+		for (const string &var:  vars) {
+			size_t p= var.find('=');
+			setenv(var.substr(0, p).c_str(), var.c_str() + p + 1, 1);
+		}
+		const char *shell= getenv("STU_SHELL");
+		if (shell == nullptr || shell[0] == '\0')
+			shell= "/bin/sh";
+		if (command[0] == '-' || command[0] == '+')
+			command= ' ' + command;
+		const char *argv[]= {argv0.c_str(), shell_options.c_str(), "-c",
+				     command.c_str(), nullptr};
+		execv(shell, (char *const *) argv);
+		perror("execv");
+		_Exit(127);
+	}
+
+	/* Wait for the command, and kill it when the connection is
+	 * closed by Stu */
+	int status;
+	while (true) {
+		pid_t r= waitpid(pid, &status, WNOHANG);
+		if (r == pid)
+			break;
+		if (r < 0 && errno != EINTR)
+			return 0;
+		struct pollfd pfd= {fd, 0, 0};
+		if (poll(&pfd, 1, INTERVAL_POLL_MS) > 0 && pfd.revents & (POLLHUP | POLLERR)) {
+			kill(-pid, SIGTERM);
+			kill(-pid, SIGCONT);
+			waitpid(pid, &status, 0);
+			return -1;
+		}
+	}
+
+	response= frmt("%d", status);
+	response += '\0';
+	for (const string &filename:  {filename_out, filename_err}) {
+		string content;
+		int fd_file= open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd_file >= 0) {
+			Daemon::read_all(fd_file, content);
+			close(fd_file);
+		}
+		response += frmt("%zu", content.size());
+		response += '\0';
+		response += content;
+	}
+	string files;
+	size_t count= 0;
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+		for (const string &name:  names_output)
+			if (is_relative(name) && append_file(files, name, dir_root + '/' + name))
+				++ count;
+	response += frmt("%zu", count);
+	response += '\0';
+	response += files;
+	return 1;
+}
+
+bool Worker::append_file(string &message, const string &name,
+			 const string &filename)
+{
+	int fd= open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	struct stat buf;
+	string content;
+	if (fstat(fd, &buf) < 0 || ! S_ISREG(buf.st_mode) ||
+	    ! Daemon::read_all(fd, content)) {
+		close(fd);
+		return false;
+	}
+	close(fd);
+	message += name;
+	message += '\0';
+	message += frmt("%o", (unsigned) (buf.st_mode & 07777));
+	message += '\0';
+	message += frmt("%zu", content.size());
+	message += '\0';
+	message += content;
+	return true;
+}
+
+bool Worker::next(const string &message, size_t &i, string &s)
+{
+	size_t j= message.find('\0', i);
+	if (j == string::npos)
+		return false;
+	s= message.substr(i, j - i);
+	i= j + 1;
+	return true;
+}
+
+bool Worker::next_number(const string &message, size_t &i, size_t &n)
+{
+	string s;
+	if (! next(message, i, s) || s.empty() ||
+	    s.find_first_not_of("0123456789") != string::npos)
+		return false;
+	n= strtoul(s.c_str(), nullptr, 10);
+	return true;
+}
+
+bool Worker::next_file(const string &message, size_t &i,
+		       string &name, mode_t &mode, string &content)
+{
+	string s;
+	size_t size;
+	if (! next(message, i, name) || name.empty() ||
+	    ! next(message, i, s) || s.empty() ||
+	    s.find_first_not_of("01234567") != string::npos ||
+	    ! next_number(message, i, size) ||
+	    size > message.size() - i)
+		return false;
+	mode= strtoul(s.c_str(), nullptr, 8) & 07777;
+	content= message.substr(i, size);
+	i += size;
+	return true;
+}
+
+bool Worker::write_file(const string &filename, mode_t mode,
+			const string &content)
+{
+	for (size_t p= filename.find('/', 1);  p != string::npos;
+	     p= filename.find('/', p + 1)) {
+		if (mkdir(filename.substr(0, p).c_str(), 0777) < 0 && errno != EEXIST)
+			return false;
+	}
+	int fd= open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+	if (fd < 0)
+		return false;
+	if (! Daemon::write_all(fd, content)) {
+		int errno_save= errno;
+		close(fd);
+		errno= errno_save;
+		return false;
+	}
+	return close(fd) == 0;
+}
+
+bool Worker::is_relative(const string &name)
+{
+	if (name.empty() || name[0] == '/')
+		return false;
+	for (size_t p= 0;  p != string::npos; ) {
+		size_t q= name.find('/', p);
+		if (name.substr(p, q == string::npos ? q : q - p) == "..")
+			return false;
+		p= q == string::npos ? q : q + 1;
+	}
+	return true;
+}
+
+void Worker::terminate(int sig)
+{
+	unlink(socket_served);
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+#endif /* ! WORKER_HH */